@@ -1,3 +1,62 @@
 var retroApi = require('bindings')('retro-api')
 
 module.exports = retroApi
+
+// Serializes now, compresses and writes on a background thread
+// @return Promise resolving to the state size in bytes
+module.exports.saveStateToFile = function (path, options) {
+  options = options || {}
+  var compress = options.compress !== false
+  var sync = !!options.sync
+  return new Promise(function (resolve, reject) {
+    retroApi.coreStateSaveFile(path, compress, sync, function (err, size) {
+      if (err) reject(err)
+      else resolve(size)
+    })
+  })
+}
+
+module.exports.loadStateFromFile = function (path) {
+  return new Promise(function (resolve, reject) {
+    retroApi.coreStateLoadFile(path, function (err) {
+      if (err) reject(err)
+      else resolve()
+    })
+  })
+}
+
+// Rollback netplay against a remote player, or with `loopback`, against a second instance of the
+// core in this process, over the given simulated network conditions
+module.exports.netplayStart = function (options) {
+  options = options || {}
+  retroApi.coreNetplayStart(
+    options.player || 0,
+    options.localPort || 0,
+    options.remoteHost || '127.0.0.1',
+    options.remotePort || 0,
+    options.inputDelay !== undefined ? options.inputDelay : 1,
+    options.maxRollback || 8,
+    options.latencyMs || 0,
+    options.jitterMs || 0,
+    options.loss || 0,
+    !!options.loopback)
+}
+
+// Hashes on a background thread, `path` may name an archive entry (archive.zip#entry)
+// @return Promise resolving to { size, crc32, sha1 }
+module.exports.hashFile = function (path) {
+  return new Promise(function (resolve, reject) {
+    retroApi.coreHashFile(path, function (err, size, crc32, sha1) {
+      if (err) reject(err)
+      else resolve({ size: size, crc32: crc32, sha1: sha1 })
+    })
+  })
+}
+
+// Looks content up in the database opened with coreHashDbOpen
+// @return Promise resolving to the metadata of the matching record, or null
+module.exports.identify = function (path) {
+  return module.exports.hashFile(path).then(function (hashes) {
+    return retroApi.coreHashDbLookup(hashes.crc32, hashes.size, hashes.sha1)
+  })
+}
@@ -0,0 +1,104 @@
+#include "autosave.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "fileio.h"
+
+
+SramAutosave::SramAutosave(const std::string & path, size_t debounceMs, size_t maxDelayMs)
+  : path_(path)
+  , debounce_(std::chrono::milliseconds(debounceMs))
+  , maxDelay_(std::chrono::milliseconds(std::max(debounceMs, maxDelayMs)))
+{
+  thread_ = std::thread(&SramAutosave::worker_, this);
+}
+
+SramAutosave::~SramAutosave()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  cond_.notify_one();
+  thread_.join();
+}
+
+void SramAutosave::check(const uint8_t * sram, size_t size)
+{
+  const auto start = Clock::now();
+
+  // The first look only records what was loaded
+  if (shadow_.size() != size) {
+    shadow_.assign(sram, sram + size);
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.checks++;
+    return;
+  }
+
+  // memcmp is vectorized by every libc and bails out at the first difference
+  const bool changed = memcmp(shadow_.data(), sram, size) != 0;
+  if (changed) memcpy(shadow_.data(), sram, size);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.checks++;
+  stats_.checkUs += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+  if (!changed) return;
+
+  stats_.changes++;
+  pending_ = shadow_;
+  const auto now = Clock::now();
+  if (!dirty_) firstChange_ = now;
+  lastChange_ = now;
+  dirty_ = true;
+  cond_.notify_one();
+}
+
+void SramAutosave::flush()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    flush_ = true;
+  }
+  cond_.notify_one();
+}
+
+AutosaveStats SramAutosave::stats()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void SramAutosave::worker_()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    if (!dirty_) {
+      flush_ = false;
+      if (quit_) return;
+      cond_.wait(lock);
+      continue;
+    }
+
+    const auto now = Clock::now();
+    const auto due = std::min(lastChange_ + debounce_, firstChange_ + maxDelay_);
+    if (now < due && !flush_ && !quit_) {
+      cond_.wait_until(lock, due);
+      continue;
+    }
+
+    writing_.swap(pending_);
+    dirty_ = false;
+    flush_ = false;
+    lock.unlock();
+
+    const auto start = Clock::now();
+    const bool ok = fileWriteAtomic(path_, { { writing_.data(), writing_.size() } }, true);
+    const double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    lock.lock();
+    stats_.writes++;
+    stats_.writeUs += us;
+    if (!ok) stats_.failures++;
+  }
+}
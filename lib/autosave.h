@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// SRAM AUTOSAVE
+//--------------------------------------------------------------------------------------------------
+
+struct AutosaveStats
+{
+  size_t checks = 0;     // Frames the SRAM was compared
+  size_t changes = 0;    // Frames it had changed
+  size_t writes = 0;     // Files written, several changes collapse into one
+  size_t failures = 0;
+  double checkUs = 0.0;  // Accumulated compare time, in microseconds
+  double writeUs = 0.0;  // Accumulated write time on the helper thread
+};
+
+// Compares the SRAM with a shadow copy every frame; changes are handed over to a helper thread
+// which replaces the save file once the SRAM has been stable for `debounceMs`, or at least
+// every `maxDelayMs` while it keeps changing. The emulation thread never touches the disk.
+class SramAutosave
+{
+public:
+  SramAutosave(const std::string & path, size_t debounceMs, size_t maxDelayMs);
+
+  // Writes what is still pending before returning
+  ~SramAutosave();
+
+  SramAutosave(const SramAutosave &) = delete;
+  SramAutosave & operator=(const SramAutosave &) = delete;
+
+  void check(const uint8_t * sram, size_t size);
+
+  // Writes pending changes without waiting for the debounce delay
+  void flush();
+
+  AutosaveStats stats();
+  const std::string & path() const { return path_; }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  void worker_();
+
+  const std::string path_;
+  const Clock::duration debounce_;
+  const Clock::duration maxDelay_;
+
+  std::vector<uint8_t> shadow_; // Emulation thread only
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::thread thread_;
+  bool quit_ = false;
+  bool flush_ = false;
+
+  std::vector<uint8_t> pending_;
+  bool dirty_ = false;
+  Clock::time_point firstChange_;
+  Clock::time_point lastChange_;
+  std::vector<uint8_t> writing_; // Helper thread only
+
+  AutosaveStats stats_;
+};
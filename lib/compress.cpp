@@ -0,0 +1,107 @@
+#include "compress.h"
+
+#include <cstring>
+
+
+namespace
+{
+
+  // A literal run ends at the first zero run at least this long
+  const size_t MIN_ZERO_RUN = 16;
+
+  inline uint64_t load64(const uint8_t * p)
+  {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  inline uint64_t xor64(const uint8_t * data, const uint8_t * ref, size_t i)
+  {
+    return ref ? (load64(data + i) ^ load64(ref + i)) : load64(data + i);
+  }
+
+  inline uint8_t xor8(const uint8_t * data, const uint8_t * ref, size_t i)
+  {
+    return ref ? (data[i] ^ ref[i]) : data[i];
+  }
+
+  inline void putVarint(std::vector<uint8_t> & out, size_t v)
+  {
+    while (v >= 0x80) {
+      out.push_back((uint8_t)(v | 0x80));
+      v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+  }
+
+  inline bool getVarint(const uint8_t *& p, const uint8_t * end, size_t & v)
+  {
+    v = 0;
+    for (size_t shift=0; p < end && shift < 64; shift += 7) {
+      const uint8_t b = *p++;
+      v |= (size_t)(b & 0x7f) << shift;
+      if (!(b & 0x80)) return true;
+    }
+    return false;
+  }
+
+} // anonymous namespace
+
+size_t deltaEncode(const uint8_t * data, const uint8_t * ref, size_t size, std::vector<uint8_t> & out)
+{
+  const size_t startSize = out.size();
+  size_t i = 0;
+
+  while (i < size) {
+    // Zero run, 8 bytes at a time then byte by byte
+    size_t z = i;
+    while (z + 8 <= size && xor64(data, ref, z) == 0) z += 8;
+    while (z < size && xor8(data, ref, z) == 0) z++;
+
+    // Literal run, up to the next long enough zero run
+    size_t l = z;
+    while (l < size) {
+      if (l + MIN_ZERO_RUN <= size) {
+        if (xor64(data, ref, l) == 0 && xor64(data, ref, l + 8) == 0) break;
+        l += 8;
+      }
+      else {
+        l = size;
+      }
+    }
+
+    putVarint(out, z - i);
+    putVarint(out, l - z);
+    const size_t litStart = out.size();
+    out.resize(litStart + (l - z));
+    uint8_t * lit = &out[0] + litStart;
+    for (size_t k=z; k<l; k++) {
+      *lit++ = xor8(data, ref, k);
+    }
+
+    i = l;
+  }
+
+  return out.size() - startSize;
+}
+
+bool deltaApply(const uint8_t * enc, size_t encSize, uint8_t * data, size_t size)
+{
+  const uint8_t * p = enc;
+  const uint8_t * end = enc + encSize;
+  size_t i = 0;
+
+  while (p < end) {
+    size_t zeros, literals;
+    if (!getVarint(p, end, zeros) || !getVarint(p, end, literals)) return false;
+    if (zeros > size - i) return false;
+    i += zeros;
+    if (literals > size - i || literals > (size_t)(end - p)) return false;
+    for (size_t k=0; k<literals; k++) {
+      data[i++] ^= *p++;
+    }
+  }
+
+  return i == size;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+
+// DELTA CODEC
+//--------------------------------------------------------------------------------------------------
+
+// Save states barely change between frames and are mostly zeros, so both are stored as an
+// alternation of zero runs and literal runs:
+//   [varint zeroCount] [varint literalCount] [literal bytes] ...
+// applied to `data XOR ref`.
+
+// Appends the encoding of `data XOR ref` to `out`
+// @param ref May be null, in which case `data` is encoded as is
+// @return Encoded size
+size_t deltaEncode(const uint8_t * data, const uint8_t * ref, size_t size, std::vector<uint8_t> & out);
+
+// XORs the decoded bytes into `data` (zero it first to decode a plain encoding)
+// @return false if the encoding is corrupted or does not match `size`
+bool deltaApply(const uint8_t * enc, size_t encSize, uint8_t * data, size_t size);
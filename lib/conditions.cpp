@@ -0,0 +1,395 @@
+#include "conditions.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace
+{
+
+  const size_t MAX_OPERAND = (1u << 24) - 1;
+
+} // anonymous namespace
+
+// Recursive descent straight to bytecode, tracking how deep the stack gets
+class ConditionSet::Compiler
+{
+public:
+  Compiler(ConditionSet & set, const std::string & source) : set_(set), src_(source) {}
+
+  bool compile(Condition & cond, std::string & error)
+  {
+    expr();
+    skipSpaces();
+    if (error_.empty() && pos_ < src_.size()) fail("unexpected '" + std::string(1, src_[pos_]) + "'");
+    cond.reads = reads_; // Released by the caller on failure
+    if (!error_.empty()) {
+      error = error_ + " at column " + std::to_string(errorPos_ + 1);
+      return false;
+    }
+    cond.code = code_;
+    cond.consts = consts_;
+    cond.stackDepth = maxDepth_;
+    return true;
+  }
+
+private:
+  void fail(const std::string & message)
+  {
+    if (!error_.empty()) return;
+    error_ = message;
+    errorPos_ = pos_;
+  }
+
+  void skipSpaces()
+  {
+    while (pos_ < src_.size() && isspace((unsigned char)src_[pos_])) pos_++;
+  }
+
+  bool accept(const char * token)
+  {
+    skipSpaces();
+    const size_t len = strlen(token);
+    if (src_.compare(pos_, len, token) != 0) return false;
+    // '<' must not swallow the first half of '<=', nor '&' the one of '&&'
+    if (len == 1 && pos_ + 1 < src_.size()) {
+      const char next = src_[pos_ + 1];
+      if ((strchr("<>!", token[0]) && next == '=') || (strchr("&|", token[0]) && next == token[0])) return false;
+    }
+    pos_ += len;
+    return true;
+  }
+
+  void expect(const char * token)
+  {
+    if (!accept(token)) fail(std::string("expected '") + token + "'");
+  }
+
+  void emit(Op op, uint32_t operand = 0, int stackEffect = 0)
+  {
+    code_.push_back(encode(op, operand));
+    depth_ += stackEffect;
+    maxDepth_ = std::max(maxDepth_, (size_t)depth_);
+  }
+
+  void binary(Op op) { emit(op, 0, -1); }
+
+  void expr() { orExpr(); }
+
+  void orExpr()
+  {
+    andExpr();
+    while (error_.empty() && accept("||")) { andExpr(); binary(OP_LOR); }
+  }
+
+  void andExpr()
+  {
+    cmpExpr();
+    while (error_.empty() && accept("&&")) { cmpExpr(); binary(OP_LAND); }
+  }
+
+  void cmpExpr()
+  {
+    bitsExpr();
+    if (!error_.empty()) return;
+    static const struct { const char * token; Op op; } ops[] = {
+      { "==", OP_EQ }, { "!=", OP_NE }, { "<=", OP_LE }, { ">=", OP_GE }, { "<", OP_LT }, { ">", OP_GT },
+    };
+    for (const auto & o : ops) {
+      if (accept(o.token)) {
+        bitsExpr();
+        binary(o.op);
+        return;
+      }
+    }
+  }
+
+  void bitsExpr()
+  {
+    sumExpr();
+    while (error_.empty()) {
+      if (accept("&")) { sumExpr(); binary(OP_BAND); }
+      else if (accept("|")) { sumExpr(); binary(OP_BOR); }
+      else if (accept("^")) { sumExpr(); binary(OP_BXOR); }
+      else break;
+    }
+  }
+
+  void sumExpr()
+  {
+    product();
+    while (error_.empty()) {
+      if (accept("+")) { product(); binary(OP_ADD); }
+      else if (accept("-")) { product(); binary(OP_SUB); }
+      else break;
+    }
+  }
+
+  void product()
+  {
+    unary();
+    while (error_.empty()) {
+      if (accept("*")) { unary(); binary(OP_MUL); }
+      else if (accept("/")) { unary(); binary(OP_DIV); }
+      else if (accept("%")) { unary(); binary(OP_MOD); }
+      else break;
+    }
+  }
+
+  void unary()
+  {
+    if (accept("!")) { unary(); emit(OP_NOT); }
+    else if (accept("-")) { unary(); emit(OP_NEG); }
+    else primary();
+  }
+
+  // Decimal, or hexadecimal with a 0x prefix; a leading 0 does not mean octal
+  bool number(uint64_t & value)
+  {
+    skipSpaces();
+    if (pos_ >= src_.size() || !isdigit((unsigned char)src_[pos_])) return false;
+
+    value = 0;
+    if (src_.compare(pos_, 2, "0x") == 0 || src_.compare(pos_, 2, "0X") == 0) {
+      pos_ += 2;
+      if (pos_ >= src_.size() || !isxdigit((unsigned char)src_[pos_])) {
+        fail("expected hexadecimal digits");
+        return true;
+      }
+      while (pos_ < src_.size() && isxdigit((unsigned char)src_[pos_])) {
+        const char c = (char)tolower((unsigned char)src_[pos_++]);
+        value = value * 16 + (uint64_t)(isdigit((unsigned char)c) ? c - '0' : c - 'a' + 10);
+      }
+      return true;
+    }
+    while (pos_ < src_.size() && isdigit((unsigned char)src_[pos_])) {
+      value = value * 10 + (uint64_t)(src_[pos_++] - '0');
+    }
+    return true;
+  }
+
+  std::string word()
+  {
+    skipSpaces();
+    size_t end = pos_;
+    while (end < src_.size() && isalnum((unsigned char)src_[end])) end++;
+    return src_.substr(pos_, end - pos_);
+  }
+
+  // @return Read slot, or -1 if there is no memory operand here
+  int64_t mem()
+  {
+    const std::string w = word();
+    bool isSigned;
+    if (w.compare(0, 1, "u") == 0) isSigned = false;
+    else if (w.compare(0, 1, "s") == 0) isSigned = true;
+    else return -1;
+
+    std::string rest = w.substr(1);
+    bool bigEndian = false;
+    if (rest.size() > 2 && rest.compare(rest.size() - 2, 2, "be") == 0) {
+      bigEndian = true;
+      rest.resize(rest.size() - 2);
+    }
+    uint8_t width;
+    if (rest == "8") width = 1;
+    else if (rest == "16") width = 2;
+    else if (rest == "32") width = 4;
+    else return -1;
+
+    pos_ += w.size();
+    expect("[");
+    uint64_t address = 0;
+    if (!number(address)) fail("expected an address");
+    expect("]");
+    const uint32_t slot = set_.readSlot(address, width, isSigned, bigEndian);
+    reads_.push_back(slot);
+    return slot;
+  }
+
+  void primary()
+  {
+    if (!error_.empty()) return;
+
+    uint64_t value;
+    if (number(value)) {
+      consts_.push_back((int64_t)value);
+      if (consts_.size() > MAX_OPERAND) return fail("too many constants");
+      emit(OP_CONST, (uint32_t)consts_.size() - 1, 1);
+      return;
+    }
+    if (accept("(")) {
+      expr();
+      expect(")");
+      return;
+    }
+
+    const std::string w = word();
+    if (w == "prev" || w == "delta") {
+      pos_ += w.size();
+      expect("(");
+      const int64_t slot = mem();
+      if (slot < 0) return fail("expected a memory operand");
+      expect(")");
+      if (w == "delta") {
+        emit(OP_READ, (uint32_t)slot, 1);
+        emit(OP_PREV, (uint32_t)slot, 1);
+        binary(OP_SUB);
+      }
+      else {
+        emit(OP_PREV, (uint32_t)slot, 1);
+      }
+      return;
+    }
+
+    const int64_t slot = mem();
+    if (slot < 0) return fail("expected a value");
+    emit(OP_READ, (uint32_t)slot, 1);
+  }
+
+  ConditionSet & set_;
+  const std::string & src_;
+  size_t pos_ = 0;
+  std::vector<uint32_t> code_;
+  std::vector<int64_t> consts_;
+  std::vector<uint32_t> reads_;
+  int depth_ = 0;
+  size_t maxDepth_ = 0;
+  std::string error_;
+  size_t errorPos_ = 0;
+};
+
+uint32_t ConditionSet::readSlot(uint64_t address, uint8_t width, bool isSigned, bool bigEndian)
+{
+  size_t slot = reads_.size();
+  for (size_t i=0; i<reads_.size(); i++) {
+    Read & r = reads_[i];
+    if (r.refs && r.address == address && r.width == width && r.isSigned == isSigned && r.bigEndian == bigEndian) {
+      r.refs++;
+      return (uint32_t)i;
+    }
+    if (!r.refs && slot == reads_.size()) slot = i;
+  }
+
+  const Read read { address, width, isSigned, bigEndian, false, 0, 0, 1 };
+  if (slot == reads_.size()) reads_.push_back(read);
+  else reads_[slot] = read;
+  return (uint32_t)slot;
+}
+
+void ConditionSet::releaseSlots(const std::vector<uint32_t> & slots)
+{
+  for (const uint32_t slot : slots) reads_[slot].refs--;
+  while (!reads_.empty() && !reads_.back().refs) reads_.pop_back();
+}
+
+int64_t ConditionSet::add(const std::string & source, uint32_t hitTarget, std::string & error)
+{
+  // Nothing compiled is kept if it fails
+  Condition cond;
+  if (!Compiler(*this, source).compile(cond, error) || reads_.size() > MAX_OPERAND) {
+    releaseSlots(cond.reads);
+    if (error.empty()) error = "too many memory operands";
+    return -1;
+  }
+  cond.hitTarget = std::max<uint32_t>(1, hitTarget);
+  cond.hits = 0;
+
+  const uint32_t id = nextId_++;
+  conditions_[id] = cond;
+  return id;
+}
+
+// Operands only this condition used stop being read
+bool ConditionSet::remove(uint32_t id)
+{
+  const auto it = conditions_.find(id);
+  if (it == conditions_.end()) return false;
+  releaseSlots(it->second.reads);
+  conditions_.erase(it);
+  return true;
+}
+
+void ConditionSet::clear()
+{
+  reads_.clear();
+  conditions_.clear();
+  triggered_.clear();
+}
+
+void ConditionSet::resetHits()
+{
+  for (auto & entry : conditions_) entry.second.hits = 0;
+}
+
+uint32_t ConditionSet::hits(uint32_t id) const
+{
+  const auto it = conditions_.find(id);
+  return it == conditions_.end() ? 0 : it->second.hits;
+}
+
+void ConditionSet::evaluate(const Translate & translate)
+{
+  triggered_.clear();
+  if (conditions_.empty()) return;
+
+  // Every operand is read once per frame, however many conditions use it
+  for (Read & r : reads_) {
+    if (!r.refs) continue;
+    uint32_t value = 0;
+    for (unsigned b=0; b<r.width; b++) {
+      const uint8_t * p = translate(r.address + b);
+      const uint32_t byte = p ? *p : 0;
+      value |= byte << (8 * (r.bigEndian ? r.width - 1 - b : b));
+    }
+    r.prev = r.primed ? r.cur : 0;
+    switch (r.width) {
+      case 1: r.cur = r.isSigned ? (int64_t)(int8_t)value : (int64_t)value; break;
+      case 2: r.cur = r.isSigned ? (int64_t)(int16_t)value : (int64_t)value; break;
+      default: r.cur = r.isSigned ? (int64_t)(int32_t)value : (int64_t)value; break;
+    }
+    if (!r.primed) r.prev = r.cur;
+    r.primed = true;
+  }
+
+  for (auto & entry : conditions_) {
+    Condition & cond = entry.second;
+    stack_.resize(std::max(stack_.size(), cond.stackDepth + 1));
+    int64_t * sp = stack_.data();
+
+    for (const uint32_t insn : cond.code) {
+      const uint32_t operand = insn >> 8;
+      switch ((Op)(insn & 0xFF)) {
+        case OP_CONST: *sp++ = cond.consts[operand]; break;
+        case OP_READ: *sp++ = reads_[operand].cur; break;
+        case OP_PREV: *sp++ = reads_[operand].prev; break;
+        // Wrapping arithmetic, and no trap on x / 0 nor INT64_MIN / -1
+        case OP_ADD: sp--; sp[-1] = (int64_t)((uint64_t)sp[-1] + (uint64_t)sp[0]); break;
+        case OP_SUB: sp--; sp[-1] = (int64_t)((uint64_t)sp[-1] - (uint64_t)sp[0]); break;
+        case OP_MUL: sp--; sp[-1] = (int64_t)((uint64_t)sp[-1] * (uint64_t)sp[0]); break;
+        case OP_DIV: sp--; sp[-1] = sp[0] == -1 ? (int64_t)(0 - (uint64_t)sp[-1]) : sp[0] ? sp[-1] / sp[0] : 0; break;
+        case OP_MOD: sp--; sp[-1] = (sp[0] == 0 || sp[0] == -1) ? 0 : sp[-1] % sp[0]; break;
+        case OP_BAND: sp--; sp[-1] &= sp[0]; break;
+        case OP_BOR: sp--; sp[-1] |= sp[0]; break;
+        case OP_BXOR: sp--; sp[-1] ^= sp[0]; break;
+        case OP_EQ: sp--; sp[-1] = sp[-1] == sp[0]; break;
+        case OP_NE: sp--; sp[-1] = sp[-1] != sp[0]; break;
+        case OP_LT: sp--; sp[-1] = sp[-1] < sp[0]; break;
+        case OP_LE: sp--; sp[-1] = sp[-1] <= sp[0]; break;
+        case OP_GT: sp--; sp[-1] = sp[-1] > sp[0]; break;
+        case OP_GE: sp--; sp[-1] = sp[-1] >= sp[0]; break;
+        case OP_LAND: sp--; sp[-1] = sp[-1] && sp[0]; break;
+        case OP_LOR: sp--; sp[-1] = sp[-1] || sp[0]; break;
+        case OP_NOT: sp[-1] = !sp[-1]; break;
+        case OP_NEG: sp[-1] = (int64_t)(0 - (uint64_t)sp[-1]); break;
+      }
+    }
+
+    if (sp[-1] != 0) {
+      if (cond.hits < cond.hitTarget) cond.hits++;
+      if (cond.hits >= cond.hitTarget) triggered_.push_back(entry.first);
+    }
+  }
+}
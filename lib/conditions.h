@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// MEMORY CONDITIONS
+//--------------------------------------------------------------------------------------------------
+
+// Expressions over game memory, compiled once to a stack bytecode and evaluated after every frame:
+//
+//   expr    := or
+//   or      := and ('||' and)*
+//   and     := cmp ('&&' cmp)*
+//   cmp     := bits (('==' | '!=' | '<' | '<=' | '>' | '>=') bits)?
+//   bits    := sum (('&' | '|' | '^') sum)*
+//   sum     := product (('+' | '-') product)*
+//   product := unary (('*' | '/' | '%') unary)*
+//   unary   := ('!' | '-') unary | primary
+//   primary := number | mem | 'prev(' mem ')' | 'delta(' mem ')' | '(' expr ')'
+//   mem     := ('u8' | 's8' | 'u16' | 's16' | 'u32' | 's32') ('be')? '[' number ']'
+//
+// Numbers are decimal or 0x hexadecimal, prev() is the value at the end of the previous frame and
+// delta() the change since then. Arithmetic wraps around on 64 bits and division by zero gives 0.
+// A condition triggers on every frame it holds once it held on `hitTarget` frames.
+
+class ConditionSet
+{
+public:
+  // Host byte behind an emulated address, nullptr if unmapped
+  typedef std::function<const uint8_t *(uint64_t address)> Translate;
+
+  // @return Id of the condition, -1 with `error` set if the expression does not compile
+  int64_t add(const std::string & source, uint32_t hitTarget, std::string & error);
+  bool remove(uint32_t id);
+  void clear();
+  void resetHits();
+
+  void evaluate(const Translate & translate);
+
+  // Conditions which triggered during the last evaluation
+  const std::vector<uint32_t> & triggered() const { return triggered_; }
+  uint32_t hits(uint32_t id) const;
+  bool empty() const { return conditions_.empty(); }
+
+private:
+  enum Op : uint8_t
+  {
+    OP_CONST, OP_READ, OP_PREV,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+    OP_BAND, OP_BOR, OP_BXOR,
+    OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE,
+    OP_LAND, OP_LOR, OP_NOT, OP_NEG,
+  };
+
+  // Instruction word: operation in the low 8 bits, operand (constant or read index) above
+  static uint32_t encode(Op op, uint32_t operand = 0) { return (uint32_t)op | (operand << 8); }
+
+  struct Read
+  {
+    uint64_t address;
+    uint8_t width;
+    bool isSigned;
+    bool bigEndian;
+    bool primed;     // prev holds a value read at the end of a frame
+    int64_t cur;
+    int64_t prev;
+    uint32_t refs;   // Operands using it, free slot when 0
+  };
+
+  struct Condition
+  {
+    std::vector<uint32_t> code;
+    std::vector<int64_t> consts;
+    std::vector<uint32_t> reads; // Slots, once per operand
+    size_t stackDepth;
+    uint32_t hitTarget;
+    uint32_t hits;
+  };
+
+  class Compiler;
+
+  uint32_t readSlot(uint64_t address, uint8_t width, bool isSigned, bool bigEndian);
+  void releaseSlots(const std::vector<uint32_t> & slots);
+
+  std::vector<Read> reads_;
+  std::map<uint32_t, Condition> conditions_;
+  std::vector<uint32_t> triggered_;
+  std::vector<int64_t> stack_;
+  uint32_t nextId_ = 1;
+};
@@ -1,34 +1,157 @@
 #include "core.h"
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <cstdlib>
+#include <fstream>
+#include <list>
 #include <map>
 #include <memory>
-#include <tuple>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
 
+#include "autosave.h"
+#include "conditions.h"
+#include "coreinfo.h"
 #include "dynload.h"
+#include "fileio.h"
+#include "hash.h"
+#include "inputqueue.h"
+#include "logsink.h"
+#include "memmap.h"
+#include "memscan.h"
+#include "movie.h"
+#include "perfcounters.h"
+#include "netplay.h"
 #include "retro.h"
+#include "rewind.h"
+#include "romcache.h"
+#include "statepool.h"
+#include "zip.h"
 
 
+#define CORE_LIBRARY_BIND(name, required) \
+  coreBind(retro.name, "retro_" #name, required)
+
+#define CORE_LIBRARY_DECL(name) \
+  decltype(retro_ ## name) *  name = nullptr
+
 namespace
 {
 
+  // See coreSetBindingMode
+  std::atomic<bool> gEagerBinding(true);
+  std::atomic<bool> gDeepBinding(false);
+
+  // Entry points of one loaded core library, the whole API of retro.h
+  struct CoreApi
+  {
+    CORE_LIBRARY_DECL(set_environment);
+    CORE_LIBRARY_DECL(set_video_refresh);
+    CORE_LIBRARY_DECL(set_audio_sample);
+    CORE_LIBRARY_DECL(set_audio_sample_batch);
+    CORE_LIBRARY_DECL(set_input_poll);
+    CORE_LIBRARY_DECL(set_input_state);
+    CORE_LIBRARY_DECL(init);
+    CORE_LIBRARY_DECL(deinit);
+    CORE_LIBRARY_DECL(api_version);
+    CORE_LIBRARY_DECL(get_system_info);
+    CORE_LIBRARY_DECL(get_system_av_info);
+    CORE_LIBRARY_DECL(set_controller_port_device);
+    CORE_LIBRARY_DECL(reset);
+    CORE_LIBRARY_DECL(run);
+    CORE_LIBRARY_DECL(serialize_size);
+    CORE_LIBRARY_DECL(serialize);
+    CORE_LIBRARY_DECL(unserialize);
+    CORE_LIBRARY_DECL(cheat_reset);
+    CORE_LIBRARY_DECL(cheat_set);
+    CORE_LIBRARY_DECL(load_game);
+    CORE_LIBRARY_DECL(load_game_special);
+    CORE_LIBRARY_DECL(unload_game);
+    CORE_LIBRARY_DECL(get_region);
+    CORE_LIBRARY_DECL(get_memory_data);
+    CORE_LIBRARY_DECL(get_memory_size);
+  };
+
   struct CoreState
   {
-    CoreState(const std::string & corePath)
+    // @param libPath Library actually opened, may be a private copy of corePath
+    CoreState(const std::string & corePath, const std::string & libPath)
     {
-      dlHandle = dynLibOpen(corePath);
+      dlHandle = dynLibOpen(libPath, gEagerBinding, gDeepBinding);
+      if (!dlHandle) openError = dynLibError();
       isMame = (corePath.find("mame") != std::string::npos);
+      if (libPath != corePath) libCopyPath = libPath;
     }
 
-    ~CoreState()
+    ~CoreState();
+
+    // Resolves the whole API up front, the optional entry points only change the capabilities
+    // @return false if a required entry point is missing, listed in missingSymbols
+    bool bind()
     {
-      dynLibClose(dlHandle);
+      CORE_LIBRARY_BIND(set_environment, true);
+      CORE_LIBRARY_BIND(set_video_refresh, true);
+      CORE_LIBRARY_BIND(set_audio_sample, true);
+      CORE_LIBRARY_BIND(set_audio_sample_batch, true);
+      CORE_LIBRARY_BIND(set_input_poll, true);
+      CORE_LIBRARY_BIND(set_input_state, true);
+      CORE_LIBRARY_BIND(init, true);
+      CORE_LIBRARY_BIND(deinit, true);
+      CORE_LIBRARY_BIND(api_version, false);
+      CORE_LIBRARY_BIND(get_system_info, true);
+      CORE_LIBRARY_BIND(get_system_av_info, true);
+      CORE_LIBRARY_BIND(set_controller_port_device, false);
+      CORE_LIBRARY_BIND(reset, false);
+      CORE_LIBRARY_BIND(run, true);
+      CORE_LIBRARY_BIND(serialize_size, true);
+      CORE_LIBRARY_BIND(serialize, true);
+      CORE_LIBRARY_BIND(unserialize, true);
+      CORE_LIBRARY_BIND(cheat_reset, false);
+      CORE_LIBRARY_BIND(cheat_set, false);
+      CORE_LIBRARY_BIND(load_game, true);
+      CORE_LIBRARY_BIND(load_game_special, false);
+      CORE_LIBRARY_BIND(unload_game, false);
+      CORE_LIBRARY_BIND(get_region, false);
+      CORE_LIBRARY_BIND(get_memory_data, false);
+      CORE_LIBRARY_BIND(get_memory_size, false);
+
+      capabilities.apiVersion = retro.api_version ? retro.api_version() : 0;
+      capabilities.controllerPortDevice = retro.set_controller_port_device != nullptr;
+      capabilities.reset = retro.reset != nullptr;
+      capabilities.cheats = retro.cheat_reset && retro.cheat_set;
+      capabilities.loadGameSpecial = retro.load_game_special != nullptr;
+      capabilities.unloadGame = retro.unload_game != nullptr;
+      capabilities.region = retro.get_region != nullptr;
+      capabilities.memory = retro.get_memory_data && retro.get_memory_size;
+      return missingSymbols.empty();
     }
 
+    CoreApi retro;
+    CoreCapabilities capabilities;
+    std::vector<std::string> missingSymbols;
+    std::string openError;
+    bool initialized = false;
     bool isMame = false;
     dynlib_t dlHandle;
+    std::string libCopyPath;
+    std::string libraryName;
+    std::string libraryVersion;
+    bool needFullpath = false;
+    bool extractArchives = true; // Unless the core blocks it or reads zip files itself
+    std::string romPath;
+    std::shared_ptr<const RomImage> rom; // Content handed to the core, when it takes it from memory
+    uint64_t romSize = 0;
+    uint32_t romCrc = 0; // Computed on first use, see romIdentity()
+    bool romCrcValid = false;
     SettingsDesc settingsDesc;
     std::map<std::string, std::string> settings;
     double fps = 0.0;
@@ -39,39 +162,287 @@ namespace
     std::vector<uint32_t> videoBuf;
     std::vector<int16_t> audioBuf;
 
-    typedef std::tuple<size_t, size_t, size_t> JoypadId;
-    typedef std::map<JoypadId, std::string> JoypadDesc;
-    std::vector<JoypadDesc> joypads;
+    // Set while a frame must run without producing any output (run-ahead)
+    bool suppressVideo = false;
+    bool suppressAudio = false;
+
+    // Whether the last frame run produced an image rather than a dupe
+    bool videoUpdated = false;
+
+    // Serialized state reused across frames, sized once per loaded game
+    std::vector<uint8_t> stateBuf;
+    size_t stateSize = 0;
+
+    struct RunAhead
+    {
+      size_t frames = 0;
+      bool secondInstance = false;
+      std::unique_ptr<CoreState> secondary;
+      bool secondaryValid = false;
+      bool secondaryFailed = false; // Not retried until coreRunAhead or coreLoadGame
+      RunAheadStats stats;
+    } runAhead;
+
+    // Real frames emulated since the game was loaded
+    size_t frame = 0;
+
+    // Set while running a frame which is rolled back afterwards
+    bool speculative = false;
+
+    InputQueue inputQueue;
+
+    std::unique_ptr<RewindBuffer> rewind;
+    size_t rewindInterval = 1;
+
+    // Branching states; new ones share pages with the last state saved or restored
+    std::unique_ptr<StatePool> statePool;
+    StatePool::Handle statePoolBase = 0;
+
+    // Input movie being recorded or played back, never both at once
+    std::unique_ptr<MovieWriter> movieWriter;
+    std::unique_ptr<MovieReader> moviePlayer;
+    size_t movieFrame = 0; // Movie frame the next coreUpdate emulates
+    std::vector<int32_t> movieInput;
+
+    // From RETRO_ENVIRONMENT_SET_MEMORY_MAPS
+    MemoryMap memoryMap;
+
+    MemoryScanner scanner;
+    unsigned scanRegion = 0;
+
+    ConditionSet conditions;
+
+    FrameTimings timings;
+
+    // Primary instance only, clones would write the same file
+    std::unique_ptr<SramAutosave> autosave;
+
+    // FINGERPRINT_* of what is hashed after every frame
+    unsigned fingerprintFlags = 0;
+    uint64_t fingerprint = 0;
+
+    // Rollback netplay session, and the instance playing the remote player in loopback mode
+    std::unique_ptr<NetplaySession> netplay;
+    std::unique_ptr<CoreState> netplayPeer;
+
+    static const size_t MAX_PORTS = 8;
+
+    // What the core reads through retro_input_state, one flat entry per port
+    struct PortInput
+    {
+      uint32_t buttons = 0;      // RETRO_DEVICE_JOYPAD, bit n is RETRO_DEVICE_ID_JOYPAD_n
+      int16_t analog[2][2] = {}; // RETRO_DEVICE_ANALOG, [RETRO_DEVICE_INDEX_ANALOG_*][RETRO_DEVICE_ID_ANALOG_*]
+      int16_t pointer[3] = {};   // RETRO_DEVICE_POINTER, [RETRO_DEVICE_ID_POINTER_*]
+
+      bool operator==(const PortInput & other) const
+      {
+        return buttons == other.buttons
+          && memcmp(analog, other.analog, sizeof(analog)) == 0
+          && memcmp(pointer, other.pointer, sizeof(pointer)) == 0;
+      }
+    };
+
+    // A named input from SET_INPUT_DESCRIPTORS
+    struct InputDesc
+    {
+      unsigned port;
+      unsigned device;
+      unsigned index;
+      unsigned id;
+      std::string name;
+    };
+
+    std::vector<InputDesc> inputDescs;
 
-    inline bool getJoypadState(size_t port, const JoypadId & inputId)
+    void setInputDescs(const std::vector<InputDesc> & descs)
     {
-      fixJoypadState_();
-      if (port >= joypadsState.size()) return false;
-      return joypadsState[port][joypads[port][inputId]];
+      inputDescs = descs;
+      inputDescByName.clear();
+      for (size_t i=0; i<inputDescs.size(); i++) {
+        inputDescByName[std::make_pair(inputDescs[i].port, inputDescs[i].name)] = i;
+      }
     }
 
-    inline void setJoypadState(size_t port, const std::string & name, bool state)
+    inline int16_t getInputState(unsigned port, unsigned device, unsigned index, unsigned id) const
     {
-      fixJoypadState_();
-      if (port >= joypadsState.size()) return;
-      joypadsState[port][name] = state;
+      if (port >= MAX_PORTS) return 0;
+      const PortInput & in = input[port];
+
+      switch (device & RETRO_DEVICE_MASK) {
+        case RETRO_DEVICE_JOYPAD:
+          return (id < 32) ? (in.buttons >> id) & 1 : 0;
+        case RETRO_DEVICE_ANALOG:
+          return (index < 2 && id < 2) ? in.analog[index][id] : 0;
+        case RETRO_DEVICE_POINTER:
+          return (index == 0 && id < 3) ? in.pointer[id] : 0;
+        default:
+          return 0;
+      }
     }
 
-  private:
-    void fixJoypadState_()
+    // Name lookup only happens here, never when the core polls
+    inline void setInputState(unsigned port, const std::string & name, bool state)
+    {
+      const auto it = inputDescByName.find(std::make_pair(port, name));
+      if (it == inputDescByName.end()) return;
+      const InputDesc & desc = inputDescs[it->second];
+      if (desc.port >= MAX_PORTS) return;
+      PortInput & in = pendingInput[desc.port];
+
+      switch (desc.device & RETRO_DEVICE_MASK) {
+        case RETRO_DEVICE_JOYPAD:
+          if (desc.id >= 32) break;
+          if (state) in.buttons |= (1u << desc.id);
+          else in.buttons &= ~(1u << desc.id);
+          break;
+        case RETRO_DEVICE_ANALOG:
+          // A named axis is driven to its positive end
+          if (desc.index < 2 && desc.id < 2) in.analog[desc.index][desc.id] = state ? 0x7FFF : 0;
+          break;
+        default:
+          break;
+      }
+    }
+
+    // Whole input of the first `ports` ports, laid out as described in core.h
+    void setInputState(const int32_t * data, size_t ports)
+    {
+      for (size_t port=0; port<ports && port<MAX_PORTS; port++) {
+        const int32_t * src = data + port * INPUT_STRIDE;
+        PortInput & in = pendingInput[port];
+        in.buttons = (uint32_t)src[INPUT_BUTTONS];
+        in.analog[RETRO_DEVICE_INDEX_ANALOG_LEFT][RETRO_DEVICE_ID_ANALOG_X] = clampAxis(src[INPUT_ANALOG_LEFT_X]);
+        in.analog[RETRO_DEVICE_INDEX_ANALOG_LEFT][RETRO_DEVICE_ID_ANALOG_Y] = clampAxis(src[INPUT_ANALOG_LEFT_Y]);
+        in.analog[RETRO_DEVICE_INDEX_ANALOG_RIGHT][RETRO_DEVICE_ID_ANALOG_X] = clampAxis(src[INPUT_ANALOG_RIGHT_X]);
+        in.analog[RETRO_DEVICE_INDEX_ANALOG_RIGHT][RETRO_DEVICE_ID_ANALOG_Y] = clampAxis(src[INPUT_ANALOG_RIGHT_Y]);
+        in.pointer[RETRO_DEVICE_ID_POINTER_X] = clampAxis(src[INPUT_POINTER_X]);
+        in.pointer[RETRO_DEVICE_ID_POINTER_Y] = clampAxis(src[INPUT_POINTER_Y]);
+        in.pointer[RETRO_DEVICE_ID_POINTER_PRESSED] = src[INPUT_POINTER_PRESSED] ? 1 : 0;
+      }
+    }
+
+    // Input the core saw during its last poll, or will see during the next one, same layout as above
+    void getInputState(int32_t * data, size_t ports, bool pending = false) const
+    {
+      for (size_t port=0; port<ports; port++) {
+        int32_t * dst = data + port * INPUT_STRIDE;
+        if (port >= MAX_PORTS) {
+          std::fill(dst, dst + INPUT_STRIDE, 0);
+          continue;
+        }
+        const PortInput & in = pending ? pendingInput[port] : input[port];
+        dst[INPUT_BUTTONS] = (int32_t)in.buttons;
+        dst[INPUT_ANALOG_LEFT_X] = in.analog[RETRO_DEVICE_INDEX_ANALOG_LEFT][RETRO_DEVICE_ID_ANALOG_X];
+        dst[INPUT_ANALOG_LEFT_Y] = in.analog[RETRO_DEVICE_INDEX_ANALOG_LEFT][RETRO_DEVICE_ID_ANALOG_Y];
+        dst[INPUT_ANALOG_RIGHT_X] = in.analog[RETRO_DEVICE_INDEX_ANALOG_RIGHT][RETRO_DEVICE_ID_ANALOG_X];
+        dst[INPUT_ANALOG_RIGHT_Y] = in.analog[RETRO_DEVICE_INDEX_ANALOG_RIGHT][RETRO_DEVICE_ID_ANALOG_Y];
+        dst[INPUT_POINTER_X] = in.pointer[RETRO_DEVICE_ID_POINTER_X];
+        dst[INPUT_POINTER_Y] = in.pointer[RETRO_DEVICE_ID_POINTER_Y];
+        dst[INPUT_POINTER_PRESSED] = in.pointer[RETRO_DEVICE_ID_POINTER_PRESSED];
+      }
+    }
+
+    void applyInputEvent(const InputEvent & ev)
     {
-      if (joypadsState.size() != joypads.size()) {
-        joypadsState.clear();
-        joypadsState.resize(joypads.size());
+      if (ev.port >= MAX_PORTS) return;
+      PortInput & in = pendingInput[ev.port];
+
+      switch (ev.field) {
+        case INPUT_BUTTONS:
+          if (ev.id >= 32) break;
+          if (ev.value) in.buttons |= (1u << ev.id);
+          else in.buttons &= ~(1u << ev.id);
+          break;
+        case INPUT_ANALOG_LEFT_X:
+          in.analog[RETRO_DEVICE_INDEX_ANALOG_LEFT][RETRO_DEVICE_ID_ANALOG_X] = clampAxis(ev.value);
+          break;
+        case INPUT_ANALOG_LEFT_Y:
+          in.analog[RETRO_DEVICE_INDEX_ANALOG_LEFT][RETRO_DEVICE_ID_ANALOG_Y] = clampAxis(ev.value);
+          break;
+        case INPUT_ANALOG_RIGHT_X:
+          in.analog[RETRO_DEVICE_INDEX_ANALOG_RIGHT][RETRO_DEVICE_ID_ANALOG_X] = clampAxis(ev.value);
+          break;
+        case INPUT_ANALOG_RIGHT_Y:
+          in.analog[RETRO_DEVICE_INDEX_ANALOG_RIGHT][RETRO_DEVICE_ID_ANALOG_Y] = clampAxis(ev.value);
+          break;
+        case INPUT_POINTER_X:
+          in.pointer[RETRO_DEVICE_ID_POINTER_X] = clampAxis(ev.value);
+          break;
+        case INPUT_POINTER_Y:
+          in.pointer[RETRO_DEVICE_ID_POINTER_Y] = clampAxis(ev.value);
+          break;
+        case INPUT_POINTER_PRESSED:
+          in.pointer[RETRO_DEVICE_ID_POINTER_PRESSED] = ev.value ? 1 : 0;
+          break;
+        default:
+          break;
       }
     }
 
-    typedef std::map<std::string, bool> JoypadState;
-    std::vector<JoypadState> joypadsState;
+    // Pending input becomes visible to the core all at once, when it polls
+    inline void latchInputState()
+    {
+      std::copy(pendingInput, pendingInput + MAX_PORTS, input);
+    }
+
+    // Compares the input this instance runs with to the one `other` ran its last frame with
+    inline bool sameInputState(const CoreState & other) const
+    {
+      return std::equal(pendingInput, pendingInput + MAX_PORTS, other.input);
+    }
+
+    inline void copyInputState(const CoreState & other)
+    {
+      std::copy(other.input, other.input + MAX_PORTS, pendingInput);
+    }
+
+    template<typename FType>
+    void coreBind(FType & f, const std::string & funcName, bool required)
+    {
+      f = (FType)dynLibGetSymbolPtr(dlHandle, funcName);
+      if (f == nullptr) (required ? missingSymbols : capabilities.missingSymbols).push_back(funcName);
+    }
+
+  private:
+    static inline int16_t clampAxis(int32_t v)
+    {
+      return (int16_t)std::max(-0x8000, std::min(0x7FFF, v));
+    }
+
+    PortInput input[MAX_PORTS];
+    PortInput pendingInput[MAX_PORTS];
+    std::map<std::pair<unsigned, std::string>, size_t> inputDescByName;
   };
 
   std::unique_ptr<CoreState> gCoreState;
 
+  // Instance whose callbacks are being served, usually gCoreState. Per thread, as the core pool
+  // initializes instances in the background.
+  thread_local CoreState * gCurrent = nullptr;
+
+  struct CurrentScope
+  {
+    CurrentScope(CoreState * state) : prev(gCurrent) { gCurrent = state; }
+    ~CurrentScope() { gCurrent = prev; }
+    CoreState * prev;
+  };
+
+  // Callbacks made from retro_deinit are served by the instance going away
+  CoreState::~CoreState()
+  {
+    if (initialized && retro.deinit) {
+      CurrentScope scope(this);
+      retro.deinit();
+    }
+    perfRelease(this);
+    if (dlHandle) dynLibClose(dlHandle);
+    if (!libCopyPath.empty()) std::remove(libCopyPath.c_str());
+  }
+
+  // Timings of the coreUpdate in progress, whichever instance serves the callbacks. Null outside
+  // of coreUpdate, which leaves loading, seeking and the core pool untimed.
+  thread_local FrameTimings * gFrameTimings = nullptr;
+
 } // anonymous namespace
 
 
@@ -93,40 +464,66 @@ std::vector<std::string> settingsChoices(const std::string & val)
   return result;
 }
 
-#define CORE_LIBRARY_BIND(name) \
-  coreBind(retro::name, "retro_" #name)
+namespace
+{
 
-#define CORE_LIBRARY_DECL(name) \
-  namespace retro { decltype(retro_ ## name) *  name = nullptr; }
+  // Cores may keep the pointers they get from GET_*_DIRECTORY for as long as they live, so every
+  // directory ever handed out stays allocated
+  const char * internDirectory(const std::string & dir)
+  {
+    static std::mutex mutex;
+    static std::list<std::string> * dirs = new std::list<std::string>;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto & interned : *dirs) {
+      if (interned == dir) return interned.c_str();
+    }
+    dirs->push_back(dir);
+    return dirs->back().c_str();
+  }
 
-const char * SAVE_DIR = "./";
+} // anonymous namespace
+
+// Interned, read by the core pool's thread as well
+std::atomic<const char *> gSaveDir(internDirectory("./"));
 const char * ASSET_DIR = "./";
 const char * SYS_DIR = "./bios";
 
+// Goes through the asynchronous sink, a core logging every frame must not stall on stdout
 void retro_log(enum retro_log_level lv, const char *fmt, ...)
 {
-  std::string level = "RETRO_LOG_DEBUG";
-
-  switch (lv) {
-    case RETRO_LOG_INFO:
-      level = "RETRO_LOG_INFO";
-      break;
-    case RETRO_LOG_WARN:
-      level = "RETRO_LOG_WARN";
-      break;
-    case RETRO_LOG_ERROR:
-      level = "RETRO_LOG_ERROR";
-      break;
-  }
-
-  printf("[%s] ", level.c_str());
-
   va_list args;
   va_start(args, fmt);
-  vprintf(fmt, args);
+  logWriteV((LogLevel)lv, fmt, args);
   va_end(args);
 }
 
+retro_time_t retro_perf_get_time_usec()
+{
+  return coreTimeUs();
+}
+
+retro_perf_tick_t retro_perf_get_counter()
+{
+  return timingTicks();
+}
+
+uint64_t retro_perf_get_cpu_features()
+{
+  return perfCpuFeatures();
+}
+
+// Counters belong to the instance serving the callbacks, whose library holds them
+void retro_perf_register(retro_perf_counter * counter)
+{
+  if (gCurrent) perfRegister(gCurrent, counter);
+}
+
+void retro_perf_log()
+{
+  if (gCurrent) perfLog(gCurrent);
+}
+
 bool retro_environment(unsigned cmd, void * data)
 {
   switch (cmd) {
@@ -138,8 +535,8 @@ bool retro_environment(unsigned cmd, void * data)
           settingsName(variables->value),
           settingsChoices(variables->value),
         };
-        gCoreState->settingsDesc.push_back(sed);
-        gCoreState->settings[sed.key] = sed.choices[0];
+        gCurrent->settingsDesc.push_back(sed);
+        gCurrent->settings[sed.key] = sed.choices[0];
         variables++;
       }
       return true;
@@ -147,7 +544,7 @@ bool retro_environment(unsigned cmd, void * data)
 
     case RETRO_ENVIRONMENT_GET_VARIABLE: {
       retro_variable * variable = (retro_variable *)data;
-      variable->value = gCoreState->settings[variable->key].c_str();
+      variable->value = gCurrent->settings[variable->key].c_str();
       return true;
     }
 
@@ -159,7 +556,7 @@ bool retro_environment(unsigned cmd, void * data)
 
     case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY: {
       const char ** ppath = (const char **)data;
-      *ppath = SAVE_DIR;
+      *ppath = gSaveDir.load();
       return true;
     }
 
@@ -170,15 +567,15 @@ bool retro_environment(unsigned cmd, void * data)
     }
 
     case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT: {
-      gCoreState->format = *(retro_pixel_format *)data;
-      std::cout << "Format is " << gCoreState->format << std::endl;
+      gCurrent->format = *(retro_pixel_format *)data;
+      logWrite(LOG_DEBUG, "Format is %d", (int)gCurrent->format);
       return true;
     }
 
     case RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO: {
       const retro_system_av_info * avInfo = (retro_system_av_info*)data;
-      gCoreState->fps = avInfo->timing.fps;
-      gCoreState->audioSampleRate = avInfo->timing.sample_rate;
+      gCurrent->fps = avInfo->timing.fps;
+      gCurrent->audioSampleRate = avInfo->timing.sample_rate;
       return true;
     }
 
@@ -188,12 +585,24 @@ bool retro_environment(unsigned cmd, void * data)
       return true;
     }
 
+    case RETRO_ENVIRONMENT_GET_PERF_INTERFACE: {
+      retro_perf_callback * perf = (retro_perf_callback *)data;
+      perf->get_time_usec = &retro_perf_get_time_usec;
+      perf->get_cpu_features = &retro_perf_get_cpu_features;
+      perf->get_perf_counter = &retro_perf_get_counter;
+      perf->perf_register = &retro_perf_register;
+      perf->perf_start = &perfStart;
+      perf->perf_stop = &perfStop;
+      perf->perf_log = &retro_perf_log;
+      return true;
+    }
+
     case RETRO_ENVIRONMENT_SET_CONTROLLER_INFO: {
       // TODO: Use this info!!!
       retro_controller_info * ctrlInfo = (retro_controller_info *)data;
       for (size_t i=0; i<ctrlInfo->num_types; i++) {
         const auto type = ctrlInfo->types[i];
-        std::cout << "Controller type : " << type.desc << std::endl;
+        logWrite(LOG_DEBUG, "Controller type : %s", type.desc);
       }
       return true;
     }
@@ -206,15 +615,18 @@ bool retro_environment(unsigned cmd, void * data)
 
     case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS: {
       retro_input_descriptor * inputDesc = (retro_input_descriptor *)data;
-      size_t i = 0;
-      while (inputDesc[i].description) {
+      std::vector<CoreState::InputDesc> descs;
+      for (size_t i=0; inputDesc[i].description; i++) {
         const auto & cur = inputDesc[i];
-
-        // Set joypad desc
-        gCoreState->joypads.resize(cur.port + 1);
-        gCoreState->joypads[cur.port][std::make_tuple(cur.device, cur.id, cur.index)] = cur.description;
-        i++;
+        descs.push_back(CoreState::InputDesc { cur.port, cur.device, cur.index, cur.id, cur.description });
       }
+      gCurrent->setInputDescs(descs);
+      return true;
+    }
+
+    case RETRO_ENVIRONMENT_SET_MEMORY_MAPS: {
+      const retro_memory_map * map = (const retro_memory_map *)data;
+      gCurrent->memoryMap.set(map->descriptors, map->num_descriptors);
       return true;
     }
 
@@ -224,31 +636,9 @@ bool retro_environment(unsigned cmd, void * data)
   }
 }
 
-CORE_LIBRARY_DECL(init);
-CORE_LIBRARY_DECL(run);
-CORE_LIBRARY_DECL(load_game);
-CORE_LIBRARY_DECL(set_environment);
-CORE_LIBRARY_DECL(set_video_refresh);
-CORE_LIBRARY_DECL(set_audio_sample);
-CORE_LIBRARY_DECL(set_audio_sample_batch);
-CORE_LIBRARY_DECL(set_input_poll);
-CORE_LIBRARY_DECL(set_input_state);
-CORE_LIBRARY_DECL(get_system_info);
-CORE_LIBRARY_DECL(get_system_av_info);
-CORE_LIBRARY_DECL(serialize_size);
-CORE_LIBRARY_DECL(serialize);
-CORE_LIBRARY_DECL(unserialize);
 
 namespace
 {
-  // Bind a dynamic library function easily (casting done for you)
-  template<typename FType>
-  void coreBind(FType & f, const std::string & funcName)
-  {
-    f = (FType)dynLibGetSymbolPtr(gCoreState->dlHandle, funcName);
-    if (f == nullptr) std::cerr << "Cannot load " << funcName << std::endl;
-  }
-
   inline uint32_t rgb565_to_xrgb8888(uint16_t val)
   {
     const uint32_t R5 = val & 0x1f; val >>= 5;
@@ -272,19 +662,21 @@ namespace
 
   void retro_video_refresh(const void *data, unsigned width, unsigned height, size_t pitch)
   {
-    if (!data) return;
+    if (!data || gCurrent->suppressVideo) return;
+    TimingScope timing(gFrameTimings, TIMING_VIDEO);
+    gCurrent->videoUpdated = true;
     // std::cout << width << 'x' << height << " - " << pitch << std::endl;
 
     const uint8_t * vData = (const uint8_t *)data;
-    gCoreState->width = width;
-    gCoreState->height = height;
-    gCoreState->videoBuf.resize(width * height);
+    gCurrent->width = width;
+    gCurrent->height = height;
+    gCurrent->videoBuf.resize(width * height);
 
-    switch (gCoreState->format) {
+    switch (gCurrent->format) {
       case RETRO_PIXEL_FORMAT_RGB565:
         for (size_t y=0; y<height; y++) {
           for (size_t x=0; x<width; x++) {
-            gCoreState->videoBuf[width * y + x] = rgb565_to_xrgb8888(*(uint16_t*)&vData[x * 2]);
+            gCurrent->videoBuf[width * y + x] = rgb565_to_xrgb8888(*(uint16_t*)&vData[x * 2]);
           }
           vData += pitch;
         }
@@ -292,7 +684,7 @@ namespace
       case RETRO_PIXEL_FORMAT_XRGB8888:
         for (size_t y=0; y<height; y++) {
           for (size_t x=0; x<width; x++) {
-            gCoreState->videoBuf[width * y + x] = xbgr8888_to_xrgb8888(*(uint32_t*)&vData[x * 4]);
+            gCurrent->videoBuf[width * y + x] = xbgr8888_to_xrgb8888(*(uint32_t*)&vData[x * 4]);
           }
           vData += pitch;
         }
@@ -304,186 +696,1560 @@ namespace
 
   void retro_audio_sample(int16_t left, int16_t right)
   {
-    std::cerr << __FUNCTION__ << " : NYI" << std::endl;
+    logWrite(LOG_WARN, "%s : NYI", __FUNCTION__);
   }
 
   size_t retro_audio_sample_batch(const int16_t *data, size_t frames)
   {
+    if (gCurrent->suppressAudio) return frames;
+    TimingScope timing(gFrameTimings, TIMING_AUDIO);
     for (size_t i=0; i<frames*2; i++) {
-      gCoreState->audioBuf.push_back(*data++);
+      gCurrent->audioBuf.push_back(*data++);
     }
     return frames;
   }
 
   void retro_input_poll(void)
   {
-    // std::cout << "Poll" << std::endl;
+    TimingScope timing(gFrameTimings, TIMING_INPUT);
+    CoreState & core = *gCurrent;
+
+    // Queued events belong to real frames, speculative ones reuse the input as is. A movie being
+    // played back or a netplay session is the only source of input.
+    if (!core.speculative && !core.moviePlayer && !core.netplay) {
+      const int64_t framePeriodUs = core.fps > 0.0 ? (int64_t)(1e6 / core.fps) : 0;
+      core.inputQueue.drain((int64_t)core.frame, coreTimeUs(), framePeriodUs, [&core](const InputEvent & ev) {
+        core.applyInputEvent(ev);
+      });
+    }
+    core.latchInputState();
   }
 
+  // Not timed, cores call it many times per frame and it is a table lookup
   int16_t retro_input_state(unsigned port, unsigned device, unsigned index, unsigned id)
   {
-    const auto state = gCoreState->getJoypadState(port, std::make_tuple(device, id, index));
-    return state ? 1 : 0;
+    return gCurrent->getInputState(port, device, index, id);
   }
 
 } // anonymous namespace
 
-void coreClose()
+namespace
 {
-  gCoreState.reset();
-}
 
-void coreInit(const std::string & corePath)
-{
-  coreClose(); // Close any previously opened core
-  gCoreState.reset(new CoreState(corePath));
-
-  CORE_LIBRARY_BIND(init);
-  CORE_LIBRARY_BIND(run);
-  CORE_LIBRARY_BIND(load_game);
-  CORE_LIBRARY_BIND(set_environment);
-  CORE_LIBRARY_BIND(set_video_refresh);
-  CORE_LIBRARY_BIND(set_audio_sample);
-  CORE_LIBRARY_BIND(set_audio_sample_batch);
-  CORE_LIBRARY_BIND(set_input_poll);
-  CORE_LIBRARY_BIND(set_input_state);
-  CORE_LIBRARY_BIND(get_system_info);
-  CORE_LIBRARY_BIND(get_system_av_info);
-  CORE_LIBRARY_BIND(serialize_size);
-  CORE_LIBRARY_BIND(serialize);
-  CORE_LIBRARY_BIND(unserialize);
-
-  retro::set_environment(&retro_environment);
-  retro::set_video_refresh(&retro_video_refresh);
-  retro::set_audio_sample(&retro_audio_sample);
-  retro::set_audio_sample_batch(&retro_audio_sample_batch);
-  retro::set_input_poll(&retro_input_poll);
-  retro::set_input_state(&retro_input_state);
-  retro::init();
+  typedef std::chrono::steady_clock Clock;
 
-  retro_system_info info;
-  retro::get_system_info(&info);
-  std::cout << info.library_name << " - " << info.library_version << std::endl;
-}
+  inline double elapsedUs(const Clock::time_point & start)
+  {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+  }
 
-void coreLoadGame(const std::string & romPath)
-{
-  retro_game_info gi;
-  gi.path = romPath.c_str();
-  gi.data = NULL;
-  gi.size = 0;
-  gi.meta = NULL;
-  retro::load_game(&gi);
-
-  retro_system_av_info avInfo;
-  retro::get_system_av_info(&avInfo);
-  gCoreState->fps = avInfo.timing.fps;
-  gCoreState->audioSampleRate = avInfo.timing.sample_rate;
-
-  if (gCoreState->isMame) {
-    // HACK: Mame doesn't
-    std::cout << "[HACK] applied for MAME : populating joypad description" << std::endl;
-
-    // REFERENCE
-    // RETRO_DEVICE_ID_JOYPAD_L        [KEY_BUTTON_5]
-    // RETRO_DEVICE_ID_JOYPAD_R        [KEY_BUTTON_6]
-    // RETRO_DEVICE_ID_JOYPAD_R2       [KEY_TAB]
-    // RETRO_DEVICE_ID_JOYPAD_L2;      [KEY_F11]
-    // RETRO_DEVICE_ID_JOYPAD_R3       [KEY_F2]
-    // RETRO_DEVICE_ID_JOYPAD_L3;      [KEY_F3]
-    // RETRO_DEVICE_ID_JOYPAD_START        [KEY_START]
-    // RETRO_DEVICE_ID_JOYPAD_SELECT       [KEY_COIN]
-    // RETRO_DEVICE_ID_JOYPAD_A        [KEY_BUTTON_1]
-    // RETRO_DEVICE_ID_JOYPAD_B        [KEY_BUTTON_2]
-    // RETRO_DEVICE_ID_JOYPAD_X        [KEY_BUTTON_3]
-    // RETRO_DEVICE_ID_JOYPAD_Y        [KEY_BUTTON_4]
-    // RETRO_DEVICE_ID_JOYPAD_UP       [KEY_JOYSTICK_U]
-    // RETRO_DEVICE_ID_JOYPAD_DOWN     [KEY_JOYSTICK_D]
-    // RETRO_DEVICE_ID_JOYPAD_LEFT     [KEY_JOYSTICK_L]
-    // RETRO_DEVICE_ID_JOYPAD_RIGHT        [KEY_JOYSTICK_R]
-    //     tips: L2 activates MAME OSD
-
-
-    gCoreState->joypads = {{
-      { std::make_tuple(RETRO_DEVICE_JOYPAD, RETRO_DEVICE_ID_JOYPAD_A, 0), "Weak Kick"},
-      { std::make_tuple(RETRO_DEVICE_JOYPAD, RETRO_DEVICE_ID_JOYPAD_B, 0), "Medium Kick"},
-      { std::make_tuple(RETRO_DEVICE_JOYPAD, RETRO_DEVICE_ID_JOYPAD_X, 0), "Strong Kick"},
-      { std::make_tuple(RETRO_DEVICE_JOYPAD, RETRO_DEVICE_ID_JOYPAD_Y, 0), "Weak Punch"},
-      { std::make_tuple(RETRO_DEVICE_JOYPAD, RETRO_DEVICE_ID_JOYPAD_L, 0), "Medium Punch"},
-      { std::make_tuple(RETRO_DEVICE_JOYPAD, RETRO_DEVICE_ID_JOYPAD_R, 0), "Strong Punch"},
-      { std::make_tuple(RETRO_DEVICE_JOYPAD, RETRO_DEVICE_ID_JOYPAD_START, 0), "Start"},
-      { std::make_tuple(RETRO_DEVICE_JOYPAD, RETRO_DEVICE_ID_JOYPAD_SELECT, 0), "Coin"},
-      { std::make_tuple(RETRO_DEVICE_JOYPAD, RETRO_DEVICE_ID_JOYPAD_UP, 0), "Up"},
-      { std::make_tuple(RETRO_DEVICE_JOYPAD, RETRO_DEVICE_ID_JOYPAD_DOWN, 0), "Down"},
-      { std::make_tuple(RETRO_DEVICE_JOYPAD, RETRO_DEVICE_ID_JOYPAD_LEFT, 0), "Left"},
-      { std::make_tuple(RETRO_DEVICE_JOYPAD, RETRO_DEVICE_ID_JOYPAD_RIGHT, 0), "Right"},
-    }};
+  // dlopen() hands back the already loaded library for a given path, so an
+  // independent instance of a core needs its own copy of the file
+  std::string copyCoreLibrary(const std::string & corePath)
+  {
+    static std::atomic<size_t> counter(0);
+
+#if WIN32
+    const char * tmpDir = std::getenv("TEMP");
+#else
+    const char * tmpDir = std::getenv("TMPDIR");
+#endif
+    const size_t sep = corePath.find_last_of("/\\");
+    const std::string base = (sep == std::string::npos) ? corePath : corePath.substr(sep + 1);
+    const std::string copyPath = std::string(tmpDir ? tmpDir : "/tmp") + "/"
+      + std::to_string(Clock::now().time_since_epoch().count()) + "-" + std::to_string(counter++) + "-" + base;
+
+    std::ifstream src(corePath, std::ios::binary);
+    std::ofstream dst(copyPath, std::ios::binary);
+    if (!src || !dst) return std::string();
+    dst << src.rdbuf();
+    return dst.good() ? copyPath : std::string();
   }
-}
 
-void coreUpdate()
-{
-  retro::run();
-}
+  // @param extensions retro_system_info::valid_extensions, '|' separated
+  // @param extension Lower case
+  bool extensionListed(const char * extensions, const char * extension)
+  {
+    if (!extensions) return false;
+    std::string lower = extensions;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+    return ("|" + lower + "|").find("|" + std::string(extension) + "|") != std::string::npos;
+  }
 
-const std::vector<uint32_t> & coreVideoData(size_t & width, size_t & height)
-{
-  width = gCoreState->width;
-  height = gCoreState->height;
-  return gCoreState->videoBuf;
-}
+  std::unique_ptr<CoreState> createCore(const std::string & corePath, const std::string & libPath, CoreLoadError & error)
+  {
+    std::unique_ptr<CoreState> core(new CoreState(corePath, libPath));
+    if (!core->dlHandle) {
+      error.message = "Cannot open " + corePath + ": " + core->openError;
+      return nullptr;
+    }
+    if (!core->bind()) {
+      error.message = "Not a libretro core, missing " + core->missingSymbols[0] + ": " + corePath;
+      error.missingSymbols = core->missingSymbols;
+      return nullptr;
+    }
 
-std::vector<int16_t> coreAudioData()
-{
-  const auto res = gCoreState->audioBuf;
-  gCoreState->audioBuf.clear();
-  return res;
-}
+    CurrentScope scope(core.get());
+    core->retro.set_environment(&retro_environment);
+    core->retro.set_video_refresh(&retro_video_refresh);
+    core->retro.set_audio_sample(&retro_audio_sample);
+    core->retro.set_audio_sample_batch(&retro_audio_sample_batch);
+    core->retro.set_input_poll(&retro_input_poll);
+    core->retro.set_input_state(&retro_input_state);
+    core->retro.init();
+    core->initialized = true;
+
+    retro_system_info info;
+    core->retro.get_system_info(&info);
+    core->libraryName = info.library_name ? info.library_name : "";
+    core->libraryVersion = info.library_version ? info.library_version : "";
+    core->needFullpath = info.need_fullpath;
+    core->extractArchives = !info.block_extract && !extensionListed(info.valid_extensions, "zip");
+    return core;
+  }
 
-void coreTimings(double & fps, double & audioSampleRate)
-{
-  fps = gCoreState->fps;
-  audioSampleRate = gCoreState->audioSampleRate;
-}
+  // <save dir>/<ROM name without extension>.srm, like RetroArch
+  std::string sramPath(const CoreState & core)
+  {
+    // Content inside an archive is named after the entry
+    std::string name = core.romPath;
+    std::string archive, entry;
+    if (zipSplitPath(core.romPath, archive, entry) && !entry.empty()) name = entry;
+    const size_t sep = name.find_last_of("/\\");
+    if (sep != std::string::npos) name = name.substr(sep + 1);
+    const size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos && dot > 0) name.resize(dot);
+
+    std::string dir = gSaveDir.load();
+    if (!dir.empty() && dir.back() != '/' && dir.back() != '\\') dir += '/';
+    return dir + name + ".srm";
+  }
 
-SettingsDesc coreSettingsDesc()
-{
-  return gCoreState->settingsDesc;
-}
+  void loadSram(CoreState & core)
+  {
+    if (!core.retro.get_memory_data || !core.retro.get_memory_size) return;
+    CurrentScope scope(&core);
+    uint8_t * sram = (uint8_t *)core.retro.get_memory_data(RETRO_MEMORY_SAVE_RAM);
+    const size_t size = sram ? core.retro.get_memory_size(RETRO_MEMORY_SAVE_RAM) : 0;
+    if (!size) return;
+
+    MappedFile file;
+    if (!file.open(sramPath(core))) return;
+    memcpy(sram, file.data(), std::min(size, file.size()));
+  }
 
-void coreSettingsSet(const std::string & key, const std::string & value)
-{
-  gCoreState->settings[key] = value;
-}
+  bool loadGame(CoreState & core, const std::string & romPath)
+  {
+    CurrentScope scope(&core);
+
+    // Archives are extracted for cores which read content from memory and do not handle archives
+    // themselves (an explicit entry always is); those are told the entry's path, archive.zip#entry
+    std::string path = romPath;
+    std::string archive, entry;
+    const bool isArchive = zipSplitPath(romPath, archive, entry);
+    const bool extract = isArchive && (core.extractArchives || !entry.empty());
+    if (extract && !core.needFullpath && entry.empty()) {
+      std::string error;
+      const auto zip = zipOpen(archive, error);
+      const ZipEntry * first = zip ? zip->find(entry) : nullptr;
+      if (first) path = archive + "#" + first->name;
+    }
 
-std::vector<std::string> coreJoypadDesc()
-{
-  std::vector<std::string> result;
-  if (gCoreState->joypads.empty()) return result;
-  for (const auto & pair : gCoreState->joypads[0]) {
-    result.push_back(pair.second);
+    // Cores which can read content from memory get the shared image instead of reading the file
+    std::shared_ptr<const RomImage> rom;
+    if (!core.needFullpath) rom = romCacheGet(path, extract);
+
+    retro_game_info gi;
+    gi.path = path.c_str();
+    gi.data = rom ? rom->data() : NULL;
+    gi.size = rom ? rom->size() : 0;
+    gi.meta = NULL;
+    core.memoryMap.clear();
+    core.conditions.clear();
+    core.scanner.clear();
+    if (!core.retro.load_game(&gi)) return false;
+    core.romPath = romPath;
+    core.rom = rom;
+    core.romCrcValid = false;
+    core.movieWriter.reset();
+    core.moviePlayer.reset();
+    core.netplay.reset();
+    core.netplayPeer.reset();
+    core.stateBuf.clear();
+    core.stateSize = 0;
+    core.frame = 0;
+    core.inputQueue.clear();
+    if (core.rewind) core.rewind->clear();
+    core.statePool.reset();
+    core.statePoolBase = 0;
+    loadSram(core);
+
+    retro_system_av_info avInfo;
+    core.retro.get_system_av_info(&avInfo);
+    core.fps = avInfo.timing.fps;
+    core.audioSampleRate = avInfo.timing.sample_rate;
+
+    if (core.isMame) {
+      // HACK: Mame doesn't
+      logWrite(LOG_INFO, "[HACK] applied for MAME : populating joypad description");
+
+      // REFERENCE
+      // RETRO_DEVICE_ID_JOYPAD_L        [KEY_BUTTON_5]
+      // RETRO_DEVICE_ID_JOYPAD_R        [KEY_BUTTON_6]
+      // RETRO_DEVICE_ID_JOYPAD_R2       [KEY_TAB]
+      // RETRO_DEVICE_ID_JOYPAD_L2;      [KEY_F11]
+      // RETRO_DEVICE_ID_JOYPAD_R3       [KEY_F2]
+      // RETRO_DEVICE_ID_JOYPAD_L3;      [KEY_F3]
+      // RETRO_DEVICE_ID_JOYPAD_START        [KEY_START]
+      // RETRO_DEVICE_ID_JOYPAD_SELECT       [KEY_COIN]
+      // RETRO_DEVICE_ID_JOYPAD_A        [KEY_BUTTON_1]
+      // RETRO_DEVICE_ID_JOYPAD_B        [KEY_BUTTON_2]
+      // RETRO_DEVICE_ID_JOYPAD_X        [KEY_BUTTON_3]
+      // RETRO_DEVICE_ID_JOYPAD_Y        [KEY_BUTTON_4]
+      // RETRO_DEVICE_ID_JOYPAD_UP       [KEY_JOYSTICK_U]
+      // RETRO_DEVICE_ID_JOYPAD_DOWN     [KEY_JOYSTICK_D]
+      // RETRO_DEVICE_ID_JOYPAD_LEFT     [KEY_JOYSTICK_L]
+      // RETRO_DEVICE_ID_JOYPAD_RIGHT        [KEY_JOYSTICK_R]
+      //     tips: L2 activates MAME OSD
+
+
+      core.setInputDescs({
+        { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_A, "Weak Kick" },
+        { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_B, "Medium Kick" },
+        { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_X, "Strong Kick" },
+        { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_Y, "Weak Punch" },
+        { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L, "Medium Punch" },
+        { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_R, "Strong Punch" },
+        { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_START, "Start" },
+        { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_SELECT, "Coin" },
+        { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP, "Up" },
+        { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_DOWN, "Down" },
+        { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT, "Left" },
+        { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT, "Right" },
+      });
+    }
+    return true;
   }
-  return result;
-}
 
-void coreJoypadPress(const std::string & name)
-{
-  gCoreState->setJoypadState(0, name, true);
-}
+  // serialize_size() is only queried once per loaded game
+  size_t stateSize(CoreState & core)
+  {
+    if (core.stateSize == 0) core.stateSize = core.retro.serialize_size();
+    return core.stateSize;
+  }
 
-void coreJoypadRelease(const std::string & name)
-{
-  gCoreState->setJoypadState(0, name, false);
-}
+  bool saveStateInto(CoreState & core, void * data, size_t sz)
+  {
+    if (sz == 0 || sz != stateSize(core)) return false;
+    if (core.retro.serialize(data, sz)) return true;
 
-std::vector<uint8_t> coreSaveState()
-{
-  std::vector<uint8_t> res(retro::serialize_size());
-  retro::serialize(&res[0], res.size());
-  return res;
-}
+    // Some cores grow their state once the game is running, query again next time
+    core.stateSize = 0;
+    return false;
+  }
 
-bool coreRestoreState(const char * data, size_t sz)
-{
-  return retro::unserialize(data, sz);
+  // Serializes into the state buffer of the instance
+  bool saveState(CoreState & core)
+  {
+    const size_t sz = stateSize(core);
+    if (core.stateBuf.size() != sz) core.stateBuf.resize(sz);
+    return saveStateInto(core, core.stateBuf.data(), sz);
+  }
+
+  // Runs one frame of the given instance
+  // @note Frames without audio are never the real one, they do not consume queued input
+  // @param speculative Frame rolled back afterwards, which takes no queued input events
+  void runFrame(CoreState & core, bool video, bool audio, bool speculative)
+  {
+    CurrentScope scope(&core);
+    core.suppressVideo = !video;
+    core.suppressAudio = !audio;
+    core.speculative = speculative;
+    core.videoUpdated = false;
+    {
+      TimingScope timing(gFrameTimings, TIMING_RUN);
+      core.retro.run();
+    }
+    core.suppressVideo = false;
+    core.suppressAudio = false;
+    core.speculative = false;
+  }
+
+  // Real frame, then speculative frames from a save state which is rolled back
+  void runAheadSingle(CoreState & core)
+  {
+    auto & ra = core.runAhead;
+
+    runFrame(core, false, true, false);
+
+    auto start = Clock::now();
+    if (!saveState(core)) {
+      logWrite(LOG_WARN, "Run-ahead: core cannot serialize, disabling");
+      ra.frames = 0;
+      ra.stats.disabled = true;
+      return;
+    }
+    ra.stats.serializeUs += elapsedUs(start);
+
+    start = Clock::now();
+    for (size_t i=1; i<=ra.frames; i++) {
+      runFrame(core, i == ra.frames, false, true);
+    }
+    ra.stats.speculativeUs += elapsedUs(start);
+
+    start = Clock::now();
+    const bool restored = core.retro.unserialize(&core.stateBuf[0], core.stateBuf.size());
+    ra.stats.unserializeUs += elapsedUs(start);
+    if (!restored) {
+      // The core is now ahead of real time, which cannot be undone
+      logWrite(LOG_ERROR, "Run-ahead: core failed to roll back %u frames, disabling", (unsigned)ra.frames);
+      ra.frames = 0;
+      ra.stats.disabled = true;
+    }
+  }
+
+  // Real frame on the primary instance while a second instance stays ahead;
+  // the state is only transferred when the input differs from the prediction
+  void runAheadSecondary(CoreState & core)
+  {
+    auto & ra = core.runAhead;
+    CoreState & secondary = *ra.secondary;
+
+    runFrame(core, false, true, false);
+
+    auto start = Clock::now();
+    if (!ra.secondaryValid || !secondary.sameInputState(core)) {
+      if (!saveState(core)) {
+        logWrite(LOG_WARN, "Run-ahead: core cannot serialize, disabling");
+        ra.frames = 0;
+        ra.stats.disabled = true;
+        return;
+      }
+      ra.stats.serializeUs += elapsedUs(start);
+
+      start = Clock::now();
+      bool restored;
+      {
+        CurrentScope scope(&secondary);
+        restored = secondary.retro.unserialize(&core.stateBuf[0], core.stateBuf.size());
+      }
+      ra.stats.unserializeUs += elapsedUs(start);
+      if (!restored) {
+        logWrite(LOG_ERROR, "Run-ahead: second instance rejected the state, disabling");
+        ra.frames = 0;
+        ra.secondaryValid = false;
+        ra.stats.disabled = true;
+        return;
+      }
+
+      secondary.copyInputState(core);
+      ra.secondaryValid = true;
+      ra.stats.resyncs++;
+
+      start = Clock::now();
+      for (size_t i=1; i<=ra.frames; i++) {
+        runFrame(secondary, i == ra.frames, false, true);
+      }
+    }
+    else {
+      runFrame(secondary, true, false, true);
+    }
+    ra.stats.speculativeUs += elapsedUs(start);
+
+    // A dupe keeps the image presented last, the second instance's buffer is older than that
+    if (secondary.videoUpdated) {
+      std::swap(core.videoBuf, secondary.videoBuf);
+      core.width = secondary.width;
+      core.height = secondary.height;
+    }
+  }
+
+  // Independent instance of the core with the same settings and game loaded
+  std::unique_ptr<CoreState> cloneCore(const CoreState & core, const std::string & corePath)
+  {
+    const std::string libPath = copyCoreLibrary(corePath);
+    if (libPath.empty()) return nullptr;
+    CoreLoadError error;
+    std::unique_ptr<CoreState> clone = createCore(corePath, libPath, error);
+    if (!clone) {
+      logWrite(LOG_ERROR, "Second instance: %s", error.message.c_str());
+      return nullptr;
+    }
+
+    clone->settings = core.settings;
+    if (!loadGame(*clone, core.romPath)) return nullptr;
+    return clone;
+  }
+
+  bool ensureSecondary(CoreState & core, const std::string & corePath)
+  {
+    auto & ra = core.runAhead;
+    if (ra.secondary) return true;
+    if (ra.secondaryFailed) return false;
+
+    // Setting up copies the library and loads the game again, far too slow to retry every frame
+    ra.secondary = cloneCore(core, corePath);
+    if (!ra.secondary) {
+      logWrite(LOG_WARN, "Run-ahead: cannot set up a second instance, running ahead on the first one");
+      ra.secondaryFailed = true;
+      return false;
+    }
+    ra.secondaryValid = false;
+    return true;
+  }
+
+  // Size and CRC-32 of the loaded ROM file, identifying it in movies
+  bool romIdentity(CoreState & core, uint64_t & size, uint32_t & crc)
+  {
+    if (!core.romCrcValid) {
+      const std::shared_ptr<const RomImage> rom = core.rom ? core.rom : romCacheGet(core.romPath);
+      if (!rom) return false;
+      core.romSize = rom->size();
+      core.romCrc = crc32(0, rom->data(), rom->size());
+      core.romCrcValid = true;
+    }
+    size = core.romSize;
+    crc = core.romCrc;
+    return true;
+  }
+
+  void recordMovieFrame(CoreState & core)
+  {
+    MovieWriter & writer = *core.movieWriter;
+    core.movieInput.resize(writer.info().inputValues);
+    core.getInputState(core.movieInput.data(), core.movieInput.size() / INPUT_STRIDE);
+    writer.frame(core.movieInput.data());
+
+    core.movieFrame++;
+    const size_t interval = writer.info().keyframeInterval;
+    if (interval && core.movieFrame % interval == 0 && saveState(core)) {
+      writer.keyframe(core.movieFrame, core.stateBuf.data(), core.stateBuf.size());
+    }
+  }
+
+  // Feeds the input of the next movie frame, ends playback after the last one
+  // @return false once the movie is over
+  bool playMovieFrame(CoreState & core)
+  {
+    MovieReader & player = *core.moviePlayer;
+    if (core.movieFrame >= player.frames()) {
+      core.moviePlayer.reset();
+      return false;
+    }
+    core.movieInput.resize(player.info().inputValues);
+    player.input(core.movieFrame, core.movieInput.data());
+    core.setInputState(core.movieInput.data(), core.movieInput.size() / INPUT_STRIDE);
+    core.movieFrame++;
+    return true;
+  }
+
+  // Restores the last keyframe at or before `frame`
+  bool restoreMovieKeyframe(CoreState & core, size_t frame)
+  {
+    const MovieReader & player = *core.moviePlayer;
+    const size_t size = stateSize(core);
+    const uint64_t kf = player.keyframe(frame, size, core.stateBuf);
+    if (core.stateBuf.empty() || core.stateBuf.size() != size) return false;
+    if (!core.retro.unserialize(core.stateBuf.data(), core.stateBuf.size())) return false;
+    core.movieFrame = kf;
+    core.runAhead.secondaryValid = false;
+    return true;
+  }
+
+  // @param output Real frames produce video and audio
+  std::unique_ptr<NetplaySession> createNetplaySession(CoreState & core, const NetplayConfig & config, bool output)
+  {
+    NetplayConfig cfg = config;
+    cfg.inputValues = INPUT_STRIDE;
+    cfg.fps = core.fps;
+
+    auto save = [&core](std::vector<uint8_t> & state) {
+      CurrentScope scope(&core);
+      state.resize(stateSize(core));
+      return saveStateInto(core, state.data(), state.size());
+    };
+    auto load = [&core](const std::vector<uint8_t> & state) {
+      CurrentScope scope(&core);
+      return core.retro.unserialize(state.data(), state.size());
+    };
+    auto run = [&core, output](const int32_t * input, bool resim) {
+      core.setInputState(input, 2);
+      runFrame(core, output && !resim, output && !resim, resim);
+    };
+    return std::unique_ptr<NetplaySession>(new NetplaySession(cfg, save, load, run));
+  }
+
+  void updateNetplay(CoreState & core)
+  {
+    // The local player drives port 0 whichever player it is, the session sets both ports
+    int32_t local[INPUT_STRIDE];
+    core.getInputState(local, 1, true);
+    const bool desynced = core.netplay->stats().desynced;
+    if (core.netplay->update(local)) core.frame++;
+    else if (!desynced && core.netplay->stats().desynced) {
+      logWrite(LOG_ERROR, "Netplay stopped at frame %llu, a state could not be saved or restored",
+        (unsigned long long)core.netplay->frame());
+    }
+    core.setInputState(local, 1);
+
+    // The loopback peer mirrors the local player
+    if (core.netplayPeer) {
+      CoreState & peer = *core.netplayPeer;
+      if (peer.netplay->update(local)) peer.frame++;
+    }
+  }
+
+  // Hash of the output of the frame just emulated
+  // @param audioStart Samples already buffered before that frame
+  uint64_t fingerprint(CoreState & core, unsigned flags, size_t audioStart)
+  {
+    uint64_t h = 0;
+    if (flags & FINGERPRINT_VIDEO) {
+      h = xxhash64(core.videoBuf.data(), core.videoBuf.size() * sizeof(uint32_t), h);
+    }
+    if ((flags & FINGERPRINT_AUDIO) && audioStart <= core.audioBuf.size()) {
+      h = xxhash64(core.audioBuf.data() + audioStart, (core.audioBuf.size() - audioStart) * sizeof(int16_t), h);
+    }
+    if ((flags & FINGERPRINT_RAM) && core.retro.get_memory_data && core.retro.get_memory_size) {
+      CurrentScope scope(&core);
+      const void * ram = core.retro.get_memory_data(RETRO_MEMORY_SYSTEM_RAM);
+      const size_t size = core.retro.get_memory_size(RETRO_MEMORY_SYSTEM_RAM);
+      if (ram) h = xxhash64(ram, size, h);
+    }
+    return h;
+  }
+
+  // Addresses are the ones of the memory map when the core describes one, system RAM offsets
+  // otherwise
+  void evaluateConditions(CoreState & core)
+  {
+    const uint8_t * ram = nullptr;
+    size_t ramSize = 0;
+    if (core.memoryMap.descriptors() == 0 && core.retro.get_memory_data && core.retro.get_memory_size) {
+      ram = (const uint8_t *)core.retro.get_memory_data(RETRO_MEMORY_SYSTEM_RAM);
+      ramSize = ram ? core.retro.get_memory_size(RETRO_MEMORY_SYSTEM_RAM) : 0;
+    }
+
+    core.conditions.evaluate([&core, ram, ramSize](uint64_t address) -> const uint8_t * {
+      if (core.memoryMap.descriptors()) return core.memoryMap.translate(address);
+      return address < ramSize ? ram + address : nullptr;
+    });
+  }
+
+  bool gAutosave = true;
+  size_t gAutosaveDebounceMs = 1000;
+  size_t gAutosaveMaxDelayMs = 10000;
+
+  void startAutosave(CoreState & core)
+  {
+    core.autosave.reset();
+    if (!gAutosave || !core.retro.get_memory_data || !core.retro.get_memory_size) return;
+    if (!core.retro.get_memory_data(RETRO_MEMORY_SAVE_RAM) || !core.retro.get_memory_size(RETRO_MEMORY_SAVE_RAM)) return;
+    core.autosave.reset(new SramAutosave(sramPath(core), gAutosaveDebounceMs, gAutosaveMaxDelayMs));
+  }
+
+  // Per frame bookkeeping, once the frame is final
+  // @param audioStart Samples already buffered before the frame
+  void afterFrame(CoreState & core, size_t audioStart)
+  {
+    if (core.fingerprintFlags) core.fingerprint = fingerprint(core, core.fingerprintFlags, audioStart);
+    if (!core.conditions.empty()) evaluateConditions(core);
+
+    if (core.autosave) {
+      const uint8_t * sram = (const uint8_t *)core.retro.get_memory_data(RETRO_MEMORY_SAVE_RAM);
+      if (sram) core.autosave->check(sram, core.retro.get_memory_size(RETRO_MEMORY_SAVE_RAM));
+    }
+  }
+
+  std::string gCorePath;
+
+  std::function<void()> gUnloadHook;
+  uint64_t gGameGeneration = 1; // Bumped by notifyUnload()
+
+  // Instances initialized ahead of coreInit by a helper thread, each from its own copy of the library
+  // so that they stay independent of the running one
+  class CorePool
+  {
+  public:
+    ~CorePool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+      }
+      cv_.notify_all();
+      if (worker_.joinable()) worker_.join();
+    }
+
+    void setup(const std::string & corePath, size_t count)
+    {
+      std::vector<std::unique_ptr<CoreState>> released;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Target & target = targets_[corePath];
+        target.count = count;
+        target.failed = false;
+        while (target.ready.size() > count) {
+          released.push_back(std::move(target.ready.back()));
+          target.ready.pop_back();
+        }
+        if (count && !worker_.joinable()) worker_ = std::thread(&CorePool::run, this);
+      }
+      cv_.notify_all();
+      // Released instances are deinitialized here, outside the lock
+    }
+
+    // Drops the ready instances and those being warmed, which were initialized with an
+    // environment (save directory...) that changed since; replacements are warmed right away
+    void flush()
+    {
+      std::vector<std::unique_ptr<CoreState>> released;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_++;
+        for (auto & it : targets_) {
+          for (auto & core : it.second.ready) released.push_back(std::move(core));
+          it.second.ready.clear();
+        }
+      }
+      cv_.notify_all();
+    }
+
+    // @return nullptr if the path is not pooled or no instance is ready yet
+    std::unique_ptr<CoreState> take(const std::string & corePath)
+    {
+      std::unique_ptr<CoreState> core;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = targets_.find(corePath);
+        if (it == targets_.end() || !it->second.count) return nullptr;
+
+        Target & target = it->second;
+        if (target.ready.empty()) {
+          stats_.misses++;
+          return nullptr;
+        }
+        stats_.hits++;
+        core = std::move(target.ready.front());
+        target.ready.pop_front();
+      }
+      cv_.notify_all(); // Warms its replacement
+      return core;
+    }
+
+    CorePoolStats stats()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      CorePoolStats stats = stats_;
+      for (const auto & it : targets_) {
+        stats.ready += it.second.ready.size();
+        stats.warming += it.second.warming;
+      }
+      return stats;
+    }
+
+  private:
+    struct Target
+    {
+      size_t count = 0;
+      size_t warming = 0;
+      bool failed = false; // Not retried until the next setup
+      std::deque<std::unique_ptr<CoreState>> ready;
+    };
+
+    // @note Called with the lock held
+    bool nextToWarm(std::string & corePath)
+    {
+      for (const auto & it : targets_) {
+        const Target & target = it.second;
+        if (!target.failed && target.ready.size() + target.warming < target.count) {
+          corePath = it.first;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void run()
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      for (;;) {
+        std::string corePath;
+        cv_.wait(lock, [&] { return quit_ || nextToWarm(corePath); });
+        if (quit_) return;
+        targets_[corePath].warming++;
+        const size_t generation = generation_;
+        lock.unlock();
+
+        const auto start = Clock::now();
+        std::unique_ptr<CoreState> core;
+        const std::string libPath = copyCoreLibrary(corePath);
+        CoreLoadError error;
+        if (!libPath.empty()) core = createCore(corePath, libPath, error);
+        if (libPath.empty()) logWrite(LOG_ERROR, "Core pool: cannot copy %s", corePath.c_str());
+        else if (!core) logWrite(LOG_ERROR, "Core pool: %s", error.message.c_str());
+        const double ms = elapsedUs(start) / 1000.0;
+
+        lock.lock();
+        Target & target = targets_[corePath];
+        target.warming--;
+        if (!core) {
+          target.failed = true;
+          stats_.failures++;
+          continue;
+        }
+
+        stats_.warmups++;
+        stats_.warmTotalMs += ms;
+        stats_.warmLastMs = ms;
+        stats_.warmMaxMs = std::max(stats_.warmMaxMs, ms);
+        if (generation == generation_ && target.ready.size() < target.count) {
+          target.ready.push_back(std::move(core));
+        }
+        else {
+          // Shrunk or flushed meanwhile
+          lock.unlock();
+          core.reset();
+          lock.lock();
+        }
+      }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread worker_;
+    bool quit_ = false;
+    size_t generation_ = 0; // Bumped by flush()
+    std::map<std::string, Target> targets_;
+    CorePoolStats stats_;
+  };
+
+  CorePool gCorePool;
+
+  void notifyUnload()
+  {
+    gGameGeneration++;
+    if (gCoreState && gUnloadHook) gUnloadHook();
+  }
+
+} // anonymous namespace
+
+void coreClose()
+{
+  notifyUnload();
+  gCurrent = nullptr;
+  gCoreState.reset();
+}
+
+bool coreInit(const std::string & corePath, CoreLoadError & error)
+{
+  coreClose(); // Close any previously opened core
+  gCoreState = gCorePool.take(corePath);
+  if (!gCoreState) gCoreState = createCore(corePath, corePath, error);
+  gCorePath = corePath;
+  gCurrent = gCoreState.get();
+  if (!gCoreState) return false;
+
+  logWrite(LOG_INFO, "%s - %s", gCoreState->libraryName.c_str(), gCoreState->libraryVersion.c_str());
+  return true;
+}
+
+void coreSetBindingMode(bool eager, bool deepBind)
+{
+  gEagerBinding = eager;
+  gDeepBinding = deepBind;
+}
+
+CoreCapabilities coreCapabilities()
+{
+  return gCoreState ? gCoreState->capabilities : CoreCapabilities();
+}
+
+void corePoolSetup(const std::string & corePath, size_t count)
+{
+  gCorePool.setup(corePath, count);
+}
+
+CorePoolStats corePoolStats()
+{
+  return gCorePool.stats();
+}
+
+void coreLibraryInfo(std::string & name, std::string & version)
+{
+  name = gCoreState->libraryName;
+  version = gCoreState->libraryVersion;
+}
+
+uint64_t coreGameGeneration()
+{
+  return gCoreState ? gGameGeneration : 0;
+}
+
+void coreLoadGame(const std::string & romPath)
+{
+  notifyUnload();
+  gCoreState->autosave.reset(); // Writes what the previous game left pending
+  gCoreState->runAhead.secondary.reset();
+  gCoreState->runAhead.secondaryFailed = false;
+  if (loadGame(*gCoreState, romPath)) startAutosave(*gCoreState);
+}
+
+namespace
+{
+
+  // Makes the frame's timings current for the callbacks, and records them when it ends
+  struct FrameTimingScope
+  {
+    explicit FrameTimingScope(FrameTimings & timings)
+      : timings(timings), prev(gFrameTimings), start(timingTicks())
+    {
+      gFrameTimings = &timings;
+    }
+
+    ~FrameTimingScope()
+    {
+      gFrameTimings = prev;
+      timings.endFrame(timingTicks() - start);
+    }
+
+    FrameTimings & timings;
+    FrameTimings * prev;
+    uint64_t start;
+  };
+
+} // anonymous namespace
+
+void coreUpdate()
+{
+  CoreState & core = *gCoreState;
+  FrameTimingScope timing(core.timings);
+  auto & ra = core.runAhead;
+  const size_t audioStart = core.audioBuf.size();
+
+  if (core.netplay) {
+    updateNetplay(core);
+    afterFrame(core, audioStart);
+    return;
+  }
+
+  if (core.moviePlayer) playMovieFrame(core);
+
+  if (ra.frames == 0) {
+    TimingScope timing(gFrameTimings, TIMING_RUN);
+    core.retro.run();
+  }
+  else {
+    const auto start = Clock::now();
+    if (ra.secondInstance && ensureSecondary(core, gCorePath)) {
+      runAheadSecondary(core);
+    }
+    else {
+      runAheadSingle(core);
+    }
+    ra.stats.frames++;
+    ra.stats.totalUs += elapsedUs(start);
+    ra.stats.serializeSize = core.stateBuf.size();
+  }
+  core.frame++;
+
+  afterFrame(core, audioStart);
+
+  if (core.movieWriter) recordMovieFrame(core);
+
+  if (core.rewind && core.frame % core.rewindInterval == 0 && saveState(core)) {
+    core.rewind->push(core.stateBuf, core.frame);
+  }
+}
+
+void coreRunAhead(size_t frames, bool secondInstance)
+{
+  auto & ra = gCoreState->runAhead;
+  ra.frames = frames;
+  ra.secondInstance = secondInstance;
+  ra.secondaryValid = false;
+  ra.secondaryFailed = false;
+  ra.stats = RunAheadStats();
+  if (!secondInstance || frames == 0) ra.secondary.reset();
+}
+
+RunAheadStats coreRunAheadStats()
+{
+  return gCoreState->runAhead.stats;
+}
+
+TimingSummary coreFrameStats(TimingStage stage)
+{
+  return gCoreState->timings.summary(stage);
+}
+
+void coreFrameStatsReset()
+{
+  gCoreState->timings.reset();
+}
+
+void coreFrameStatsAdd(TimingStage stage, uint64_t ticks)
+{
+  if (gCoreState) gCoreState->timings.add(stage, ticks);
+}
+
+std::vector<PerfCounterStats> corePerfCounters()
+{
+  return perfCounters(gCoreState.get());
+}
+
+void corePerfReset()
+{
+  perfReset(gCoreState.get());
+}
+
+void corePerfLog()
+{
+  perfLog(gCoreState.get());
+}
+
+void coreRewindSetup(size_t budget, size_t interval)
+{
+  gCoreState->rewind.reset();
+  gCoreState->rewindInterval = interval ? interval : 1;
+  if (budget) gCoreState->rewind.reset(new RewindBuffer(budget));
+}
+
+size_t coreRewind(size_t frames)
+{
+  CoreState & core = *gCoreState;
+  if (!core.rewind) return 0;
+
+  // Captures may have been skipped, the history is walked by frame number rather than by count
+  const size_t target = core.frame > frames ? core.frame - frames : 0;
+  size_t frame = 0;
+  if (!core.rewind->rewind(target, core.stateBuf, frame)) return 0;
+
+  if (!core.retro.unserialize(&core.stateBuf[0], core.stateBuf.size())) {
+    logWrite(LOG_ERROR, "Rewind: core rejected the state of frame %u", (unsigned)frame);
+    return 0;
+  }
+  core.runAhead.secondaryValid = false;
+  const size_t rewound = core.frame - std::min(frame, core.frame);
+  core.frame = frame;
+  return rewound;
+}
+
+RewindStats coreRewindStats()
+{
+  return gCoreState->rewind ? gCoreState->rewind->stats() : RewindStats();
+}
+
+uint32_t coreStatePoolSave()
+{
+  CoreState & core = *gCoreState;
+  if (!saveState(core)) return 0;
+
+  if (!core.statePool || core.statePool->stateSize() != core.stateBuf.size()) {
+    core.statePool.reset(new StatePool(core.stateBuf.size()));
+    core.statePoolBase = 0;
+  }
+  core.statePoolBase = core.statePool->save(core.stateBuf.data(), core.statePoolBase);
+  return core.statePoolBase;
+}
+
+uint32_t coreStatePoolFork(uint32_t handle)
+{
+  CoreState & core = *gCoreState;
+  return core.statePool ? core.statePool->fork(handle) : 0;
+}
+
+bool coreStatePoolRestore(uint32_t handle)
+{
+  CoreState & core = *gCoreState;
+  if (!core.statePool || !core.statePool->valid(handle)) return false;
+
+  core.stateBuf.resize(core.statePool->stateSize());
+  core.statePool->read(handle, core.stateBuf.data());
+  if (!core.retro.unserialize(core.stateBuf.data(), core.stateBuf.size())) return false;
+  core.statePoolBase = handle;
+  core.runAhead.secondaryValid = false;
+  return true;
+}
+
+bool coreStatePoolRelease(uint32_t handle)
+{
+  CoreState & core = *gCoreState;
+  if (!core.statePool || !core.statePool->release(handle)) return false;
+  if (core.statePoolBase == handle) core.statePoolBase = 0;
+  return true;
+}
+
+StatePoolStats coreStatePoolStats()
+{
+  return gCoreState->statePool ? gCoreState->statePool->stats() : StatePoolStats();
+}
+
+const std::vector<uint32_t> & coreVideoData(size_t & width, size_t & height)
+{
+  width = gCoreState->width;
+  height = gCoreState->height;
+  return gCoreState->videoBuf;
+}
+
+std::vector<int16_t> coreAudioData()
+{
+  const auto res = gCoreState->audioBuf;
+  gCoreState->audioBuf.clear();
+  return res;
+}
+
+void coreTimings(double & fps, double & audioSampleRate)
+{
+  fps = gCoreState->fps;
+  audioSampleRate = gCoreState->audioSampleRate;
+}
+
+SettingsDesc coreSettingsDesc()
+{
+  return gCoreState->settingsDesc;
+}
+
+void coreSettingsSet(const std::string & key, const std::string & value)
+{
+  gCoreState->settings[key] = value;
+  if (gCoreState->runAhead.secondary) gCoreState->runAhead.secondary->settings[key] = value;
+}
+
+std::vector<std::string> coreJoypadDesc()
+{
+  std::vector<std::string> result;
+  for (const auto & desc : gCoreState->inputDescs) {
+    if (desc.port == 0) result.push_back(desc.name);
+  }
+  return result;
+}
+
+void coreJoypadPress(const std::string & name)
+{
+  gCoreState->setInputState(0, name, true);
+}
+
+void coreJoypadRelease(const std::string & name)
+{
+  gCoreState->setInputState(0, name, false);
+}
+
+void coreInputSet(const int32_t * data, size_t ports)
+{
+  gCoreState->setInputState(data, ports);
+}
+
+void coreInputQueuePush(const InputEvent * events, size_t count, bool timed)
+{
+  if (timed) gCoreState->inputQueue.pushTimed(events, count);
+  else gCoreState->inputQueue.push(events, count);
+}
+
+InputQueueStats coreInputQueueStats()
+{
+  return gCoreState->inputQueue.stats();
+}
+
+size_t coreFrame()
+{
+  return gCoreState->frame;
+}
+
+int64_t coreTimeUs()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+size_t coreStateSize()
+{
+  return stateSize(*gCoreState);
+}
+
+bool coreSaveStateInto(void * data, size_t sz)
+{
+  return saveStateInto(*gCoreState, data, sz);
+}
+
+std::vector<uint8_t> coreSaveState()
+{
+  std::vector<uint8_t> res(coreStateSize());
+  if (!coreSaveStateInto(res.data(), res.size())) res.clear();
+  return res;
+}
+
+bool coreRestoreState(const char * data, size_t sz)
+{
+  if (sz == 0 || sz != coreStateSize()) return false;
+  gCoreState->runAhead.secondaryValid = false;
+  return gCoreState->retro.unserialize(data, sz);
+}
+
+bool coreMovieRecord(const std::string & path, size_t ports, size_t keyframeInterval, std::string & error)
+{
+  CoreState & core = *gCoreState;
+  core.moviePlayer.reset();
+  if (!coreMovieStop(error)) return false;
+
+  MovieInfo info;
+  info.coreName = core.libraryName;
+  info.coreVersion = core.libraryVersion;
+  const size_t sep = core.romPath.find_last_of("/\\");
+  info.romName = (sep == std::string::npos) ? core.romPath : core.romPath.substr(sep + 1);
+  if (!romIdentity(core, info.romSize, info.romCrc)) {
+    error = "Cannot read " + core.romPath;
+    return false;
+  }
+  info.inputValues = (uint32_t)(std::min(ports, (size_t)CoreState::MAX_PORTS) * INPUT_STRIDE);
+  info.keyframeInterval = (uint32_t)keyframeInterval;
+
+  if (!saveState(core)) {
+    error = "Core cannot serialize";
+    return false;
+  }
+
+  std::unique_ptr<MovieWriter> writer(new MovieWriter());
+  if (!writer->open(path, info, core.stateBuf.data(), core.stateBuf.size(), error)) return false;
+  core.movieWriter = std::move(writer);
+  core.movieFrame = 0;
+  return true;
+}
+
+bool coreMoviePlay(const std::string & path, std::string & error)
+{
+  CoreState & core = *gCoreState;
+  if (!coreMovieStop(error)) return false;
+
+  std::unique_ptr<MovieReader> player(new MovieReader());
+  if (!player->open(path, error)) return false;
+
+  const MovieInfo & info = player->info();
+  if (info.coreName != core.libraryName) {
+    error = "Movie was recorded with " + info.coreName + ", not " + core.libraryName;
+    return false;
+  }
+  if (info.coreVersion != core.libraryVersion) {
+    logWrite(LOG_WARN, "Movie was recorded with %s %s, playing it back with %s",
+      info.coreName.c_str(), info.coreVersion.c_str(), core.libraryVersion.c_str());
+  }
+  uint64_t romSize = 0;
+  uint32_t romCrc = 0;
+  if (!romIdentity(core, romSize, romCrc) || romSize != info.romSize || romCrc != info.romCrc) {
+    error = "Movie was recorded with another ROM: " + info.romName;
+    return false;
+  }
+
+  core.moviePlayer = std::move(player);
+  if (!restoreMovieKeyframe(core, 0)) {
+    core.moviePlayer.reset();
+    error = "Core rejected the movie starting state";
+    return false;
+  }
+  return true;
+}
+
+bool coreMovieStop(std::string & error)
+{
+  CoreState & core = *gCoreState;
+  core.moviePlayer.reset();
+  if (!core.movieWriter) return true;
+
+  const bool ok = core.movieWriter->close(error);
+  core.movieWriter.reset();
+  return ok;
+}
+
+bool coreMovieSeek(size_t frame)
+{
+  CoreState & core = *gCoreState;
+  if (!core.moviePlayer || frame > core.moviePlayer->frames()) return false;
+
+  // Going forward from the current frame beats restoring an earlier keyframe
+  const size_t interval = core.moviePlayer->info().keyframeInterval;
+  const bool forward = frame >= core.movieFrame && (interval == 0 || frame / interval == core.movieFrame / interval);
+  if (!forward) {
+    // coreFrame moves with the movie
+    const size_t from = core.movieFrame;
+    if (!restoreMovieKeyframe(core, frame)) return false;
+    core.frame = (core.frame + core.movieFrame > from) ? core.frame + core.movieFrame - from : 0;
+  }
+
+  while (core.movieFrame < frame && playMovieFrame(core)) {
+    runFrame(core, false, false, false);
+    core.frame++;
+  }
+  return true;
+}
+
+MovieStatus coreMovieStatus()
+{
+  const CoreState & core = *gCoreState;
+  MovieStatus status;
+  status.recording = (bool)core.movieWriter;
+  status.playing = (bool)core.moviePlayer;
+  status.frame = core.movieFrame;
+  status.frames = core.movieWriter ? core.movieWriter->frames() : core.moviePlayer ? core.moviePlayer->frames() : 0;
+  return status;
+}
+
+bool coreMovieReplay(const std::string & path, bool video, MovieReplayStats & stats, std::string & error)
+{
+  CoreState & core = *gCoreState;
+  stats = MovieReplayStats();
+  if (!coreMoviePlay(path, error)) return false;
+
+  // Audio is never collected, video only converted when asked to
+  const auto start = Clock::now();
+  while (playMovieFrame(core)) {
+    runFrame(core, video, false, false);
+    core.frame++;
+    stats.frames++;
+  }
+  stats.totalUs = elapsedUs(start);
+  return true;
+}
+
+bool coreNetplayStart(const NetplayConfig & config, bool loopback, std::string & error)
+{
+  CoreState & core = *gCoreState;
+  coreNetplayStop();
+
+  if (config.player > 1) {
+    error = "Player must be 0 or 1";
+    return false;
+  }
+  if (!saveState(core)) {
+    error = "Core cannot serialize";
+    return false;
+  }
+
+  std::unique_ptr<NetplaySession> session = createNetplaySession(core, config, true);
+  if (!session->open(error)) return false;
+
+  if (loopback) {
+    // The peer starts from the very same state
+    std::unique_ptr<CoreState> peer = cloneCore(core, gCorePath);
+    if (!peer) {
+      error = "Cannot create a second instance of the core";
+      return false;
+    }
+    {
+      CurrentScope scope(peer.get());
+      if (!peer->retro.unserialize(core.stateBuf.data(), core.stateBuf.size())) {
+        error = "Second instance rejected the state";
+        return false;
+      }
+    }
+
+    NetplayConfig peerConfig = config;
+    peerConfig.player = 1 - config.player;
+    peerConfig.localPort = 0;
+    peer->netplay = createNetplaySession(*peer, peerConfig, false);
+    if (!peer->netplay->open(error)) return false;
+    if (!peer->netplay->connect("127.0.0.1", session->localPort(), error)) return false;
+    if (!session->connect("127.0.0.1", peer->netplay->localPort(), error)) return false;
+    core.netplayPeer = std::move(peer);
+  }
+  else if (!session->connect(config.remoteHost, config.remotePort, error)) {
+    return false;
+  }
+
+  core.netplay = std::move(session);
+  return true;
+}
+
+void coreNetplayStop()
+{
+  gCoreState->netplay.reset();
+  gCoreState->netplayPeer.reset();
+}
+
+NetplayStats coreNetplayStats()
+{
+  return gCoreState->netplay ? gCoreState->netplay->stats() : NetplayStats();
+}
+
+void coreFingerprintSetup(unsigned flags)
+{
+  gCoreState->fingerprintFlags = flags;
+  gCoreState->fingerprint = 0;
+}
+
+uint64_t coreFingerprint()
+{
+  return gCoreState->fingerprint;
+}
+
+bool coreMovieCompare(const std::string & pathA, const std::string & pathB, unsigned flags, MovieDivergence & result, std::string & error)
+{
+  CoreState & core = *gCoreState;
+  result = MovieDivergence();
+
+  MovieReader movies[2];
+  if (!movies[0].open(pathA, error) || !movies[1].open(pathB, error)) return false;
+
+  const MovieInfo & infoA = movies[0].info();
+  const MovieInfo & infoB = movies[1].info();
+  if (infoA.inputValues != infoB.inputValues) {
+    error = "Movies record a different number of ports";
+    return false;
+  }
+
+  // Input is compared directly, only the start states need emulating to compare
+  const uint64_t frames = std::min(movies[0].frames(), movies[1].frames());
+  std::vector<int32_t> inputA(infoA.inputValues), inputB(infoB.inputValues);
+  for (uint64_t f=0; f<frames && result.input < 0; f++) {
+    movies[0].input(f, inputA.data());
+    movies[1].input(f, inputB.data());
+    if (inputA != inputB) result.input = (int64_t)f;
+  }
+
+  // Fingerprints of the first movie, then the second one is played until they differ
+  std::vector<uint64_t> prints;
+  prints.reserve(frames);
+  const bool video = (flags & FINGERPRINT_VIDEO) != 0;
+  const bool audio = (flags & FINGERPRINT_AUDIO) != 0;
+  for (int m=0; m<2 && result.state < 0; m++) {
+    if (!coreMoviePlay(m == 0 ? pathA : pathB, error)) return false;
+    for (uint64_t f=0; f<frames && playMovieFrame(core); f++) {
+      core.audioBuf.clear();
+      runFrame(core, video, audio, false);
+      const uint64_t h = fingerprint(core, flags, 0);
+      if (m == 0) prints.push_back(h);
+      else if (prints[f] != h) {
+        result.state = (int64_t)f;
+        break;
+      }
+    }
+    core.audioBuf.clear();
+  }
+  core.moviePlayer.reset();
+  result.frames = frames;
+  return true;
+}
+
+void * coreMemoryData(unsigned id, size_t & size)
+{
+  CoreState & core = *gCoreState;
+  size = 0;
+  if (!core.retro.get_memory_data || !core.retro.get_memory_size) return nullptr;
+
+  void * data = core.retro.get_memory_data(id);
+  if (data) size = core.retro.get_memory_size(id);
+  return size ? data : nullptr;
+}
+
+void coreSetUnloadHook(std::function<void()> hook)
+{
+  gUnloadHook = hook;
+}
+
+size_t coreMemoryMapDescriptors()
+{
+  return gCoreState->memoryMap.descriptors();
+}
+
+void coreMemoryRead(const uint32_t * addresses, size_t count, unsigned width, void * out)
+{
+  gCoreState->memoryMap.read(addresses, count, width, out);
+}
+
+size_t coreMemoryReadRange(uint64_t address, uint8_t * out, size_t size)
+{
+  return gCoreState->memoryMap.readRange(address, out, size);
+}
+
+bool coreScanReset(unsigned region, unsigned width, bool bigEndian, bool aligned)
+{
+  CoreState & core = *gCoreState;
+  size_t size;
+  const uint8_t * data = (const uint8_t *)coreMemoryData(region, size);
+  if (!data) return false;
+
+  core.scanRegion = region;
+  core.scanner.reset(data, size, width, bigEndian, aligned);
+  return true;
+}
+
+size_t coreScanFilter(ScanOp op, uint32_t value)
+{
+  CoreState & core = *gCoreState;
+  size_t size;
+  const uint8_t * data = (const uint8_t *)coreMemoryData(core.scanRegion, size);
+  if (!data || size != core.scanner.size()) return 0;
+  return core.scanner.filter(data, op, value);
+}
+
+size_t coreScanResults(uint32_t * offsets, uint32_t * values, size_t max)
+{
+  return gCoreState->scanner.results(offsets, values, max);
+}
+
+int64_t coreConditionAdd(const std::string & source, uint32_t hitTarget, std::string & error)
+{
+  return gCoreState->conditions.add(source, hitTarget, error);
+}
+
+bool coreConditionRemove(uint32_t id)
+{
+  return gCoreState->conditions.remove(id);
+}
+
+void coreConditionsClear()
+{
+  gCoreState->conditions.clear();
+}
+
+void coreConditionsResetHits()
+{
+  gCoreState->conditions.resetHits();
+}
+
+uint32_t coreConditionHits(uint32_t id)
+{
+  return gCoreState->conditions.hits(id);
+}
+
+const std::vector<uint32_t> & coreConditionsTriggered()
+{
+  return gCoreState->conditions.triggered();
+}
+
+void coreSetSaveDirectory(const std::string & dir)
+{
+  const char * saveDir = internDirectory(dir.empty() ? "./" : dir);
+  if (gSaveDir.exchange(saveDir) != saveDir) gCorePool.flush();
+}
+
+void coreAutosaveSetup(bool enabled, size_t debounceMs, size_t maxDelayMs)
+{
+  gAutosave = enabled;
+  gAutosaveDebounceMs = debounceMs;
+  gAutosaveMaxDelayMs = maxDelayMs;
+  if (gCoreState && !gCoreState->romPath.empty()) startAutosave(*gCoreState);
+}
+
+void coreAutosaveFlush()
+{
+  if (gCoreState->autosave) gCoreState->autosave->flush();
+}
+
+AutosaveStats coreAutosaveStats()
+{
+  return gCoreState->autosave ? gCoreState->autosave->stats() : AutosaveStats();
+}
+
+void coreRomCachePut(const std::string & path, const void * data, size_t size)
+{
+  romCachePut(path, data, size);
+}
+
+void coreRomCacheClear()
+{
+  romCacheClear();
+}
+
+RomCacheStats coreRomCacheStats()
+{
+  return romCacheStats();
+}
+
+bool coreArchiveEntries(const std::string & path, std::vector<ZipEntry> & entries, std::string & error)
+{
+  const auto archive = zipOpen(path, error);
+  if (!archive) return false;
+  entries = archive->entries();
+  return true;
+}
+
+namespace
+{
+
+  CoreInfoCache gCoreInfoCache;
+  CoreMetadata * gProbe = nullptr;
+
+  // Only records what the core announces, it is not initialized and gets nothing back
+  bool probeEnvironment(unsigned cmd, void * data)
+  {
+    switch (cmd) {
+      case RETRO_ENVIRONMENT_SET_VARIABLES: {
+        const retro_variable * variables = (const retro_variable *)data;
+        for (; variables->key; variables++) {
+          gProbe->settingsDesc.push_back(SettingsEntryDesc {
+            variables->key,
+            settingsName(variables->value),
+            settingsChoices(variables->value),
+          });
+        }
+        return true;
+      }
+
+      case RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME: {
+        gProbe->supportsNoGame = *(const bool *)data;
+        return true;
+      }
+    }
+    return false;
+  }
+
+} // anonymous namespace
+
+void coreProbeCache(const std::string & path)
+{
+  gCoreInfoCache.load(path);
+}
+
+bool coreProbe(const std::string & corePath, CoreMetadata & meta, std::string & error)
+{
+  struct stat st;
+  if (stat(corePath.c_str(), &st) != 0) {
+    error = "Cannot open " + corePath;
+    return false;
+  }
+  if (const CoreMetadata * cached = gCoreInfoCache.find(corePath, (int64_t)st.st_mtime, (uint64_t)st.st_size)) {
+    meta = *cached;
+    return true;
+  }
+
+  const dynlib_t lib = dynLibOpen(corePath);
+  if (!lib) {
+    error = "Cannot open " + corePath;
+    return false;
+  }
+
+  const auto setEnvironment = (decltype(retro_set_environment) *)dynLibGetSymbolPtr(lib, "retro_set_environment");
+  const auto getSystemInfo = (decltype(retro_get_system_info) *)dynLibGetSymbolPtr(lib, "retro_get_system_info");
+  if (!setEnvironment || !getSystemInfo) {
+    dynLibClose(lib);
+    error = "Not a libretro core: " + corePath;
+    return false;
+  }
+
+  meta = CoreMetadata();
+  if (gCoreState && gCoreState->dlHandle == lib) {
+    // Same library as the running core, whose environment must stay in place
+    meta.settingsDesc = gCoreState->settingsDesc;
+  }
+  else {
+    gProbe = &meta;
+    setEnvironment(&probeEnvironment);
+    gProbe = nullptr;
+  }
+
+  retro_system_info info;
+  memset(&info, 0, sizeof(info));
+  getSystemInfo(&info);
+  meta.libraryName = info.library_name ? info.library_name : "";
+  meta.libraryVersion = info.library_version ? info.library_version : "";
+  meta.validExtensions = info.valid_extensions ? info.valid_extensions : "";
+  meta.needFullpath = info.need_fullpath;
+  meta.blockExtract = info.block_extract;
+  dynLibClose(lib);
+
+  if (gCoreInfoCache.enabled()) {
+    gCoreInfoCache.put(corePath, (int64_t)st.st_mtime, (uint64_t)st.st_size, meta);
+    std::string saveError;
+    if (!gCoreInfoCache.save(saveError)) logWrite(LOG_ERROR, "Core info cache: %s", saveError.c_str());
+  }
+  return true;
 }
@@ -1,16 +1,91 @@
 #pragma once
 
 #include <stdint.h>
+#include <functional>
 #include <string>
 #include <vector>
 
+#include "autosave.h"
+#include "coreinfo.h"
+#include "inputqueue.h"
+#include "memscan.h"
+#include "netplay.h"
+#include "perfcounters.h"
+#include "rewind.h"
+#include "romcache.h"
+#include "statepool.h"
+#include "timing.h"
+#include "zip.h"
+
 
 // CORE LOADING
 //--------------------------------------------------------------------------------------------------
 
-void coreInit(const std::string & corePath);
+struct CoreLoadError
+{
+  std::string message;
+  std::vector<std::string> missingSymbols; // Required entry points the library does not export
+};
+
+// @return false if the library cannot be opened or lacks part of the API the frontend calls
+bool coreInit(const std::string & corePath, CoreLoadError & error);
 void coreClose();
 
+// Eager binding (the default) resolves every symbol of the library when it is opened, so that
+// no lazy binding happens during the first frames. `deepBind` keeps the core on its own copies of
+// symbols it shares with the process (e.g. a statically linked zlib), on glibc only.
+// @note Takes effect on the next coreInit
+void coreSetBindingMode(bool eager, bool deepBind);
+
+// Optional parts of the API the running core exports
+struct CoreCapabilities
+{
+  unsigned apiVersion = 0;
+  bool controllerPortDevice = false;
+  bool reset = false;
+  bool cheats = false;
+  bool loadGameSpecial = false;
+  bool unloadGame = false;
+  bool region = false;
+  bool memory = false;
+  std::vector<std::string> missingSymbols;
+};
+
+CoreCapabilities coreCapabilities();
+
+// As reported by retro_get_system_info
+void coreLibraryInfo(std::string & name, std::string & version);
+
+// Changes whenever the loaded game goes away (coreLoadGame, coreInit, coreClose), 0 while no core is
+// open. Lets work finishing later check that it still applies to the same game.
+uint64_t coreGameGeneration();
+
+// Metadata without initializing the core: only retro_set_environment and retro_get_system_info are
+// called. Results are kept in the cache file if one is set, so cores unchanged on disk are not even
+// opened again.
+void coreProbeCache(const std::string & path);
+bool coreProbe(const std::string & corePath, CoreMetadata & meta, std::string & error);
+
+struct CorePoolStats
+{
+  size_t ready = 0;
+  size_t warming = 0;
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t failures = 0;
+  size_t warmups = 0;
+  double warmTotalMs = 0;
+  double warmLastMs = 0;
+  double warmMaxMs = 0;
+};
+
+// Keeps `count` initialized instances of a core ready on a helper thread, coreInit hands one out
+// and a replacement is warmed in the background. 0 releases the instances of that core.
+// @note Pooled instances start with default settings, like any coreInit, and are warmed again when
+//       the save directory changes
+void corePoolSetup(const std::string & corePath, size_t count);
+CorePoolStats corePoolStats();
+
 
 // ROM LOADING
 //--------------------------------------------------------------------------------------------------
@@ -23,6 +98,61 @@ void coreLoadGame(const std::string & romPath);
 
 void coreUpdate();
 
+// Content is mapped once per process and shared by every instance loading the same path. Cores
+// which do not need a path on disk (need_fullpath) read it straight from that memory.
+
+// Serves `path` from a copy of `data`, for content which is not on disk
+// @note Cores which need a path on disk still open the file
+void coreRomCachePut(const std::string & path, const void * data, size_t size);
+void coreRomCacheClear();
+RomCacheStats coreRomCacheStats();
+
+// Files of an archive, for picking the `archive.zip#entry` to load
+bool coreArchiveEntries(const std::string & path, std::vector<ZipEntry> & entries, std::string & error);
+
+// RUN-AHEAD
+//--------------------------------------------------------------------------------------------------
+
+// Each coreUpdate runs the real frame, then `frames` more frames with audio and video suppressed
+// (except for the video of the last one) and rolls them back, hiding the core's internal input lag.
+// @param secondInstance Keep a second copy of the core running ahead instead, which only needs a
+//                       state transfer when the input differs from the one it ran with. If that
+//                       copy cannot be set up, the first instance runs ahead until the next call
+//                       or coreLoadGame.
+// @note frames = 0 disables run-ahead, as does a core failing to save or restore a state (see
+//       RunAheadStats::disabled)
+void coreRunAhead(size_t frames, bool secondInstance);
+
+struct RunAheadStats
+{
+  size_t frames = 0;        // Frames emulated with run-ahead enabled
+  size_t resyncs = 0;       // State transfers to the second instance
+  size_t serializeSize = 0; // Bytes
+  double serializeUs = 0.0; // Accumulated timings, in microseconds
+  double unserializeUs = 0.0;
+  double speculativeUs = 0.0;
+  double totalUs = 0.0;
+  bool disabled = false;    // Turned off after the core failed to save or restore a state
+};
+
+RunAheadStats coreRunAheadStats();
+
+
+// REWIND
+//--------------------------------------------------------------------------------------------------
+
+// Captures a state every `interval` frames into a ring of delta-compressed states
+// @param budget Memory the ring may use, in bytes. 0 disables rewind
+void coreRewindSetup(size_t budget, size_t interval);
+
+// Restores the state captured about `frames` frames ago (at least one capture back), coreFrame
+// goes back with it
+// @return Number of frames actually rewound, 0 when the history is empty or the core rejected
+//         the state
+size_t coreRewind(size_t frames);
+
+RewindStats coreRewindStats();
+
 
 // VIDEO
 //--------------------------------------------------------------------------------------------------
@@ -45,18 +175,28 @@ std::vector<int16_t> coreAudioData();
 void coreTimings(double & fps, double & audioSampleRate);
 
 
-// CORE SETTINGS
+// FRAME STATS
 //--------------------------------------------------------------------------------------------------
 
-struct SettingsEntryDesc
-{
-  std::string key;
-  std::string name; // Human readable
-  std::vector<std::string> choices;
-};
+// Per-stage timings of the frames emulated by coreUpdate, see TimingStage
+TimingSummary coreFrameStats(TimingStage stage);
+void coreFrameStatsReset();
 
-typedef std::vector<SettingsEntryDesc> SettingsDesc;
+// Charges time spent outside the core to the next frame, e.g. TIMING_MARSHAL
+void coreFrameStatsAdd(TimingStage stage, uint64_t ticks);
 
+// Counters the core registered through RETRO_ENVIRONMENT_GET_PERF_INTERFACE, in registration order
+std::vector<PerfCounterStats> corePerfCounters();
+void corePerfReset();
+
+// Same as the core's perf_log, to the log sink
+void corePerfLog();
+
+
+// CORE SETTINGS
+//--------------------------------------------------------------------------------------------------
+
+// SettingsEntryDesc is in coreinfo.h
 SettingsDesc coreSettingsDesc();
 void coreSettingsSet(const std::string & key, const std::string & value);
 
@@ -64,13 +204,223 @@ void coreSettingsSet(const std::string & key, const std::string & value);
 // JOYPAD
 //--------------------------------------------------------------------------------------------------
 
-// @note The same joypad for all players
+// @note Names of port 0 only, press and release act on port 0
 std::vector<std::string> coreJoypadDesc();
 void coreJoypadPress(const std::string & name);
 void coreJoypadRelease(const std::string & name);
 
+// INPUT
+//--------------------------------------------------------------------------------------------------
+
+// Layout of one port in coreInputSet arrays
+enum InputField
+{
+  INPUT_BUTTONS,         // Bit n is RETRO_DEVICE_ID_JOYPAD_n
+  INPUT_ANALOG_LEFT_X,   // RETRO_DEVICE_ANALOG axes, -0x8000 to 0x7fff
+  INPUT_ANALOG_LEFT_Y,
+  INPUT_ANALOG_RIGHT_X,
+  INPUT_ANALOG_RIGHT_Y,
+  INPUT_POINTER_X,       // RETRO_DEVICE_POINTER, -0x7fff to 0x7fff across the screen
+  INPUT_POINTER_Y,
+  INPUT_POINTER_PRESSED,
+  INPUT_STRIDE
+};
+
+// Replaces the whole input of ports [0, ports) from `ports * INPUT_STRIDE` values
+// @note Like coreJoypadPress/Release, takes effect all at once on the next retro_input_poll
+void coreInputSet(const int32_t * data, size_t ports);
+
+// Queues events applied when the core polls input during their target frame (see coreFrame), or
+// for timed events, during the first frame polled at or after their time (see coreTimeUs)
+// @note Thread-safe. Events targeting a past frame are applied on the next poll and counted late
+void coreInputQueuePush(const InputEvent * events, size_t count, bool timed);
+InputQueueStats coreInputQueueStats();
+
+// Number of the frame the next coreUpdate emulates, 0 right after coreLoadGame
+size_t coreFrame();
+
+// Monotonic clock used by timed input events, in microseconds
+int64_t coreTimeUs();
+
 // SAVE STATE
 //--------------------------------------------------------------------------------------------------
 
+// Size of a state for the loaded game, cached until the next coreLoadGame
+size_t coreStateSize();
+
+// Serializes straight into `data`
+// @return false if `sz` is not coreStateSize() or the core failed
+bool coreSaveStateInto(void * data, size_t sz);
+
 std::vector<uint8_t> coreSaveState();
+
+// @return false if `sz` is not coreStateSize() or the core rejected the state
 bool coreRestoreState(const char * data, size_t sz);
+
+
+// MOVIE
+//--------------------------------------------------------------------------------------------------
+
+// Input movies hold the input the core consumed each frame, from a starting state embedded in the
+// file, with a keyframe state every `keyframeInterval` frames to seek from. Playback is
+// deterministic as long as the core is. coreLoadGame stops any recording or playback.
+
+// Records from the current state on, the input of ports [0, ports)
+bool coreMovieRecord(const std::string & path, size_t ports, size_t keyframeInterval, std::string & error);
+
+// Plays a movie back through coreUpdate from its starting state; input set otherwise, queued or
+// not, is ignored until it ends
+// @return false if the movie does not belong to the loaded core and ROM
+bool coreMoviePlay(const std::string & path, std::string & error);
+
+// Ends recording or playback
+// @return false if the recording could not be completed
+bool coreMovieStop(std::string & error);
+
+// Jumps to `frame` of the movie being played back, emulating from the closest keyframe without
+// producing any output
+bool coreMovieSeek(size_t frame);
+
+struct MovieStatus
+{
+  bool recording = false;
+  bool playing = false;
+  size_t frame = 0;  // Frame the next coreUpdate emulates
+  size_t frames = 0; // Recorded so far, or in the movie being played back
+};
+
+MovieStatus coreMovieStatus();
+
+struct MovieReplayStats
+{
+  size_t frames = 0;
+  double totalUs = 0;
+};
+
+// Plays a whole movie back as fast as possible, leaving the core at its last frame
+// @param video Converts frames too, only the last one is visible anyway
+bool coreMovieReplay(const std::string & path, bool video, MovieReplayStats & stats, std::string & error);
+
+
+// NETPLAY
+//--------------------------------------------------------------------------------------------------
+
+// Two player rollback netplay. Both peers must start from the same state of the same game. The
+// local player drives port 0 as usual, whichever player it is; coreUpdate then exchanges input,
+// rolls back on misprediction and may hold a frame back while waiting for the remote player.
+// @note Run-ahead, rewind, movies and the input queue are not used while a session runs
+
+// @param loopback Plays against a second instance of the core in this process, over 127.0.0.1
+//   with the simulated network conditions of `config`, mirroring the local input
+bool coreNetplayStart(const NetplayConfig & config, bool loopback, std::string & error);
+void coreNetplayStop();
+NetplayStats coreNetplayStats();
+
+
+// FINGERPRINT
+//--------------------------------------------------------------------------------------------------
+
+// Cheap hash of what a frame produced, to detect desyncs between hosts, replays or rollbacks
+enum FingerprintFlags
+{
+  FINGERPRINT_VIDEO = 1 << 0, // Converted frame, see coreVideoData
+  FINGERPRINT_AUDIO = 1 << 1, // Samples produced during the frame
+  FINGERPRINT_RAM   = 1 << 2, // RETRO_MEMORY_SYSTEM_RAM, when the core exposes it
+};
+
+// Hashes what `flags` selects after every coreUpdate, 0 disables it
+void coreFingerprintSetup(unsigned flags);
+
+// Fingerprint of the last frame, 0 if disabled
+uint64_t coreFingerprint();
+
+struct MovieDivergence
+{
+  uint64_t frames = 0;  // Frames compared, the length of the shortest movie
+  int64_t input = -1;   // First frame with different input, -1 if none
+  int64_t state = -1;   // First frame with a different fingerprint, -1 if none
+};
+
+// Plays both movies back and locates the first frame where they diverge
+// @note Leaves the core wherever the comparison stopped
+bool coreMovieCompare(const std::string & pathA, const std::string & pathB, unsigned flags, MovieDivergence & result, std::string & error);
+
+
+// MEMORY
+//--------------------------------------------------------------------------------------------------
+
+// Region of the loaded game owned by the core, RETRO_MEMORY_SAVE_RAM, RTC, SYSTEM_RAM or VIDEO_RAM
+// @return nullptr if the core does not expose it
+void * coreMemoryData(unsigned id, size_t & size);
+
+// Address space of the emulated CPU, from RETRO_ENVIRONMENT_SET_MEMORY_MAPS
+// @return Descriptors in use, 0 if the core did not describe its memory
+size_t coreMemoryMapDescriptors();
+
+// Reads one value of `width` bytes (1, 2 or 4) per emulated address, in the endianness of the
+// memory; unmapped bytes read as 0
+void coreMemoryRead(const uint32_t * addresses, size_t count, unsigned width, void * out);
+
+// @return Bytes actually mapped in [address, address + size)
+size_t coreMemoryReadRange(uint64_t address, uint8_t * out, size_t size);
+
+// Starts a search over a RETRO_MEMORY_* region, every position being a candidate. coreLoadGame ends
+// the search.
+// @param width 1, 2 or 4 bytes
+// @return false if the core does not expose the region
+bool coreScanReset(unsigned region, unsigned width, bool bigEndian, bool aligned);
+
+// Compares the region with `value` or with its state at the previous filter
+// @return Candidates left
+size_t coreScanFilter(ScanOp op, uint32_t value);
+
+// Byte offsets in the region of the first `max` candidates, and their value
+// @param values May be null
+size_t coreScanResults(uint32_t * offsets, uint32_t * values, size_t max);
+
+// Conditions evaluated after every coreUpdate, see conditions.h for the expression syntax.
+// Addresses are the ones of the memory map when the core describes one, system RAM offsets
+// otherwise. coreLoadGame removes every condition.
+// @return Id of the condition, -1 with `error` set if the expression does not compile
+int64_t coreConditionAdd(const std::string & source, uint32_t hitTarget, std::string & error);
+bool coreConditionRemove(uint32_t id);
+void coreConditionsClear();
+void coreConditionsResetHits();
+uint32_t coreConditionHits(uint32_t id);
+
+// Ids of the conditions which triggered during the last coreUpdate
+const std::vector<uint32_t> & coreConditionsTriggered();
+
+// Called right before the loaded game and its memory go away (coreLoadGame, coreInit, coreClose)
+void coreSetUnloadHook(std::function<void()> hook);
+
+
+// SRAM
+//--------------------------------------------------------------------------------------------------
+
+// Battery saves live in <dir>/<ROM name>.srm, loaded by coreLoadGame and written back by the
+// autosave helper thread. The core is also told about this directory.
+// @note Takes effect on the next coreLoadGame
+void coreSetSaveDirectory(const std::string & dir);
+
+// Enabled by default: the SRAM is compared after every frame and written once it has been stable
+// for `debounceMs`, or every `maxDelayMs` while it keeps changing
+void coreAutosaveSetup(bool enabled, size_t debounceMs, size_t maxDelayMs);
+
+// Writes pending changes now, still from the helper thread
+void coreAutosaveFlush();
+AutosaveStats coreAutosaveStats();
+
+
+// SAVE STATE POOL
+//--------------------------------------------------------------------------------------------------
+
+// States kept natively and referred to by handle, for search over inputs. A new state shares its
+// unchanged 4 KiB pages with the last state saved or restored, typically its parent in the tree.
+// @note Handles are invalidated by coreLoadGame, 0 means failure
+
+uint32_t coreStatePoolSave();
+uint32_t coreStatePoolFork(uint32_t handle);
+bool coreStatePoolRestore(uint32_t handle);
+bool coreStatePoolRelease(uint32_t handle);
+StatePoolStats coreStatePoolStats();
@@ -0,0 +1,173 @@
+#include "coreinfo.h"
+#include "fileio.h"
+
+#include <string.h>
+
+
+namespace
+{
+
+  const char MAGIC[4] = { 'R', 'C', 'I', 'C' };
+  const uint32_t VERSION = 1;
+
+  enum MetadataFlags
+  {
+    NEED_FULLPATH = 1 << 0,
+    BLOCK_EXTRACT = 1 << 1,
+    SUPPORTS_NO_GAME = 1 << 2,
+  };
+
+  class Writer
+  {
+  public:
+    explicit Writer(std::vector<uint8_t> & out) : out_(out) {}
+
+    void bytes(const void * data, size_t size)
+    {
+      out_.insert(out_.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+    }
+
+    void u32(uint32_t v) { bytes(&v, sizeof(v)); }
+    void u64(uint64_t v) { bytes(&v, sizeof(v)); }
+
+    void str(const std::string & s)
+    {
+      u32((uint32_t)s.size());
+      bytes(s.data(), s.size());
+    }
+
+  private:
+    std::vector<uint8_t> & out_;
+  };
+
+  // Every read is bounds-checked, a short or corrupted file just fails the whole load
+  class Reader
+  {
+  public:
+    Reader(const uint8_t * data, size_t size) : p_(data), end_(data + size) {}
+
+    bool ok() const { return ok_; }
+
+    bool bytes(void * out, size_t size)
+    {
+      if (!ok_ || (size_t)(end_ - p_) < size) return ok_ = false;
+      memcpy(out, p_, size);
+      p_ += size;
+      return true;
+    }
+
+    uint32_t u32() { uint32_t v = 0; bytes(&v, sizeof(v)); return v; }
+    uint64_t u64() { uint64_t v = 0; bytes(&v, sizeof(v)); return v; }
+
+    std::string str()
+    {
+      const uint32_t size = u32();
+      if (!ok_ || (size_t)(end_ - p_) < size) {
+        ok_ = false;
+        return std::string();
+      }
+      std::string s((const char *)p_, size);
+      p_ += size;
+      return s;
+    }
+
+  private:
+    const uint8_t * p_;
+    const uint8_t * end_;
+    bool ok_ = true;
+  };
+
+} // anonymous namespace
+
+void CoreInfoCache::load(const std::string & path)
+{
+  path_ = path;
+  entries_.clear();
+
+  MappedFile file;
+  if (!file.open(path)) return;
+
+  Reader in(file.data(), file.size());
+  char magic[4] = {};
+  in.bytes(magic, sizeof(magic));
+  if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || in.u32() != VERSION) return;
+
+  std::map<std::string, Entry> entries;
+  const uint32_t count = in.u32();
+  for (uint32_t i = 0; i < count && in.ok(); i++) {
+    const std::string corePath = in.str();
+    Entry & entry = entries[corePath];
+    entry.mtime = (int64_t)in.u64();
+    entry.size = in.u64();
+    entry.meta.libraryName = in.str();
+    entry.meta.libraryVersion = in.str();
+    entry.meta.validExtensions = in.str();
+
+    const uint32_t flags = in.u32();
+    entry.meta.needFullpath = (flags & NEED_FULLPATH) != 0;
+    entry.meta.blockExtract = (flags & BLOCK_EXTRACT) != 0;
+    entry.meta.supportsNoGame = (flags & SUPPORTS_NO_GAME) != 0;
+
+    const uint32_t settings = in.u32();
+    for (uint32_t s = 0; s < settings && in.ok(); s++) {
+      SettingsEntryDesc desc;
+      desc.key = in.str();
+      desc.name = in.str();
+      const uint32_t choices = in.u32();
+      for (uint32_t c = 0; c < choices && in.ok(); c++) desc.choices.push_back(in.str());
+      entry.meta.settingsDesc.push_back(std::move(desc));
+    }
+  }
+
+  if (in.ok()) entries_ = std::move(entries);
+}
+
+bool CoreInfoCache::save(std::string & error)
+{
+  std::vector<uint8_t> data;
+  Writer out(data);
+  out.bytes(MAGIC, sizeof(MAGIC));
+  out.u32(VERSION);
+  out.u32((uint32_t)entries_.size());
+
+  for (const auto & it : entries_) {
+    const Entry & entry = it.second;
+    out.str(it.first);
+    out.u64((uint64_t)entry.mtime);
+    out.u64(entry.size);
+    out.str(entry.meta.libraryName);
+    out.str(entry.meta.libraryVersion);
+    out.str(entry.meta.validExtensions);
+    out.u32((entry.meta.needFullpath ? NEED_FULLPATH : 0) | (entry.meta.blockExtract ? BLOCK_EXTRACT : 0) |
+      (entry.meta.supportsNoGame ? SUPPORTS_NO_GAME : 0));
+
+    out.u32((uint32_t)entry.meta.settingsDesc.size());
+    for (const auto & desc : entry.meta.settingsDesc) {
+      out.str(desc.key);
+      out.str(desc.name);
+      out.u32((uint32_t)desc.choices.size());
+      for (const auto & choice : desc.choices) out.str(choice);
+    }
+  }
+
+  if (!fileWriteAtomic(path_, { { data.data(), data.size() } }, false)) {
+    error = "Cannot write " + path_;
+    return false;
+  }
+  return true;
+}
+
+const CoreMetadata * CoreInfoCache::find(const std::string & corePath, int64_t mtime, uint64_t size) const
+{
+  const auto it = entries_.find(corePath);
+  if (it == entries_.end() || it->second.mtime != mtime || it->second.size != size) return nullptr;
+  return &it->second.meta;
+}
+
+void CoreInfoCache::put(const std::string & corePath, int64_t mtime, uint64_t size, const CoreMetadata & meta)
+{
+  Entry & entry = entries_[corePath];
+  entry.mtime = mtime;
+  entry.size = size;
+  entry.meta = meta;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// CORE METADATA
+//--------------------------------------------------------------------------------------------------
+
+struct SettingsEntryDesc
+{
+  std::string key;
+  std::string name; // Human readable
+  std::vector<std::string> choices;
+};
+
+typedef std::vector<SettingsEntryDesc> SettingsDesc;
+
+// What a core announces before retro_init: retro_get_system_info and the options it sets from
+// retro_set_environment
+struct CoreMetadata
+{
+  std::string libraryName;
+  std::string libraryVersion;
+  std::string validExtensions; // '|' separated
+  bool needFullpath = false;
+  bool blockExtract = false;
+  bool supportsNoGame = false;
+  SettingsDesc settingsDesc;
+};
+
+// Metadata of every probed core, keyed by library path and invalidated when the library's mtime
+// or size changes. The whole cache is one small file, read at startup instead of opening each core.
+class CoreInfoCache
+{
+public:
+  // A missing or corrupted file just starts an empty cache
+  void load(const std::string & path);
+  bool save(std::string & error);
+
+  bool enabled() const { return !path_.empty(); }
+
+  // @return nullptr if the core is not cached or changed since
+  const CoreMetadata * find(const std::string & corePath, int64_t mtime, uint64_t size) const;
+  void put(const std::string & corePath, int64_t mtime, uint64_t size, const CoreMetadata & meta);
+
+private:
+  struct Entry
+  {
+    int64_t mtime;
+    uint64_t size;
+    CoreMetadata meta;
+  };
+
+  std::string path_;
+  std::map<std::string, Entry> entries_;
+};
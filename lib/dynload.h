@@ -6,10 +6,15 @@
   #include <Windows.h>
   typedef HMODULE dynlib_t;
 
-  inline dynlib_t dynLibOpen(const std::string & path) {
+  // Imports are always resolved at load time on Windows, `eager` and `deepBind` are ignored
+  inline dynlib_t dynLibOpen(const std::string & path, bool eager = false, bool deepBind = false) {
     return LoadLibrary(path.c_str());
   }
 
+  inline std::string dynLibError() {
+    return "error " + std::to_string(GetLastError());
+  }
+
   inline void dynLibClose(dynlib_t lib) {
     FreeLibrary(lib);
   }
@@ -21,8 +26,19 @@
   #include <dlfcn.h>
   typedef void * dynlib_t;
 
-  inline dynlib_t dynLibOpen(const std::string & path) {
-    return dlopen(path.c_str(), RTLD_LAZY);
+  // @param eager Resolves every symbol now rather than on first call
+  // @param deepBind Prefers the library's own symbols over already loaded ones (glibc only)
+  inline dynlib_t dynLibOpen(const std::string & path, bool eager = false, bool deepBind = false) {
+    int flags = eager ? RTLD_NOW : RTLD_LAZY;
+#ifdef RTLD_DEEPBIND
+    if (deepBind) flags |= RTLD_DEEPBIND;
+#endif
+    return dlopen(path.c_str(), flags);
+  }
+
+  inline std::string dynLibError() {
+    const char * error = dlerror();
+    return error ? error : "";
   }
 
   inline void dynLibClose(dynlib_t lib) {
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <cstdio>
+#include <initializer_list>
+#include <string>
+#include <utility>
+
+#if WIN32
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+  #endif
+  #include <Windows.h>
+  #include <io.h>
+  #include <process.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+
+// Read-only mapping of a whole file
+class MappedFile
+{
+public:
+  MappedFile() {}
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
+
+  const uint8_t * data() const { return data_; }
+  size_t size() const { return size_; }
+
+#if WIN32
+  bool open(const std::string & path)
+  {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(file, &sz) || sz.QuadPart == 0) {
+      CloseHandle(file);
+      return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return false;
+
+    data_ = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data_) return false;
+    size_ = (size_t)sz.QuadPart;
+    return true;
+  }
+
+  void close()
+  {
+    if (data_) UnmapViewOfFile(data_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  void adviseSequential() const {}
+#else
+  bool open(const std::string & path)
+  {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+
+    void * p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+
+    data_ = (const uint8_t *)p;
+    size_ = (size_t)st.st_size;
+    return true;
+  }
+
+  void close()
+  {
+    if (data_) munmap((void *)data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  // Read-ahead hint for a single front-to-back pass
+  void adviseSequential() const
+  {
+    if (data_) madvise((void *)data_, size_, MADV_SEQUENTIAL);
+  }
+#endif
+
+private:
+  const uint8_t * data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Writes the concatenation of `parts` to a temporary file then renames it over `path`, so that
+// readers only ever see the old or the new content. Concurrent writes to the same path (an SRAM
+// autosave and a state save, say) each use their own temporary file, the last rename wins.
+// @param sync Flush to the storage device before renaming
+inline bool fileWriteAtomic(const std::string & path, std::initializer_list<std::pair<const void *, size_t>> parts, bool sync)
+{
+  static std::atomic<unsigned> counter(0);
+#if WIN32
+  const int pid = _getpid();
+#else
+  const int pid = (int)getpid();
+#endif
+  const std::string tmpPath = path + "." + std::to_string(pid) + "." + std::to_string(counter++) + ".tmp";
+  FILE * f = fopen(tmpPath.c_str(), "wb");
+  if (!f) return false;
+
+  bool ok = true;
+  for (const auto & part : parts) {
+    if (part.second && fwrite(part.first, 1, part.second, f) != part.second) ok = false;
+  }
+  ok = (fflush(f) == 0) && ok;
+#if WIN32
+  if (ok && sync) ok = (_commit(_fileno(f)) == 0);
+#else
+  if (ok && sync) ok = (fsync(fileno(f)) == 0);
+#endif
+  ok = (fclose(f) == 0) && ok;
+
+#if WIN32
+  ok = ok && MoveFileExA(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+  ok = ok && (rename(tmpPath.c_str(), path.c_str()) == 0);
+#endif
+  if (!ok) std::remove(tmpPath.c_str());
+  return ok;
+}
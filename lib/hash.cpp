@@ -0,0 +1,360 @@
+#include "hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || ((defined(__i386__) || defined(_M_IX86)) && (defined(__SSE2__) || _M_IX86_FP >= 2))
+  #define HASH_PCLMUL 1
+  #include <emmintrin.h>
+  #include <wmmintrin.h>
+  #if !defined(_MSC_VER)
+    #include <cpuid.h>
+  #endif
+#endif
+
+
+namespace
+{
+
+  // Slicing-by-8: entries[k][b] is the CRC of byte b followed by k zero bytes, so eight table
+  // lookups fold eight input bytes at once
+  struct Crc32Table
+  {
+    Crc32Table()
+    {
+      for (uint32_t i=0; i<256; i++) {
+        uint32_t c = i;
+        for (int k=0; k<8; k++) {
+          c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+        }
+        entries[0][i] = c;
+      }
+      for (uint32_t i=0; i<256; i++) {
+        for (int k=1; k<8; k++) {
+          entries[k][i] = entries[0][entries[k - 1][i] & 0xFF] ^ (entries[k - 1][i] >> 8);
+        }
+      }
+    }
+
+    uint32_t entries[8][256];
+  };
+
+  const Crc32Table gCrc32Table;
+
+  // @param crc Inverted running CRC
+  uint32_t crc32Slicing(uint32_t crc, const uint8_t * p, size_t size)
+  {
+    const auto & t = gCrc32Table.entries;
+    for (; size && ((uintptr_t)p & 7); size--) {
+      crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    for (; size >= 8; size -= 8, p += 8) {
+      uint32_t lo, hi;
+      memcpy(&lo, p, 4);
+      memcpy(&hi, p + 4, 4);
+      lo ^= crc; // Little-endian only, like the rest of the state handling
+      crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+            t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    while (size--) {
+      crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+  }
+
+#if HASH_PCLMUL
+  bool hasPclmul()
+  {
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 1);
+    return (regs[2] & (1 << 1)) != 0;
+#else
+    unsigned eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_PCLMUL);
+#endif
+  }
+
+  const bool gHasPclmul = hasPclmul();
+
+  // Folds 64 bytes per iteration with carry-less multiplications, then reduces with Barrett
+  // (Intel, "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ"; constants from the
+  // Linux kernel crc32-pclmul)
+  // @param crc Inverted running CRC
+  // @param size Multiple of 16, at least 64
+#if !defined(_MSC_VER)
+  __attribute__((target("pclmul,sse2")))
+#endif
+  uint32_t crc32Pclmul(uint32_t crc, const uint8_t * p, size_t size)
+  {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596ll, 0x0154442bd4ll);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009ell, 0x01751997d0ll);
+    const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124ll);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641ll, 0x01db710641ll);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+    __m128i x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+    __m128i x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+    __m128i x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    p += 64;
+    size -= 64;
+
+    // Four independent lanes hide the multiplier latency
+    while (size >= 64) {
+      const __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+      const __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+      const __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+      const __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(p + 0x00)));
+      x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(p + 0x10)));
+      x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(p + 0x20)));
+      x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(p + 0x30)));
+      p += 64;
+      size -= 64;
+    }
+
+    // Four lanes into one, then the remaining 16-byte blocks
+    const __m128i lanes[3] = { x2, x3, x4 };
+    for (const __m128i & lane : lanes) {
+      const __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, lane), x5);
+    }
+    for (; size >= 16; p += 16, size -= 16) {
+      const __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)p)), x5);
+    }
+
+    // 128 to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+  }
+#endif
+
+  const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ull;
+  const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+  const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ull;
+  const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+  const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+  inline uint32_t rotl32(uint32_t x, int r)
+  {
+    return (x << r) | (x >> (32 - r));
+  }
+
+  inline uint64_t rotl64(uint64_t x, int r)
+  {
+    return (x << r) | (x >> (64 - r));
+  }
+
+  inline uint64_t read64(const uint8_t * p)
+  {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  inline uint32_t read32(const uint8_t * p)
+  {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  inline uint64_t xxhRound(uint64_t acc, uint64_t input)
+  {
+    acc += input * XXH_PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+  }
+
+  inline uint64_t xxhMerge(uint64_t acc, uint64_t val)
+  {
+    acc ^= xxhRound(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+  }
+
+} // anonymous namespace
+
+uint32_t crc32(uint32_t crc, const void * data, size_t size)
+{
+  const uint8_t * p = (const uint8_t *)data;
+  crc = ~crc;
+#if HASH_PCLMUL
+  if (gHasPclmul && size >= 64) {
+    const size_t folded = size & ~(size_t)15;
+    crc = crc32Pclmul(crc, p, folded);
+    p += folded;
+    size -= folded;
+  }
+#endif
+  return ~crc32Slicing(crc, p, size);
+}
+
+uint64_t xxhash64(const void * data, size_t size, uint64_t seed)
+{
+  const uint8_t * p = (const uint8_t *)data;
+  const uint8_t * const end = p + size;
+  uint64_t h;
+
+  if (size >= 32) {
+    // Four independent lanes keep the multipliers busy, this is where the time goes
+    uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    uint64_t v2 = seed + XXH_PRIME64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - XXH_PRIME64_1;
+    const uint8_t * const limit = end - 32;
+    do {
+      v1 = xxhRound(v1, read64(p));
+      v2 = xxhRound(v2, read64(p + 8));
+      v3 = xxhRound(v3, read64(p + 16));
+      v4 = xxhRound(v4, read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = xxhMerge(h, v1);
+    h = xxhMerge(h, v2);
+    h = xxhMerge(h, v3);
+    h = xxhMerge(h, v4);
+  }
+  else {
+    h = seed + XXH_PRIME64_5;
+  }
+
+  h += (uint64_t)size;
+
+  while (p + 8 <= end) {
+    h ^= xxhRound(0, read64(p));
+    h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    p += 8;
+  }
+  if (p + 4 <= end) {
+    h ^= (uint64_t)read32(p) * XXH_PRIME64_1;
+    h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+    p += 4;
+  }
+  while (p < end) {
+    h ^= (*p++) * XXH_PRIME64_5;
+    h = rotl64(h, 11) * XXH_PRIME64_1;
+  }
+
+  h ^= h >> 33;
+  h *= XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= XXH_PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+Sha1::Sha1()
+{
+  h_[0] = 0x67452301;
+  h_[1] = 0xEFCDAB89;
+  h_[2] = 0x98BADCFE;
+  h_[3] = 0x10325476;
+  h_[4] = 0xC3D2E1F0;
+}
+
+void Sha1::update(const void * data, size_t size)
+{
+  const uint8_t * p = (const uint8_t *)data;
+  length_ += size;
+
+  if (used_) {
+    const size_t n = std::min(size, sizeof(block_) - used_);
+    memcpy(block_ + used_, p, n);
+    used_ += n;
+    p += n;
+    size -= n;
+    if (used_ < sizeof(block_)) return;
+    transform(block_);
+    used_ = 0;
+  }
+
+  // Whole blocks straight from the input
+  for (; size >= 64; p += 64, size -= 64) transform(p);
+
+  memcpy(block_, p, size);
+  used_ = size;
+}
+
+void Sha1::final(uint8_t digest[20])
+{
+  const uint64_t bits = length_ * 8;
+  const uint8_t pad = 0x80;
+  const uint8_t zero[64] = {};
+  update(&pad, 1);
+  update(zero, (used_ <= 56 ? 56 : 120) - used_);
+
+  uint8_t tail[8];
+  for (int i = 0; i < 8; i++) tail[i] = (uint8_t)(bits >> (56 - 8 * i));
+  update(tail, 8);
+
+  for (int i = 0; i < 5; i++) {
+    digest[4 * i + 0] = (uint8_t)(h_[i] >> 24);
+    digest[4 * i + 1] = (uint8_t)(h_[i] >> 16);
+    digest[4 * i + 2] = (uint8_t)(h_[i] >> 8);
+    digest[4 * i + 3] = (uint8_t)h_[i];
+  }
+}
+
+void Sha1::transform(const uint8_t * block)
+{
+  uint32_t w[80];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) |
+           ((uint32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+  }
+  for (int i = 16; i < 80; i++) w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+  uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4];
+  for (int i = 0; i < 80; i++) {
+    uint32_t f, k;
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+    const uint32_t t = rotl32(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = rotl32(b, 30);
+    b = a;
+    a = t;
+  }
+
+  h_[0] += a;
+  h_[1] += b;
+  h_[2] += c;
+  h_[3] += d;
+  h_[4] += e;
+}
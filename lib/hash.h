@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// CHECKSUMS
+//--------------------------------------------------------------------------------------------------
+
+// CRC-32 as used by zip/zlib, start with crc = 0 and chain calls to hash data in pieces
+// @note Folds with PCLMULQDQ when the CPU has it, slicing-by-8 otherwise
+uint32_t crc32(uint32_t crc, const void * data, size_t size);
+
+// XXH64, a fast non-cryptographic 64-bit hash; chain calls by passing the previous hash as seed
+uint64_t xxhash64(const void * data, size_t size, uint64_t seed);
+
+// SHA-1, for matching content against No-Intro/Redump style databases
+class Sha1
+{
+public:
+  Sha1();
+
+  void update(const void * data, size_t size);
+  void final(uint8_t digest[20]);
+
+private:
+  void transform(const uint8_t * block);
+
+  uint32_t h_[5];
+  uint64_t length_ = 0;
+  uint8_t block_[64];
+  size_t used_ = 0;
+};
@@ -0,0 +1,72 @@
+#include "inputqueue.h"
+
+#include <algorithm>
+
+
+void InputQueue::push(const InputEvent * events, size_t count)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  insert_(byFrame_, events, count);
+}
+
+void InputQueue::pushTimed(const InputEvent * events, size_t count)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  insert_(byTime_, events, count);
+}
+
+void InputQueue::drain(int64_t frame, int64_t nowUs, int64_t framePeriodUs, const std::function<void(const InputEvent &)> & apply)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  size_t n = 0;
+  for (; n < byFrame_.size() && byFrame_[n].target <= frame; n++) {
+    const InputEvent & ev = byFrame_[n];
+    if (ev.target < frame) {
+      stats_.late++;
+      stats_.lateFramesTotal += frame - ev.target;
+      stats_.lateFramesMax = std::max(stats_.lateFramesMax, frame - ev.target);
+    }
+    apply(ev);
+  }
+  byFrame_.erase(byFrame_.begin(), byFrame_.begin() + n);
+  stats_.applied += n;
+
+  size_t t = 0;
+  for (; t < byTime_.size() && byTime_[t].target <= nowUs; t++) {
+    const InputEvent & ev = byTime_[t];
+    const int64_t lateUs = nowUs - ev.target;
+    if (lateUs > framePeriodUs) {
+      stats_.late++;
+      stats_.lateUsMax = std::max(stats_.lateUsMax, lateUs);
+    }
+    apply(ev);
+  }
+  byTime_.erase(byTime_.begin(), byTime_.begin() + t);
+  stats_.applied += t;
+}
+
+void InputQueue::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  byFrame_.clear();
+  byTime_.clear();
+}
+
+InputQueueStats InputQueue::stats()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  InputQueueStats res = stats_;
+  res.queued = byFrame_.size() + byTime_.size();
+  return res;
+}
+
+void InputQueue::insert_(std::vector<InputEvent> & queue, const InputEvent * events, size_t count)
+{
+  const auto byTarget = [](const InputEvent & a, const InputEvent & b) { return a.target < b.target; };
+  for (size_t i=0; i<count; i++) {
+    // Events mostly arrive in order, so this is usually an append
+    const auto pos = std::upper_bound(queue.begin(), queue.end(), events[i], byTarget);
+    queue.insert(pos, events[i]);
+  }
+}
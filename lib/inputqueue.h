@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+
+// INPUT EVENT QUEUE
+//--------------------------------------------------------------------------------------------------
+
+struct InputEvent
+{
+  int64_t target;  // Frame number, or steady clock time in microseconds for timed events
+  uint32_t port;
+  uint32_t field;  // InputField
+  uint32_t id;     // Button for INPUT_BUTTONS, unused otherwise
+  int32_t value;
+};
+
+struct InputQueueStats
+{
+  size_t queued = 0;  // Waiting for their frame
+  size_t applied = 0;
+  size_t late = 0;    // Applied after the frame they targeted
+  int64_t lateFramesMax = 0;
+  int64_t lateFramesTotal = 0;
+  int64_t lateUsMax = 0;
+};
+
+// Input events waiting for the frame they target. Events can be pushed from any thread and are
+// applied, in target order, when the emulation polls input for that frame.
+class InputQueue
+{
+public:
+  // Frame-tagged events
+  void push(const InputEvent * events, size_t count);
+
+  // Time-tagged events, late when applied more than one frame period after their time
+  void pushTimed(const InputEvent * events, size_t count);
+
+  // Applies every event targeting `frame` or earlier, and timed events up to `nowUs`
+  void drain(int64_t frame, int64_t nowUs, int64_t framePeriodUs, const std::function<void(const InputEvent &)> & apply);
+
+  void clear();
+  InputQueueStats stats();
+
+private:
+  static void insert_(std::vector<InputEvent> & queue, const InputEvent * events, size_t count);
+
+  std::mutex mutex_;
+  std::vector<InputEvent> byFrame_; // Sorted by target, arrival order kept for equal targets
+  std::vector<InputEvent> byTime_;
+  InputQueueStats stats_;
+};
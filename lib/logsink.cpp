@@ -0,0 +1,352 @@
+#include "logsink.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+
+namespace
+{
+
+  const size_t SLOT_COUNT = 4096; // Power of two
+  const size_t TEXT_SIZE = 240;
+  const size_t SITE_COUNT = 1024;
+  const size_t SITE_PROBES = 8;
+  const std::chrono::milliseconds DRAIN_INTERVAL(20);
+
+  const char * const LEVEL_NAMES[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+  // Bounded MPMC ring (Vyukov): `seq` tells whether the slot is free for the writer at that
+  // position or holds a message for the reader
+  struct Slot
+  {
+    std::atomic<size_t> seq;
+    LogLevel level;
+    double timeMs;
+    char text[TEXT_SIZE];
+  };
+
+  struct Site
+  {
+    std::atomic<const char *> fmt;
+    std::atomic<int64_t> second;
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> suppressed;
+  };
+
+  class LogSink
+  {
+  public:
+    LogSink()
+      : slots_(new Slot[SLOT_COUNT]), sites_(new Site[SITE_COUNT])
+    {
+      for (size_t i = 0; i < SLOT_COUNT; i++) slots_[i].seq.store(i, std::memory_order_relaxed);
+      for (size_t i = 0; i < SITE_COUNT; i++) {
+        sites_[i].fmt.store(nullptr, std::memory_order_relaxed);
+        sites_[i].second.store(-1, std::memory_order_relaxed);
+        sites_[i].count.store(0, std::memory_order_relaxed);
+        sites_[i].suppressed.store(0, std::memory_order_relaxed);
+      }
+      worker_ = std::thread(&LogSink::run, this);
+    }
+
+    // Drains the ring and stops the helper thread. Later messages (cores logging from retro_deinit
+    // when static instances go away) are written to the file synchronously.
+    void shutdown()
+    {
+      {
+        // What is left goes to the file, the callback's owner may already be gone
+        std::lock_guard<std::mutex> lock(sinkMutex_);
+        callback_ = nullptr;
+      }
+      stopped_ = true;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+      }
+      cv_.notify_all();
+      worker_.join();
+    }
+
+    void write(LogLevel level, const char * fmt, va_list args)
+    {
+      if ((int)level < level_.load(std::memory_order_relaxed)) {
+        filtered_++;
+        return;
+      }
+      if (stopped_.load(std::memory_order_acquire)) {
+        writeDirect(level, fmt, args);
+        return;
+      }
+
+      const auto now = std::chrono::system_clock::now().time_since_epoch();
+      const double timeMs = std::chrono::duration<double, std::milli>(now).count();
+      const int64_t second = std::chrono::duration_cast<std::chrono::seconds>(now).count();
+
+      uint32_t lost = 0;
+      if (!admit(fmt, second, lost)) {
+        suppressed_++;
+        return;
+      }
+      if (lost) push(level, timeMs, "(%u similar messages suppressed)", lost);
+      pushV(level, timeMs, fmt, args);
+    }
+
+    void setLevel(LogLevel level) { level_ = (int)level; }
+    void setRateLimit(size_t perSecond) { rateLimit_ = perSecond; }
+
+    bool setFile(const std::string & path)
+    {
+      FILE * file = stdout;
+      if (!path.empty()) {
+        file = fopen(path.c_str(), "a");
+        if (!file) return false;
+      }
+
+      std::lock_guard<std::mutex> lock(sinkMutex_);
+      if (file_ != stdout) fclose(file_);
+      file_ = file;
+      return true;
+    }
+
+    void setCallback(std::function<void(std::vector<LogEntry> &)> callback)
+    {
+      std::lock_guard<std::mutex> lock(sinkMutex_);
+      callback_ = std::move(callback);
+    }
+
+    void flush()
+    {
+      if (stopped_) return;
+      const size_t target = enqueuePos_.load();
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.notify_all();
+      flushed_.wait(lock, [&] { return delivered_ >= target; });
+    }
+
+    LogStats stats() const
+    {
+      LogStats stats;
+      stats.written = written_;
+      stats.dropped = dropped_;
+      stats.suppressed = suppressed_;
+      stats.filtered = filtered_;
+      return stats;
+    }
+
+  private:
+    // Fixed one-second windows per site, approximate under contention which is fine for logs
+    bool admit(const char * fmt, int64_t second, uint32_t & lost)
+    {
+      const size_t limit = rateLimit_.load(std::memory_order_relaxed);
+      if (!limit) return true;
+
+      const size_t hash = (size_t)(((uintptr_t)fmt * 0x9E3779B97F4A7C15ull) >> 32);
+      for (size_t probe = 0; probe < SITE_PROBES; probe++) {
+        Site & site = sites_[(hash + probe) % SITE_COUNT];
+        const char * current = site.fmt.load(std::memory_order_acquire);
+        if (!current && site.fmt.compare_exchange_strong(current, fmt)) current = fmt;
+        if (current != fmt) continue;
+
+        int64_t window = site.second.load(std::memory_order_relaxed);
+        if (window != second && site.second.compare_exchange_strong(window, second)) {
+          site.count.store(0, std::memory_order_relaxed);
+          lost = site.suppressed.exchange(0);
+        }
+        if (site.count.fetch_add(1, std::memory_order_relaxed) < limit) return true;
+        site.suppressed++;
+        return false;
+      }
+      return true; // Too many sites, not limited
+    }
+
+    void push(LogLevel level, double timeMs, const char * fmt, ...)
+    {
+      va_list args;
+      va_start(args, fmt);
+      pushV(level, timeMs, fmt, args);
+      va_end(args);
+    }
+
+    void pushV(LogLevel level, double timeMs, const char * fmt, va_list args)
+    {
+      size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+      Slot * slot;
+      for (;;) {
+        slot = &slots_[pos & (SLOT_COUNT - 1)];
+        const size_t seq = slot->seq.load(std::memory_order_acquire);
+        const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+          if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        }
+        else if (diff < 0) {
+          dropped_++;
+          return;
+        }
+        else {
+          pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+      }
+
+      slot->level = level;
+      slot->timeMs = timeMs;
+      const int n = vsnprintf(slot->text, TEXT_SIZE, fmt, args);
+      if (n < 0) {
+        slot->text[0] = 0;
+      }
+      else if ((size_t)n >= TEXT_SIZE) {
+        memcpy(slot->text + TEXT_SIZE - 4, "...", 4);
+      }
+      slot->seq.store(pos + 1, std::memory_order_release);
+      written_++;
+    }
+
+    // @note Only called from the helper thread
+    void drain(std::vector<LogEntry> & batch)
+    {
+      for (;;) {
+        Slot & slot = slots_[dequeuePos_ & (SLOT_COUNT - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != dequeuePos_ + 1) return;
+
+        size_t length = strlen(slot.text);
+        while (length && (slot.text[length - 1] == '\n' || slot.text[length - 1] == '\r')) length--;
+        batch.push_back(LogEntry { slot.level, slot.timeMs, std::string(slot.text, length) });
+
+        slot.seq.store(dequeuePos_ + SLOT_COUNT, std::memory_order_release);
+        dequeuePos_++;
+      }
+    }
+
+    void deliver(std::vector<LogEntry> & batch)
+    {
+      std::lock_guard<std::mutex> lock(sinkMutex_);
+      if (callback_) {
+        callback_(batch);
+        return;
+      }
+
+      for (const auto & entry : batch) {
+        fprintf(file_, "[%s] %s\n", LEVEL_NAMES[std::min((int)entry.level, (int)LOG_ERROR)], entry.text.c_str());
+      }
+      fflush(file_);
+    }
+
+    void writeDirect(LogLevel level, const char * fmt, va_list args)
+    {
+      char text[TEXT_SIZE];
+      vsnprintf(text, sizeof(text), fmt, args);
+      size_t length = strlen(text);
+      while (length && (text[length - 1] == '\n' || text[length - 1] == '\r')) text[--length] = 0;
+
+      std::lock_guard<std::mutex> lock(sinkMutex_);
+      fprintf(file_, "[%s] %s\n", LEVEL_NAMES[std::min((int)level, (int)LOG_ERROR)], text);
+      fflush(file_);
+      written_++;
+    }
+
+    void run()
+    {
+      std::vector<LogEntry> batch;
+      std::unique_lock<std::mutex> lock(mutex_);
+      for (;;) {
+        const bool quit = quit_;
+        lock.unlock();
+        batch.clear();
+        drain(batch);
+        if (!batch.empty()) deliver(batch);
+        lock.lock();
+
+        delivered_ = dequeuePos_;
+        flushed_.notify_all();
+        if (quit) return;
+        if (batch.empty()) cv_.wait_for(lock, DRAIN_INTERVAL);
+      }
+    }
+
+    std::unique_ptr<Slot[]> slots_;
+    std::unique_ptr<Site[]> sites_;
+    std::atomic<size_t> enqueuePos_ { 0 };
+    size_t dequeuePos_ = 0;
+
+    std::atomic<bool> stopped_ { false };
+    std::atomic<int> level_ { LOG_INFO };
+    std::atomic<size_t> rateLimit_ { 50 };
+
+    std::atomic<size_t> written_ { 0 };
+    std::atomic<size_t> dropped_ { 0 };
+    std::atomic<size_t> suppressed_ { 0 };
+    std::atomic<size_t> filtered_ { 0 };
+
+    std::mutex sinkMutex_;
+    FILE * file_ = stdout;
+    std::function<void(std::vector<LogEntry> &)> callback_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable flushed_;
+    size_t delivered_ = 0;
+    bool quit_ = false;
+    std::thread worker_;
+  };
+
+  // Created on first use, so that logging works from other static initializers, and never
+  // destroyed, so that it also works from static destructors (instances calling retro_deinit)
+  LogSink & sink()
+  {
+    static LogSink & instance = *new LogSink;
+    static const int stopAtExit = atexit([] { sink().shutdown(); });
+    (void)stopAtExit;
+    return instance;
+  }
+
+} // anonymous namespace
+
+void logWrite(LogLevel level, const char * fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  sink().write(level, fmt, args);
+  va_end(args);
+}
+
+void logWriteV(LogLevel level, const char * fmt, va_list args)
+{
+  sink().write(level, fmt, args);
+}
+
+void logSetLevel(LogLevel level)
+{
+  sink().setLevel(level);
+}
+
+void logSetRateLimit(size_t perSecond)
+{
+  sink().setRateLimit(perSecond);
+}
+
+bool logSetFile(const std::string & path)
+{
+  return sink().setFile(path);
+}
+
+void logSetCallback(std::function<void(std::vector<LogEntry> & batch)> callback)
+{
+  sink().setCallback(std::move(callback));
+}
+
+void logFlush()
+{
+  sink().flush();
+}
+
+LogStats logStats()
+{
+  return sink().stats();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <cstdarg>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+// LOG SINK
+//--------------------------------------------------------------------------------------------------
+
+// Messages are formatted straight into the preallocated slots of a lock-free ring, and a helper
+// thread drains them in batches to stdout, a file or a callback. Writers never block nor allocate:
+// when the ring is full the message is dropped and counted.
+//
+// Each format string is a message site: a site logging more than the rate limit within a second
+// is suppressed until the next second, which then reports how many messages were lost.
+
+// Same values as retro_log_level
+enum LogLevel
+{
+  LOG_DEBUG = 0,
+  LOG_INFO,
+  LOG_WARN,
+  LOG_ERROR,
+  LOG_NONE, // Filters everything out
+};
+
+struct LogEntry
+{
+  LogLevel level;
+  double timeMs; // Since the epoch
+  std::string text;
+};
+
+struct LogStats
+{
+  size_t written = 0;
+  size_t dropped = 0; // Ring full
+  size_t suppressed = 0; // Rate limited
+  size_t filtered = 0; // Below the level
+};
+
+// @note Messages longer than a slot (about 240 bytes) are truncated
+void logWrite(LogLevel level, const char * fmt, ...);
+void logWriteV(LogLevel level, const char * fmt, va_list args);
+
+// LOG_INFO by default
+void logSetLevel(LogLevel level);
+
+// Messages per second and per site, 0 for no limit (the default is 50)
+void logSetRateLimit(size_t perSecond);
+
+// @param path Appended to, empty for stdout (the default)
+bool logSetFile(const std::string & path);
+
+// Batches go to `callback`, on the helper thread, instead of the file; null restores the file
+void logSetCallback(std::function<void(std::vector<LogEntry> & batch)> callback);
+
+// Waits until everything written so far has been handed to the sink
+void logFlush();
+
+LogStats logStats();
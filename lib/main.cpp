@@ -1,6 +1,17 @@
 #include <nan.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <mutex>
+
 #include "core.h"
+#include "logsink.h"
+#include "retro.h"
+#include "romdb.h"
+#include "statefile.h"
 
 using v8::FunctionTemplate;
 using v8::Handle;
@@ -11,9 +22,109 @@ using Nan::GetFunction;
 using Nan::New;
 using Nan::Set;
 
+// @throws Error with `missing_symbols` when the library is not a complete libretro core
 NAN_METHOD(nodeCoreInit) {
   const String::Utf8Value corePath(info[0]->ToString());
-  coreInit(*corePath);
+
+  CoreLoadError error;
+  if (coreInit(*corePath, error)) return;
+
+  auto missing = Nan::New<v8::Array>((int)error.missingSymbols.size());
+  for (size_t i=0; i<error.missingSymbols.size(); i++) {
+    missing->Set(i, Nan::New(error.missingSymbols[i]).ToLocalChecked());
+  }
+  auto exception = Nan::Error(error.message.c_str()).As<Object>();
+  exception->Set(Nan::New("missing_symbols").ToLocalChecked(), missing);
+  v8::Isolate::GetCurrent()->ThrowException(exception);
+}
+
+// @arg eager, deepBind
+NAN_METHOD(nodeCoreSetBindingMode) {
+  coreSetBindingMode(info[0]->BooleanValue(), info[1]->BooleanValue());
+}
+
+NAN_METHOD(nodeCoreCapabilities) {
+  const auto caps = coreCapabilities();
+
+  auto missing = Nan::New<v8::Array>((int)caps.missingSymbols.size());
+  for (size_t i=0; i<caps.missingSymbols.size(); i++) {
+    missing->Set(i, Nan::New(caps.missingSymbols[i]).ToLocalChecked());
+  }
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("api_version").ToLocalChecked(), Nan::New(caps.apiVersion));
+  obj->Set(Nan::New("controller_port_device").ToLocalChecked(), Nan::New(caps.controllerPortDevice));
+  obj->Set(Nan::New("reset").ToLocalChecked(), Nan::New(caps.reset));
+  obj->Set(Nan::New("cheats").ToLocalChecked(), Nan::New(caps.cheats));
+  obj->Set(Nan::New("load_game_special").ToLocalChecked(), Nan::New(caps.loadGameSpecial));
+  obj->Set(Nan::New("unload_game").ToLocalChecked(), Nan::New(caps.unloadGame));
+  obj->Set(Nan::New("region").ToLocalChecked(), Nan::New(caps.region));
+  obj->Set(Nan::New("memory").ToLocalChecked(), Nan::New(caps.memory));
+  obj->Set(Nan::New("missing_symbols").ToLocalChecked(), missing);
+
+  info.GetReturnValue().Set(obj);
+}
+
+NAN_METHOD(nodeCoreProbeCache) {
+  const String::Utf8Value path(info[0]->ToString());
+  coreProbeCache(*path);
+}
+
+// @return { library_name, library_version, valid_extensions, need_fullpath, block_extract,
+//           supports_no_game, settings: { key: { name, choices } } }
+NAN_METHOD(nodeCoreProbe) {
+  const String::Utf8Value corePath(info[0]->ToString());
+
+  CoreMetadata meta;
+  std::string error;
+  if (!coreProbe(*corePath, meta, error)) return Nan::ThrowError(error.c_str());
+
+  auto settings = Nan::New<Object>();
+  for (const auto & desc : meta.settingsDesc) {
+    auto choices = Nan::New<v8::Array>((int)desc.choices.size());
+    for (size_t i=0; i<desc.choices.size(); i++) {
+      choices->Set(i, Nan::New(desc.choices[i]).ToLocalChecked());
+    }
+
+    auto entry = Nan::New<Object>();
+    entry->Set(Nan::New("name").ToLocalChecked(), Nan::New(desc.name).ToLocalChecked());
+    entry->Set(Nan::New("choices").ToLocalChecked(), choices);
+    settings->Set(Nan::New(desc.key).ToLocalChecked(), entry);
+  }
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("library_name").ToLocalChecked(), Nan::New(meta.libraryName).ToLocalChecked());
+  obj->Set(Nan::New("library_version").ToLocalChecked(), Nan::New(meta.libraryVersion).ToLocalChecked());
+  obj->Set(Nan::New("valid_extensions").ToLocalChecked(), Nan::New(meta.validExtensions).ToLocalChecked());
+  obj->Set(Nan::New("need_fullpath").ToLocalChecked(), Nan::New(meta.needFullpath));
+  obj->Set(Nan::New("block_extract").ToLocalChecked(), Nan::New(meta.blockExtract));
+  obj->Set(Nan::New("supports_no_game").ToLocalChecked(), Nan::New(meta.supportsNoGame));
+  obj->Set(Nan::New("settings").ToLocalChecked(), settings);
+
+  info.GetReturnValue().Set(obj);
+}
+
+// @arg Core path, number of instances kept ready (0 to stop pooling it)
+NAN_METHOD(nodeCorePoolSetup) {
+  const String::Utf8Value corePath(info[0]->ToString());
+  corePoolSetup(*corePath, info[1]->Uint32Value());
+}
+
+NAN_METHOD(nodeCorePoolStats) {
+  const auto stats = corePoolStats();
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("ready").ToLocalChecked(), Nan::New((double)stats.ready));
+  obj->Set(Nan::New("warming").ToLocalChecked(), Nan::New((double)stats.warming));
+  obj->Set(Nan::New("hits").ToLocalChecked(), Nan::New((double)stats.hits));
+  obj->Set(Nan::New("misses").ToLocalChecked(), Nan::New((double)stats.misses));
+  obj->Set(Nan::New("failures").ToLocalChecked(), Nan::New((double)stats.failures));
+  obj->Set(Nan::New("warmups").ToLocalChecked(), Nan::New((double)stats.warmups));
+  obj->Set(Nan::New("warm_avg_ms").ToLocalChecked(), Nan::New(stats.warmups ? stats.warmTotalMs / stats.warmups : 0.0));
+  obj->Set(Nan::New("warm_last_ms").ToLocalChecked(), Nan::New(stats.warmLastMs));
+  obj->Set(Nan::New("warm_max_ms").ToLocalChecked(), Nan::New(stats.warmMaxMs));
+
+  info.GetReturnValue().Set(obj);
 }
 
 NAN_METHOD(nodeCoreLoadGame) {
@@ -25,7 +136,101 @@ NAN_METHOD(nodeCoreUpdate) {
   coreUpdate();
 }
 
+NAN_METHOD(nodeCoreRunAhead) {
+  coreRunAhead(info[0]->Uint32Value(), info[1]->BooleanValue());
+}
+
+NAN_METHOD(nodeCoreRunAheadStats) {
+  const auto stats = coreRunAheadStats();
+  const double frames = stats.frames ? (double)stats.frames : 1.0;
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("frames").ToLocalChecked(), Nan::New((double)stats.frames));
+  obj->Set(Nan::New("resyncs").ToLocalChecked(), Nan::New((double)stats.resyncs));
+  obj->Set(Nan::New("serialize_size").ToLocalChecked(), Nan::New((double)stats.serializeSize));
+  obj->Set(Nan::New("serialize_us").ToLocalChecked(), Nan::New(stats.serializeUs / frames));
+  obj->Set(Nan::New("unserialize_us").ToLocalChecked(), Nan::New(stats.unserializeUs / frames));
+  obj->Set(Nan::New("speculative_us").ToLocalChecked(), Nan::New(stats.speculativeUs / frames));
+  obj->Set(Nan::New("frame_us").ToLocalChecked(), Nan::New(stats.totalUs / frames));
+  obj->Set(Nan::New("disabled").ToLocalChecked(), Nan::New(stats.disabled));
+
+  info.GetReturnValue().Set(obj);
+}
+
+// Per stage: { count, mean_us, p50_us, p90_us, p99_us, max_us }
+NAN_METHOD(nodeCoreStats) {
+  auto obj = Nan::New<Object>();
+  for (int i = 0; i < TIMING_STAGE_COUNT; i++) {
+    const TimingStage stage = (TimingStage)i;
+    const auto summary = coreFrameStats(stage);
+
+    auto stats = Nan::New<Object>();
+    stats->Set(Nan::New("count").ToLocalChecked(), Nan::New((double)summary.count));
+    stats->Set(Nan::New("mean_us").ToLocalChecked(), Nan::New(summary.meanUs));
+    stats->Set(Nan::New("p50_us").ToLocalChecked(), Nan::New(summary.p50Us));
+    stats->Set(Nan::New("p90_us").ToLocalChecked(), Nan::New(summary.p90Us));
+    stats->Set(Nan::New("p99_us").ToLocalChecked(), Nan::New(summary.p99Us));
+    stats->Set(Nan::New("max_us").ToLocalChecked(), Nan::New(summary.maxUs));
+    obj->Set(Nan::New(timingStageName(stage)).ToLocalChecked(), stats);
+  }
+
+  info.GetReturnValue().Set(obj);
+}
+
+NAN_METHOD(nodeCoreStatsReset) {
+  coreFrameStatsReset();
+}
+
+// Counters of the core's own perf interface: [{ ident, calls, total_us, mean_us }]
+NAN_METHOD(nodeCorePerfCounters) {
+  const auto counters = corePerfCounters();
+
+  auto res = Nan::New<v8::Array>((int)counters.size());
+  for (size_t i=0; i<counters.size(); i++) {
+    auto obj = Nan::New<Object>();
+    obj->Set(Nan::New("ident").ToLocalChecked(), Nan::New(counters[i].ident).ToLocalChecked());
+    obj->Set(Nan::New("calls").ToLocalChecked(), Nan::New((double)counters[i].calls));
+    obj->Set(Nan::New("total_us").ToLocalChecked(), Nan::New(counters[i].totalUs));
+    obj->Set(Nan::New("mean_us").ToLocalChecked(), Nan::New(counters[i].meanUs));
+    res->Set(i, obj);
+  }
+
+  info.GetReturnValue().Set(res);
+}
+
+NAN_METHOD(nodeCorePerfReset) {
+  corePerfReset();
+}
+
+NAN_METHOD(nodeCorePerfLog) {
+  corePerfLog();
+}
+
+NAN_METHOD(nodeCoreRewindSetup) {
+  coreRewindSetup(info[0]->Uint32Value(), info[1]->Uint32Value());
+}
+
+NAN_METHOD(nodeCoreRewind) {
+  info.GetReturnValue().Set(Nan::New((uint32_t)coreRewind(info[0]->Uint32Value())));
+}
+
+NAN_METHOD(nodeCoreRewindStats) {
+  const auto stats = coreRewindStats();
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("budget").ToLocalChecked(), Nan::New((double)stats.budget));
+  obj->Set(Nan::New("used").ToLocalChecked(), Nan::New((double)stats.used));
+  obj->Set(Nan::New("entries").ToLocalChecked(), Nan::New((double)stats.entries));
+  obj->Set(Nan::New("pushed").ToLocalChecked(), Nan::New((double)stats.pushed));
+  obj->Set(Nan::New("dropped").ToLocalChecked(), Nan::New((double)stats.dropped));
+  obj->Set(Nan::New("encode_us").ToLocalChecked(), Nan::New(stats.pushed ? stats.encodeUs / stats.pushed : 0.0));
+  obj->Set(Nan::New("ratio").ToLocalChecked(), Nan::New(stats.rawBytes ? (double)stats.encodedBytes / stats.rawBytes : 0.0));
+
+  info.GetReturnValue().Set(obj);
+}
+
 NAN_METHOD(nodeCoreVideoData) {
+  const uint64_t start = timingTicks();
   size_t width, height;
   const auto & videoBuf = coreVideoData(width, height);
 
@@ -39,6 +244,7 @@ NAN_METHOD(nodeCoreVideoData) {
   memcpy(*typedArray, &videoBuf[0], videoBuf.size() * 4);
 
   info.GetReturnValue().Set(obj);
+  coreFrameStatsAdd(TIMING_MARSHAL, timingTicks() - start);
 }
 
 NAN_METHOD(nodeCoreVideoSize) {
@@ -53,8 +259,10 @@ NAN_METHOD(nodeCoreVideoSize) {
 }
 
 NAN_METHOD(nodeCoreAudioData) {
+  const uint64_t start = timingTicks();
   const auto audioBuf = coreAudioData();
   info.GetReturnValue().Set(Nan::CopyBuffer((const char *)&audioBuf[0], audioBuf.size() * 2).ToLocalChecked());
+  coreFrameStatsAdd(TIMING_MARSHAL, timingTicks() - start);
 }
 
 NAN_METHOD(nodeCoreTimings) {
@@ -105,106 +313,998 @@ NAN_METHOD(nodeCoreSettingsSet)
 //
 //   args.GetReturnValue().Set(obj);
 // }
-//
-// void nodeCoreJoypadDesc(const FunctionCallbackInfo<Value> & args)
-// {
-//   Isolate* isolate = Isolate::GetCurrent();
-//   HandleScope scope(isolate);
-//
-//   if (args.Length() != 0) {
-//     isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Wrong number of arguments")));
-//     return;
-//   }
-//
-//   Local<Array> res = Array::New(isolate, coreJoypadDesc().size());
-//
-//   size_t i = 0;
-//   for (const auto & name : coreJoypadDesc()) {
-//     res->Set(i++, String::NewFromUtf8(isolate, name.c_str()));
-//   }
-//
-//   args.GetReturnValue().Set(res);
-// }
-//
-// void nodeCoreJoypadPress(const FunctionCallbackInfo<Value> & args)
-// {
-//   Isolate* isolate = Isolate::GetCurrent();
-//   HandleScope scope(isolate);
-//
-//   if (args.Length() != 1) {
-//     isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Wrong number of arguments")));
-//     return;
-//   }
-//
-//   v8::String::Utf8Value name(args[0]->ToString());
-//   coreJoypadPress(*name);
-// }
-//
-// void nodeCoreJoypadRelease(const FunctionCallbackInfo<Value> & args)
-// {
-//   Isolate* isolate = Isolate::GetCurrent();
-//   HandleScope scope(isolate);
-//
-//   if (args.Length() != 1) {
-//     isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Wrong number of arguments")));
-//     return;
-//   }
-//
-//   v8::String::Utf8Value name(args[0]->ToString());
-//   coreJoypadRelease(*name);
-// }
-//
-// // @return Buffer containing the saved state
-// void nodeCoreSaveState(const FunctionCallbackInfo<Value> & args)
-// {
-//   Isolate* isolate = Isolate::GetCurrent();
-//   HandleScope scope(isolate);
-//
-//   if (args.Length() != 0) {
-//     isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Wrong number of arguments")));
-//     return;
-//   }
-//
-//   const auto stateBuf = coreSaveState();
-//
-//   auto slowBuffer = Buffer::New(stateBuf.size());
-//   memcpy(Buffer::Data(slowBuffer), &stateBuf[0], stateBuf.size());
-//   args.GetReturnValue().Set(slowBuffer);
-// }
-//
-//
-// // @arg Buffer containing the state to restore
-// void nodeCoreRestoreState(const FunctionCallbackInfo<Value> & args)
-// {
-//   Isolate* isolate = Isolate::GetCurrent();
-//   HandleScope scope(isolate);
-//
-//   if (args.Length() != 1) {
-//     isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Wrong number of arguments")));
-//     return;
-//   }
-//
-//   Local<Object> bufferObj = args[0]->ToObject();
-//   char*  bufferData = Buffer::Data(bufferObj);
-//   size_t bufferLength = Buffer::Length(bufferObj);
-//   coreRestoreState(bufferData, bufferLength);
-// }
+
+NAN_METHOD(nodeCoreJoypadDesc) {
+  const auto names = coreJoypadDesc();
+
+  auto res = Nan::New<v8::Array>((int)names.size());
+  for (size_t i=0; i<names.size(); i++) {
+    res->Set(i, Nan::New(names[i]).ToLocalChecked());
+  }
+
+  info.GetReturnValue().Set(res);
+}
+
+NAN_METHOD(nodeCoreJoypadPress) {
+  const String::Utf8Value name(info[0]->ToString());
+  coreJoypadPress(*name);
+}
+
+NAN_METHOD(nodeCoreJoypadRelease) {
+  const String::Utf8Value name(info[0]->ToString());
+  coreJoypadRelease(*name);
+}
+
+// @arg Int32Array of INPUT_STRIDE values per port, for as many ports as it holds
+NAN_METHOD(nodeCoreInputSet) {
+  if (info.Length() < 1 || !info[0]->IsInt32Array()) return Nan::ThrowTypeError("Expected an Int32Array");
+
+  Nan::TypedArrayContents<int32_t> data(info[0]);
+  coreInputSet(*data, data.length() / INPUT_STRIDE);
+}
+
+// @arg Float64Array of [target, port, field, id, value] per event
+// @arg true if targets are coreTimeUs() times rather than frame numbers
+NAN_METHOD(nodeCoreInputQueuePush) {
+  if (info.Length() < 1 || !info[0]->IsFloat64Array()) return Nan::ThrowTypeError("Expected a Float64Array");
+
+  Nan::TypedArrayContents<double> data(info[0]);
+  const size_t count = data.length() / 5;
+  std::vector<InputEvent> events(count);
+  for (size_t i=0; i<count; i++) {
+    const double * src = *data + i * 5;
+    events[i] = InputEvent { (int64_t)src[0], (uint32_t)src[1], (uint32_t)src[2], (uint32_t)src[3], (int32_t)src[4] };
+  }
+  coreInputQueuePush(events.data(), events.size(), info[1]->BooleanValue());
+}
+
+NAN_METHOD(nodeCoreInputQueueStats) {
+  const auto stats = coreInputQueueStats();
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("queued").ToLocalChecked(), Nan::New((double)stats.queued));
+  obj->Set(Nan::New("applied").ToLocalChecked(), Nan::New((double)stats.applied));
+  obj->Set(Nan::New("late").ToLocalChecked(), Nan::New((double)stats.late));
+  obj->Set(Nan::New("late_frames_max").ToLocalChecked(), Nan::New((double)stats.lateFramesMax));
+  obj->Set(Nan::New("late_frames_total").ToLocalChecked(), Nan::New((double)stats.lateFramesTotal));
+  obj->Set(Nan::New("late_us_max").ToLocalChecked(), Nan::New((double)stats.lateUsMax));
+
+  info.GetReturnValue().Set(obj);
+}
+
+NAN_METHOD(nodeCoreFrame) {
+  info.GetReturnValue().Set(Nan::New((double)coreFrame()));
+}
+
+NAN_METHOD(nodeCoreTimeUs) {
+  info.GetReturnValue().Set(Nan::New((double)coreTimeUs()));
+}
+
+NAN_METHOD(nodeCoreStateSize) {
+  info.GetReturnValue().Set(Nan::New((double)coreStateSize()));
+}
+
+// @arg Optional Buffer or typed array of coreStateSize() bytes to serialize into
+// @return The Buffer containing the saved state
+NAN_METHOD(nodeCoreSaveState) {
+  const size_t sz = coreStateSize();
+
+  if (info.Length() > 0 && info[0]->IsArrayBufferView()) {
+    Nan::TypedArrayContents<uint8_t> dst(info[0]);
+    if (dst.length() != sz) return Nan::ThrowRangeError("State buffer size does not match coreStateSize()");
+    if (!coreSaveStateInto(*dst, sz)) return Nan::ThrowError("Core failed to serialize its state");
+    info.GetReturnValue().Set(info[0]);
+    return;
+  }
+
+  auto buffer = Nan::NewBuffer(sz).ToLocalChecked();
+  if (!coreSaveStateInto(node::Buffer::Data(buffer), sz)) return Nan::ThrowError("Core failed to serialize its state");
+  info.GetReturnValue().Set(buffer);
+}
+
+// @arg Buffer containing the state to restore, read in place
+NAN_METHOD(nodeCoreRestoreState) {
+  if (info.Length() < 1 || !info[0]->IsArrayBufferView()) return Nan::ThrowTypeError("Expected a Buffer");
+
+  Nan::TypedArrayContents<char> src(info[0]);
+  if (src.length() != coreStateSize()) return Nan::ThrowRangeError("State buffer size does not match coreStateSize()");
+  info.GetReturnValue().Set(Nan::New(coreRestoreState(*src, src.length())));
+}
+
+namespace
+{
+
+  struct StateFileBuffers
+  {
+    std::vector<uint8_t> state;
+    std::vector<uint8_t> scratch;
+  };
+
+  // Recycled between saves, only touched from the main thread
+  std::vector<std::unique_ptr<StateFileBuffers>> gStateFileBuffers;
+
+  class StateSaveWorker : public Nan::AsyncWorker
+  {
+  public:
+    StateSaveWorker(Nan::Callback * callback, const std::string & path, bool compress, bool sync)
+      : Nan::AsyncWorker(callback), path_(path), compress_(compress), sync_(sync)
+    {
+      if (gStateFileBuffers.empty()) {
+        buffers_.reset(new StateFileBuffers());
+      }
+      else {
+        buffers_ = std::move(gStateFileBuffers.back());
+        gStateFileBuffers.pop_back();
+      }
+      coreLibraryInfo(info_.coreName, info_.coreVersion);
+    }
+
+    ~StateSaveWorker()
+    {
+      gStateFileBuffers.push_back(std::move(buffers_));
+    }
+
+    // Runs on the main thread, the core is not thread-safe
+    bool serialize()
+    {
+      buffers_->state.resize(coreStateSize());
+      return coreSaveStateInto(buffers_->state.data(), buffers_->state.size());
+    }
+
+    void Execute()
+    {
+      std::string error;
+      const auto & state = buffers_->state;
+      if (!stateFileWrite(path_, info_, state.data(), state.size(), compress_, sync_, buffers_->scratch, error)) {
+        SetErrorMessage(error.c_str());
+      }
+    }
+
+    void HandleOKCallback()
+    {
+      Nan::HandleScope scope;
+      Local<v8::Value> argv[] = { Nan::Null(), Nan::New((double)buffers_->state.size()) };
+      callback->Call(2, argv);
+    }
+
+  private:
+    std::string path_;
+    bool compress_;
+    bool sync_;
+    StateFileInfo info_;
+    std::unique_ptr<StateFileBuffers> buffers_;
+  };
+
+  class StateLoadWorker : public Nan::AsyncWorker
+  {
+  public:
+    StateLoadWorker(Nan::Callback * callback, const std::string & path)
+      : Nan::AsyncWorker(callback), path_(path), generation_(coreGameGeneration()),
+        stateSize_(generation_ ? coreStateSize() : 0)
+    {
+    }
+
+    void Execute()
+    {
+      std::string error;
+      if (!reader_.open(path_, stateSize_, error)) SetErrorMessage(error.c_str());
+    }
+
+    void HandleOKCallback()
+    {
+      Nan::HandleScope scope;
+
+      // The core may have been closed, or another game loaded, while the file was read
+      if (!generation_ || coreGameGeneration() != generation_) {
+        Local<v8::Value> argv[] = { Nan::Error("Game was unloaded while the state was loading") };
+        callback->Call(1, argv);
+        return;
+      }
+
+      std::string name, version;
+      coreLibraryInfo(name, version);
+      if (reader_.info().coreName != name || reader_.info().coreVersion != version) {
+        const std::string error = "State was saved by " + reader_.info().coreName + " " + reader_.info().coreVersion;
+        Local<v8::Value> argv[] = { Nan::Error(error.c_str()) };
+        callback->Call(1, argv);
+        return;
+      }
+
+      // Restored straight from the mapping when the file is not compressed
+      if (!coreRestoreState((const char *)reader_.state(), reader_.stateSize())) {
+        Local<v8::Value> argv[] = { Nan::Error("Core rejected the state") };
+        callback->Call(1, argv);
+        return;
+      }
+
+      Local<v8::Value> argv[] = { Nan::Null() };
+      callback->Call(1, argv);
+    }
+
+  private:
+    std::string path_;
+    uint64_t generation_; // Game the state is meant for
+    size_t stateSize_;    // Read on the main thread
+    StateFileReader reader_;
+  };
+
+} // anonymous namespace
+
+// @arg path, compress, sync, callback(err, bytes)
+NAN_METHOD(nodeCoreStateSaveFile) {
+  const String::Utf8Value path(info[0]->ToString());
+  auto callback = new Nan::Callback(info[3].As<v8::Function>());
+  auto worker = new StateSaveWorker(callback, *path, info[1]->BooleanValue(), info[2]->BooleanValue());
+
+  if (!worker->serialize()) {
+    delete worker;
+    return Nan::ThrowError("Core failed to serialize its state");
+  }
+  Nan::AsyncQueueWorker(worker);
+}
+
+// @arg path, callback(err)
+NAN_METHOD(nodeCoreStateLoadFile) {
+  const String::Utf8Value path(info[0]->ToString());
+  auto callback = new Nan::Callback(info[1].As<v8::Function>());
+  Nan::AsyncQueueWorker(new StateLoadWorker(callback, *path));
+}
+
+namespace
+{
+
+  // Opened from JS, only touched from the main thread
+  HashDatabase gHashDb;
+
+  std::string toHex(const uint8_t * data, size_t size)
+  {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(size * 2, '0');
+    for (size_t i=0; i<size; i++) {
+      hex[2 * i] = digits[data[i] >> 4];
+      hex[2 * i + 1] = digits[data[i] & 15];
+    }
+    return hex;
+  }
+
+  // @return false unless `hex` is exactly `size` bytes
+  bool fromHex(const std::string & hex, uint8_t * out, size_t size)
+  {
+    if (hex.size() != size * 2) return false;
+    for (size_t i=0; i<hex.size(); i++) {
+      const char c = hex[i];
+      const int v = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+      if (v < 0) return false;
+      out[i / 2] = (uint8_t)((i & 1) ? (out[i / 2] | v) : (v << 4));
+    }
+    return true;
+  }
+
+  // Content size in bytes, 0 when unknown: missing, not a number, or out of range
+  uint64_t sizeValue(Local<v8::Value> value)
+  {
+    if (!value->IsNumber()) return 0;
+    const double size = value->NumberValue();
+    return (size >= 0.0 && size < 18446744073709551616.0) ? (uint64_t)size : 0;
+  }
+
+  class HashWorker : public Nan::AsyncWorker
+  {
+  public:
+    HashWorker(Nan::Callback * callback, const std::string & path)
+      : Nan::AsyncWorker(callback), path_(path)
+    {
+    }
+
+    void Execute()
+    {
+      std::string error;
+      if (!hashContent(path_, hashes_, error)) SetErrorMessage(error.c_str());
+    }
+
+    void HandleOKCallback()
+    {
+      Nan::HandleScope scope;
+      Local<v8::Value> argv[] = {
+        Nan::Null(),
+        Nan::New((double)hashes_.size),
+        Nan::New(hashes_.crc32),
+        Nan::New(toHex(hashes_.sha1, sizeof(hashes_.sha1))).ToLocalChecked(),
+      };
+      callback->Call(4, argv);
+    }
+
+  private:
+    std::string path_;
+    ContentHashes hashes_;
+  };
+
+} // anonymous namespace
+
+// @arg path (or archive.zip#entry), callback(err, size, crc32, sha1)
+NAN_METHOD(nodeCoreHashFile) {
+  const String::Utf8Value path(info[0]->ToString());
+  auto callback = new Nan::Callback(info[1].As<v8::Function>());
+  Nan::AsyncQueueWorker(new HashWorker(callback, *path));
+}
+
+// @arg path, Array of { crc32, size, sha1, metadata }, size and sha1 being optional
+NAN_METHOD(nodeCoreHashDbWrite) {
+  const String::Utf8Value path(info[0]->ToString());
+  if (!info[1]->IsArray()) return Nan::ThrowTypeError("Expected an array of records");
+  const auto array = info[1].As<v8::Array>();
+
+  std::vector<HashDbRecord> records(array->Length());
+  for (uint32_t i=0; i<array->Length(); i++) {
+    const auto obj = Nan::Get(array, i).ToLocalChecked()->ToObject();
+    const auto sha1 = Nan::Get(obj, Nan::New("sha1").ToLocalChecked()).ToLocalChecked();
+    const String::Utf8Value metadata(Nan::Get(obj, Nan::New("metadata").ToLocalChecked()).ToLocalChecked()->ToString());
+
+    records[i].crc32 = Nan::Get(obj, Nan::New("crc32").ToLocalChecked()).ToLocalChecked()->Uint32Value();
+    records[i].size = sizeValue(Nan::Get(obj, Nan::New("size").ToLocalChecked()).ToLocalChecked());
+    records[i].metadata = *metadata;
+    if (sha1->IsString() && !fromHex(*String::Utf8Value(sha1), records[i].sha1, sizeof(records[i].sha1))) {
+      return Nan::ThrowTypeError("Invalid sha1");
+    }
+  }
+
+  std::string error;
+  if (!hashDbWrite(*path, std::move(records), error)) return Nan::ThrowError(error.c_str());
+}
+
+NAN_METHOD(nodeCoreHashDbOpen) {
+  const String::Utf8Value path(info[0]->ToString());
+
+  std::string error;
+  if (!gHashDb.open(*path, error)) return Nan::ThrowError(error.c_str());
+  info.GetReturnValue().Set(Nan::New((double)gHashDb.size()));
+}
+
+// @arg crc32, size (0 if unknown), sha1 (optional, preferred when given)
+// @return Metadata of the matching record, null if there is none
+NAN_METHOD(nodeCoreHashDbLookup) {
+  std::string metadata;
+  bool found = false;
+  if (info[2]->IsString()) {
+    uint8_t sha1[20];
+    if (!fromHex(*String::Utf8Value(info[2]), sha1, sizeof(sha1))) return Nan::ThrowTypeError("Invalid sha1");
+    found = gHashDb.findSha1(sha1, metadata);
+  }
+  if (!found) found = gHashDb.findCrc(info[0]->Uint32Value(), sizeValue(info[1]), metadata);
+
+  if (found) info.GetReturnValue().Set(Nan::New(metadata).ToLocalChecked());
+  else info.GetReturnValue().Set(Nan::Null());
+}
+
+namespace
+{
+
+  // Batches handed over by the log sink thread, delivered to JS on the main loop
+  const size_t MAX_PENDING_LOGS = 10000;
+  uv_async_t gLogAsync;
+  bool gLogAsyncInit = false;
+  std::mutex gLogMutex;
+  std::vector<LogEntry> gLogPending;
+  std::unique_ptr<Nan::Callback> gLogCallback;
+  std::atomic<size_t> gLogsDropped(0); // Pending batches full, reported with the ring's own drops
+
+  void deliverLogs(uv_async_t *)
+  {
+    std::vector<LogEntry> entries;
+    {
+      std::lock_guard<std::mutex> lock(gLogMutex);
+      entries.swap(gLogPending);
+    }
+    if (!gLogCallback || entries.empty()) return;
+
+    Nan::HandleScope scope;
+    auto res = Nan::New<v8::Array>((int)entries.size());
+    for (size_t i=0; i<entries.size(); i++) {
+      auto obj = Nan::New<Object>();
+      obj->Set(Nan::New("level").ToLocalChecked(), Nan::New((int)entries[i].level));
+      obj->Set(Nan::New("time").ToLocalChecked(), Nan::New(entries[i].timeMs));
+      obj->Set(Nan::New("text").ToLocalChecked(), Nan::New(entries[i].text).ToLocalChecked());
+      res->Set(i, obj);
+    }
+
+    Local<v8::Value> argv[] = { res };
+    gLogCallback->Call(1, argv);
+  }
+
+} // anonymous namespace
+
+// @arg Minimum LOG_* level
+NAN_METHOD(nodeCoreLogLevel) {
+  logSetLevel((LogLevel)info[0]->Uint32Value());
+}
+
+// @arg Messages per second and per call site, 0 for no limit
+NAN_METHOD(nodeCoreLogRateLimit) {
+  logSetRateLimit(info[0]->Uint32Value());
+}
+
+// @arg Path appended to, empty for stdout
+NAN_METHOD(nodeCoreLogFile) {
+  const String::Utf8Value path(info[0]->ToString());
+  if (!logSetFile(*path)) return Nan::ThrowError("Cannot open log file");
+}
+
+// @arg callback(entries) receiving batches of { level, time, text }, null to go back to the file
+NAN_METHOD(nodeCoreLogCallback) {
+  if (!info[0]->IsFunction()) {
+    logSetCallback(nullptr);
+    gLogCallback.reset();
+    return;
+  }
+
+  if (!gLogAsyncInit) {
+    uv_async_init(uv_default_loop(), &gLogAsync, deliverLogs);
+    uv_unref((uv_handle_t *)&gLogAsync); // Logging alone does not keep the process alive
+    gLogAsyncInit = true;
+  }
+  gLogCallback.reset(new Nan::Callback(info[0].As<v8::Function>()));
+
+  logSetCallback([](std::vector<LogEntry> & batch) {
+    {
+      std::lock_guard<std::mutex> lock(gLogMutex);
+      const size_t room = MAX_PENDING_LOGS - std::min(MAX_PENDING_LOGS, gLogPending.size());
+      const size_t count = std::min(room, batch.size());
+      std::move(batch.begin(), batch.begin() + count, std::back_inserter(gLogPending));
+      gLogsDropped += batch.size() - count;
+    }
+    uv_async_send(&gLogAsync);
+  });
+}
+
+NAN_METHOD(nodeCoreLogFlush) {
+  logFlush();
+}
+
+NAN_METHOD(nodeCoreLogStats) {
+  const auto stats = logStats();
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("written").ToLocalChecked(), Nan::New((double)stats.written));
+  obj->Set(Nan::New("dropped").ToLocalChecked(), Nan::New((double)(stats.dropped + gLogsDropped.load())));
+  obj->Set(Nan::New("suppressed").ToLocalChecked(), Nan::New((double)stats.suppressed));
+  obj->Set(Nan::New("filtered").ToLocalChecked(), Nan::New((double)stats.filtered));
+
+  info.GetReturnValue().Set(obj);
+}
+
+NAN_METHOD(nodeCoreStatePoolSave) {
+  info.GetReturnValue().Set(Nan::New(coreStatePoolSave()));
+}
+
+NAN_METHOD(nodeCoreStatePoolFork) {
+  info.GetReturnValue().Set(Nan::New(coreStatePoolFork(info[0]->Uint32Value())));
+}
+
+NAN_METHOD(nodeCoreStatePoolRestore) {
+  info.GetReturnValue().Set(Nan::New(coreStatePoolRestore(info[0]->Uint32Value())));
+}
+
+NAN_METHOD(nodeCoreStatePoolRelease) {
+  info.GetReturnValue().Set(Nan::New(coreStatePoolRelease(info[0]->Uint32Value())));
+}
+
+NAN_METHOD(nodeCoreStatePoolStats) {
+  const auto stats = coreStatePoolStats();
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("state_size").ToLocalChecked(), Nan::New((double)stats.stateSize));
+  obj->Set(Nan::New("states").ToLocalChecked(), Nan::New((double)stats.states));
+  obj->Set(Nan::New("pages").ToLocalChecked(), Nan::New((double)stats.pages));
+  obj->Set(Nan::New("page_refs").ToLocalChecked(), Nan::New((double)stats.pageRefs));
+  obj->Set(Nan::New("bytes").ToLocalChecked(), Nan::New((double)(stats.pages * StatePool::PAGE_SIZE)));
+  obj->Set(Nan::New("arena_bytes").ToLocalChecked(), Nan::New((double)stats.arenaBytes));
+  obj->Set(Nan::New("shared_pages").ToLocalChecked(), Nan::New((double)stats.sharedPages));
+  obj->Set(Nan::New("copied_pages").ToLocalChecked(), Nan::New((double)stats.copiedPages));
+
+  info.GetReturnValue().Set(obj);
+}
+
+// @arg Path, number of ports, keyframe interval in frames
+NAN_METHOD(nodeCoreMovieRecord) {
+  const String::Utf8Value path(info[0]->ToString());
+  const size_t ports = info[1]->IsUndefined() ? 2 : info[1]->Uint32Value();
+  const size_t keyframeInterval = info[2]->IsUndefined() ? 600 : info[2]->Uint32Value();
+
+  std::string error;
+  if (!coreMovieRecord(*path, ports, keyframeInterval, error)) return Nan::ThrowError(error.c_str());
+}
+
+NAN_METHOD(nodeCoreMoviePlay) {
+  const String::Utf8Value path(info[0]->ToString());
+
+  std::string error;
+  if (!coreMoviePlay(*path, error)) return Nan::ThrowError(error.c_str());
+}
+
+NAN_METHOD(nodeCoreMovieStop) {
+  std::string error;
+  if (!coreMovieStop(error)) return Nan::ThrowError(error.c_str());
+}
+
+NAN_METHOD(nodeCoreMovieSeek) {
+  info.GetReturnValue().Set(Nan::New(coreMovieSeek(info[0]->Uint32Value())));
+}
+
+NAN_METHOD(nodeCoreMovieStatus) {
+  const auto status = coreMovieStatus();
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("recording").ToLocalChecked(), Nan::New(status.recording));
+  obj->Set(Nan::New("playing").ToLocalChecked(), Nan::New(status.playing));
+  obj->Set(Nan::New("frame").ToLocalChecked(), Nan::New((double)status.frame));
+  obj->Set(Nan::New("frames").ToLocalChecked(), Nan::New((double)status.frames));
+
+  info.GetReturnValue().Set(obj);
+}
+
+// @arg Path, whether to convert video frames
+NAN_METHOD(nodeCoreMovieReplay) {
+  const String::Utf8Value path(info[0]->ToString());
+  const bool video = info[1]->BooleanValue();
+
+  MovieReplayStats stats;
+  std::string error;
+  if (!coreMovieReplay(*path, video, stats, error)) return Nan::ThrowError(error.c_str());
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("frames").ToLocalChecked(), Nan::New((double)stats.frames));
+  obj->Set(Nan::New("total_us").ToLocalChecked(), Nan::New(stats.totalUs));
+  obj->Set(Nan::New("fps").ToLocalChecked(), Nan::New(stats.totalUs > 0 ? stats.frames * 1e6 / stats.totalUs : 0.0));
+
+  info.GetReturnValue().Set(obj);
+}
+
+NAN_METHOD(nodeCoreFingerprintSetup) {
+  coreFingerprintSetup(info[0]->Uint32Value());
+}
+
+// @arg Optional Uint32Array receiving the low then high half, no allocation per frame
+// @return Hex string when no array is given
+NAN_METHOD(nodeCoreFingerprint) {
+  const uint64_t fingerprint = coreFingerprint();
+
+  if (info.Length() >= 1 && info[0]->IsUint32Array()) {
+    Nan::TypedArrayContents<uint32_t> dst(info[0]);
+    if (dst.length() < 2) return Nan::ThrowRangeError("Expected 2 elements");
+    (*dst)[0] = (uint32_t)fingerprint;
+    (*dst)[1] = (uint32_t)(fingerprint >> 32);
+    return;
+  }
+
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)fingerprint);
+  info.GetReturnValue().Set(Nan::New(hex).ToLocalChecked());
+}
+
+// @arg Paths of both movies, FINGERPRINT_* flags
+NAN_METHOD(nodeCoreMovieCompare) {
+  const String::Utf8Value pathA(info[0]->ToString());
+  const String::Utf8Value pathB(info[1]->ToString());
+  const unsigned flags = info[2]->IsUndefined() ? FINGERPRINT_VIDEO | FINGERPRINT_RAM : info[2]->Uint32Value();
+
+  MovieDivergence result;
+  std::string error;
+  if (!coreMovieCompare(*pathA, *pathB, flags, result, error)) return Nan::ThrowError(error.c_str());
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("frames").ToLocalChecked(), Nan::New((double)result.frames));
+  obj->Set(Nan::New("input").ToLocalChecked(), Nan::New((double)result.input));
+  obj->Set(Nan::New("state").ToLocalChecked(), Nan::New((double)result.state));
+
+  info.GetReturnValue().Set(obj);
+}
+
+namespace
+{
+
+  // ArrayBuffers handed out per region, aliasing the memory of the core
+  struct MemoryView
+  {
+    Nan::Persistent<v8::ArrayBuffer> buffer;
+    void * data = nullptr;
+    size_t size = 0;
+  };
+
+  MemoryView gMemoryViews[RETRO_MEMORY_VIDEO_RAM + 1];
+
+  // Scripts may hold on to views, neutering them turns a dangling pointer into an empty buffer
+  void invalidateMemoryView(MemoryView & view)
+  {
+    if (!view.buffer.IsEmpty()) {
+      auto buffer = Nan::New(view.buffer);
+      if (buffer->IsNeuterable()) buffer->Neuter();
+      view.buffer.Reset();
+    }
+    view.data = nullptr;
+    view.size = 0;
+  }
+
+  void invalidateMemoryViews()
+  {
+    Nan::HandleScope scope;
+    for (auto & view : gMemoryViews) invalidateMemoryView(view);
+  }
+
+} // anonymous namespace
+
+// @arg RETRO_MEMORY_* id
+// @return ArrayBuffer aliasing the region without copy, undefined if the core does not expose it
+// @note The buffer is emptied when the game is unloaded, do not keep it across coreLoadGame
+NAN_METHOD(nodeCoreMemory) {
+  const unsigned id = info[0]->Uint32Value();
+  if (id > RETRO_MEMORY_VIDEO_RAM) return Nan::ThrowRangeError("Unknown memory region");
+
+  size_t size;
+  void * data = coreMemoryData(id, size);
+  MemoryView & view = gMemoryViews[id];
+  if (view.data != data || view.size != size) invalidateMemoryView(view);
+  if (!data) return;
+
+  if (view.buffer.IsEmpty()) {
+    view.buffer.Reset(v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), data, size));
+    view.data = data;
+    view.size = size;
+  }
+  info.GetReturnValue().Set(Nan::New(view.buffer));
+}
+
+NAN_METHOD(nodeCoreMemoryMapDescriptors) {
+  info.GetReturnValue().Set(Nan::New((double)coreMemoryMapDescriptors()));
+}
+
+// @arg Uint32Array of emulated addresses, Uint8Array, Uint16Array or Uint32Array receiving one
+//      value per address, its element size being the width read
+NAN_METHOD(nodeCoreMemoryRead) {
+  if (info.Length() < 2 || !info[0]->IsUint32Array()) return Nan::ThrowTypeError("Expected a Uint32Array of addresses");
+
+  Nan::TypedArrayContents<uint32_t> addresses(info[0]);
+  size_t count = addresses.length();
+  if (info[1]->IsUint8Array()) {
+    Nan::TypedArrayContents<uint8_t> out(info[1]);
+    coreMemoryRead(*addresses, std::min(count, out.length()), 1, *out);
+  }
+  else if (info[1]->IsUint16Array()) {
+    Nan::TypedArrayContents<uint16_t> out(info[1]);
+    coreMemoryRead(*addresses, std::min(count, out.length()), 2, *out);
+  }
+  else if (info[1]->IsUint32Array()) {
+    Nan::TypedArrayContents<uint32_t> out(info[1]);
+    coreMemoryRead(*addresses, std::min(count, out.length()), 4, *out);
+  }
+  else {
+    return Nan::ThrowTypeError("Expected a Uint8Array, Uint16Array or Uint32Array");
+  }
+}
+
+// @arg Emulated address, Uint8Array receiving the bytes from there
+// @return Bytes actually mapped
+NAN_METHOD(nodeCoreMemoryReadRange) {
+  if (info.Length() < 2 || !info[1]->IsUint8Array()) return Nan::ThrowTypeError("Expected a Uint8Array");
+
+  Nan::TypedArrayContents<uint8_t> out(info[1]);
+  const uint64_t address = (uint64_t)info[0]->NumberValue();
+  info.GetReturnValue().Set(Nan::New((double)coreMemoryReadRange(address, *out, out.length())));
+}
+
+// @arg RETRO_MEMORY_* region, width in bytes, big endian, aligned positions only (default)
+NAN_METHOD(nodeCoreScanReset) {
+  const unsigned width = info[1]->IsUndefined() ? 1 : info[1]->Uint32Value();
+  if (width != 1 && width != 2 && width != 4) return Nan::ThrowRangeError("Width must be 1, 2 or 4");
+  const bool aligned = info[3]->IsUndefined() ? true : info[3]->BooleanValue();
+  info.GetReturnValue().Set(Nan::New(coreScanReset(info[0]->Uint32Value(), width, info[2]->BooleanValue(), aligned)));
+}
+
+// @arg SCAN_* operation, value
+NAN_METHOD(nodeCoreScanFilter) {
+  const unsigned op = info[0]->Uint32Value();
+  if (op >= SCAN_OP_COUNT) return Nan::ThrowRangeError("Unknown scan operation");
+  info.GetReturnValue().Set(Nan::New((double)coreScanFilter((ScanOp)op, info[1]->Uint32Value())));
+}
+
+// @arg Uint32Array receiving candidate offsets, optional Uint32Array receiving their values
+// @return Candidates written
+NAN_METHOD(nodeCoreScanResults) {
+  if (info.Length() < 1 || !info[0]->IsUint32Array()) return Nan::ThrowTypeError("Expected a Uint32Array");
+
+  Nan::TypedArrayContents<uint32_t> offsets(info[0]);
+  size_t max = offsets.length();
+  size_t count;
+  if (info.Length() >= 2 && info[1]->IsUint32Array()) {
+    Nan::TypedArrayContents<uint32_t> values(info[1]);
+    count = coreScanResults(*offsets, *values, std::min(max, values.length()));
+  }
+  else {
+    count = coreScanResults(*offsets, nullptr, max);
+  }
+  info.GetReturnValue().Set(Nan::New((double)count));
+}
+
+// @arg Expression, frames it must hold before triggering (default 1)
+// @return Id of the condition
+NAN_METHOD(nodeCoreConditionAdd) {
+  const String::Utf8Value source(info[0]->ToString());
+  const uint32_t hitTarget = info[1]->IsUndefined() ? 1 : info[1]->Uint32Value();
+
+  std::string error;
+  const int64_t id = coreConditionAdd(*source, hitTarget, error);
+  if (id < 0) return Nan::ThrowError(error.c_str());
+  info.GetReturnValue().Set(Nan::New((double)id));
+}
+
+NAN_METHOD(nodeCoreConditionRemove) {
+  info.GetReturnValue().Set(Nan::New(coreConditionRemove(info[0]->Uint32Value())));
+}
+
+NAN_METHOD(nodeCoreConditionsClear) {
+  coreConditionsClear();
+}
+
+NAN_METHOD(nodeCoreConditionsResetHits) {
+  coreConditionsResetHits();
+}
+
+NAN_METHOD(nodeCoreConditionHits) {
+  info.GetReturnValue().Set(Nan::New(coreConditionHits(info[0]->Uint32Value())));
+}
+
+// @arg Uint32Array receiving the ids of the conditions triggered by the last coreUpdate
+// @return Number of triggered conditions, which may exceed the array length
+NAN_METHOD(nodeCoreConditionsTriggered) {
+  if (info.Length() < 1 || !info[0]->IsUint32Array()) return Nan::ThrowTypeError("Expected a Uint32Array");
+
+  const auto & triggered = coreConditionsTriggered();
+  Nan::TypedArrayContents<uint32_t> dst(info[0]);
+  std::copy(triggered.begin(), triggered.begin() + std::min(triggered.size(), dst.length()), *dst);
+  info.GetReturnValue().Set(Nan::New((double)triggered.size()));
+}
+
+NAN_METHOD(nodeCoreSetSaveDirectory) {
+  const String::Utf8Value dir(info[0]->ToString());
+  coreSetSaveDirectory(*dir);
+}
+
+// @arg Enabled, debounce delay (ms), longest delay while the SRAM keeps changing (ms)
+NAN_METHOD(nodeCoreAutosaveSetup) {
+  const size_t debounceMs = info[1]->IsUndefined() ? 1000 : info[1]->Uint32Value();
+  const size_t maxDelayMs = info[2]->IsUndefined() ? 10000 : info[2]->Uint32Value();
+  coreAutosaveSetup(info[0]->BooleanValue(), debounceMs, maxDelayMs);
+}
+
+NAN_METHOD(nodeCoreAutosaveFlush) {
+  coreAutosaveFlush();
+}
+
+NAN_METHOD(nodeCoreAutosaveStats) {
+  const auto stats = coreAutosaveStats();
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("checks").ToLocalChecked(), Nan::New((double)stats.checks));
+  obj->Set(Nan::New("changes").ToLocalChecked(), Nan::New((double)stats.changes));
+  obj->Set(Nan::New("writes").ToLocalChecked(), Nan::New((double)stats.writes));
+  obj->Set(Nan::New("failures").ToLocalChecked(), Nan::New((double)stats.failures));
+  obj->Set(Nan::New("check_us").ToLocalChecked(), Nan::New(stats.checks ? stats.checkUs / stats.checks : 0.0));
+  obj->Set(Nan::New("write_us").ToLocalChecked(), Nan::New(stats.writes ? stats.writeUs / stats.writes : 0.0));
+
+  info.GetReturnValue().Set(obj);
+}
+
+// @arg Path the content is loaded as, Buffer holding it (copied)
+NAN_METHOD(nodeCoreRomCachePut) {
+  if (info.Length() < 2 || !info[1]->IsArrayBufferView()) return Nan::ThrowTypeError("Expected a Buffer");
+
+  const String::Utf8Value path(info[0]->ToString());
+  Nan::TypedArrayContents<uint8_t> data(info[1]);
+  coreRomCachePut(*path, *data, data.length());
+}
+
+NAN_METHOD(nodeCoreRomCacheClear) {
+  coreRomCacheClear();
+}
+
+NAN_METHOD(nodeCoreRomCacheStats) {
+  const auto stats = coreRomCacheStats();
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("entries").ToLocalChecked(), Nan::New((double)stats.entries));
+  obj->Set(Nan::New("bytes").ToLocalChecked(), Nan::New((double)stats.bytes));
+  obj->Set(Nan::New("hits").ToLocalChecked(), Nan::New((double)stats.hits));
+  obj->Set(Nan::New("misses").ToLocalChecked(), Nan::New((double)stats.misses));
+
+  info.GetReturnValue().Set(obj);
+}
+
+// @return Array of { name, size, compressed_size, crc }
+NAN_METHOD(nodeCoreArchiveEntries) {
+  const String::Utf8Value path(info[0]->ToString());
+
+  std::vector<ZipEntry> entries;
+  std::string error;
+  if (!coreArchiveEntries(*path, entries, error)) return Nan::ThrowError(error.c_str());
+
+  auto res = Nan::New<v8::Array>((int)entries.size());
+  for (size_t i=0; i<entries.size(); i++) {
+    auto obj = Nan::New<Object>();
+    obj->Set(Nan::New("name").ToLocalChecked(), Nan::New(entries[i].name).ToLocalChecked());
+    obj->Set(Nan::New("size").ToLocalChecked(), Nan::New((double)entries[i].size));
+    obj->Set(Nan::New("compressed_size").ToLocalChecked(), Nan::New((double)entries[i].compressedSize));
+    obj->Set(Nan::New("crc").ToLocalChecked(), Nan::New((double)entries[i].crc));
+    res->Set(i, obj);
+  }
+
+  info.GetReturnValue().Set(res);
+}
+
+// @arg Player, local port, remote host, remote port, input delay, max rollback, simulated latency
+//      (ms), jitter (ms), loss (0-1), loopback
+NAN_METHOD(nodeCoreNetplayStart) {
+  NetplayConfig config;
+  config.player = info[0]->Uint32Value();
+  config.localPort = (uint16_t)info[1]->Uint32Value();
+  const String::Utf8Value remoteHost(info[2]->ToString());
+  config.remoteHost = *remoteHost;
+  config.remotePort = (uint16_t)info[3]->Uint32Value();
+  config.inputDelay = info[4]->Uint32Value();
+  config.maxRollback = info[5]->Uint32Value();
+  config.latencyMs = info[6]->NumberValue();
+  config.jitterMs = info[7]->NumberValue();
+  config.loss = info[8]->NumberValue();
+  const bool loopback = info[9]->BooleanValue();
+
+  std::string error;
+  if (!coreNetplayStart(config, loopback, error)) return Nan::ThrowError(error.c_str());
+}
+
+NAN_METHOD(nodeCoreNetplayStop) {
+  coreNetplayStop();
+}
+
+NAN_METHOD(nodeCoreNetplayStats) {
+  const auto stats = coreNetplayStats();
+
+  auto obj = Nan::New<Object>();
+  obj->Set(Nan::New("frames").ToLocalChecked(), Nan::New((double)stats.frames));
+  obj->Set(Nan::New("stalls").ToLocalChecked(), Nan::New((double)stats.stalls));
+  obj->Set(Nan::New("rollbacks").ToLocalChecked(), Nan::New((double)stats.rollbacks));
+  obj->Set(Nan::New("rollback_frames").ToLocalChecked(), Nan::New((double)stats.rollbackFrames));
+  obj->Set(Nan::New("rollback_depth").ToLocalChecked(), Nan::New(stats.rollbacks ? (double)stats.rollbackFrames / stats.rollbacks : 0.0));
+  obj->Set(Nan::New("rollback_max").ToLocalChecked(), Nan::New((double)stats.rollbackMax));
+  obj->Set(Nan::New("resim_us").ToLocalChecked(), Nan::New(stats.rollbacks ? stats.resimUs / stats.rollbacks : 0.0));
+  obj->Set(Nan::New("resim_us_max").ToLocalChecked(), Nan::New(stats.resimUsMax));
+  obj->Set(Nan::New("save_us").ToLocalChecked(), Nan::New(stats.frames ? stats.saveUs / stats.frames : 0.0));
+  obj->Set(Nan::New("packets_sent").ToLocalChecked(), Nan::New((double)stats.packetsSent));
+  obj->Set(Nan::New("packets_received").ToLocalChecked(), Nan::New((double)stats.packetsReceived));
+  obj->Set(Nan::New("packets_lost").ToLocalChecked(), Nan::New((double)stats.packetsLost));
+  obj->Set(Nan::New("rtt_us").ToLocalChecked(), Nan::New(stats.rttUs));
+  obj->Set(Nan::New("frame_advantage").ToLocalChecked(), Nan::New((double)stats.frameAdvantage));
+  obj->Set(Nan::New("desynced").ToLocalChecked(), Nan::New(stats.desynced));
+
+  info.GetReturnValue().Set(obj);
+}
 
 NAN_MODULE_INIT(init) {
+  coreSetUnloadHook(invalidateMemoryViews);
+
   Set(target, New("coreInit").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreInit)).ToLocalChecked());
+  Set(target, New("coreSetBindingMode").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreSetBindingMode)).ToLocalChecked());
+  Set(target, New("coreCapabilities").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreCapabilities)).ToLocalChecked());
+  Set(target, New("coreProbeCache").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreProbeCache)).ToLocalChecked());
+  Set(target, New("coreProbe").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreProbe)).ToLocalChecked());
+  Set(target, New("corePoolSetup").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCorePoolSetup)).ToLocalChecked());
+  Set(target, New("corePoolStats").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCorePoolStats)).ToLocalChecked());
   Set(target, New("coreLoadGame").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreLoadGame)).ToLocalChecked());
   Set(target, New("coreUpdate").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreUpdate)).ToLocalChecked());
+  Set(target, New("coreRomCachePut").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreRomCachePut)).ToLocalChecked());
+  Set(target, New("coreRomCacheClear").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreRomCacheClear)).ToLocalChecked());
+  Set(target, New("coreRomCacheStats").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreRomCacheStats)).ToLocalChecked());
+  Set(target, New("coreArchiveEntries").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreArchiveEntries)).ToLocalChecked());
+  Set(target, New("coreRunAhead").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreRunAhead)).ToLocalChecked());
+  Set(target, New("coreRunAheadStats").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreRunAheadStats)).ToLocalChecked());
+  Set(target, New("coreStats").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreStats)).ToLocalChecked());
+  Set(target, New("coreStatsReset").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreStatsReset)).ToLocalChecked());
+  Set(target, New("corePerfCounters").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCorePerfCounters)).ToLocalChecked());
+  Set(target, New("corePerfReset").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCorePerfReset)).ToLocalChecked());
+  Set(target, New("corePerfLog").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCorePerfLog)).ToLocalChecked());
+  Set(target, New("coreRewindSetup").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreRewindSetup)).ToLocalChecked());
+  Set(target, New("coreRewind").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreRewind)).ToLocalChecked());
+  Set(target, New("coreRewindStats").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreRewindStats)).ToLocalChecked());
   Set(target, New("coreVideoData").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreVideoData)).ToLocalChecked());
   Set(target, New("coreVideoSize").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreVideoSize)).ToLocalChecked());
   Set(target, New("coreAudioData").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreAudioData)).ToLocalChecked());
   Set(target, New("coreTimings").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreTimings)).ToLocalChecked());
   Set(target, New("coreSettingsSet").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreSettingsSet)).ToLocalChecked());
   // Set(target, New("coreSettingsDesc").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreSettingsDesc)).ToLocalChecked());
-  // Set(target, New("coreJoypadDesc").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreJoypadDesc)).ToLocalChecked());
-  // Set(target, New("coreJoypadPress").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreJoypadPress)).ToLocalChecked());
-  // Set(target, New("coreJoypadRelease").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreJoypadRelease)).ToLocalChecked());
-  // Set(target, New("coreStateSave").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreSaveState)).ToLocalChecked());
-  // Set(target, New("coreStateRestore").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreRestoreState)).ToLocalChecked());
+  Set(target, New("coreJoypadDesc").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreJoypadDesc)).ToLocalChecked());
+  Set(target, New("coreJoypadPress").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreJoypadPress)).ToLocalChecked());
+  Set(target, New("coreJoypadRelease").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreJoypadRelease)).ToLocalChecked());
+  Set(target, New("coreInputSet").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreInputSet)).ToLocalChecked());
+  Set(target, New("coreInputQueuePush").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreInputQueuePush)).ToLocalChecked());
+  Set(target, New("coreInputQueueStats").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreInputQueueStats)).ToLocalChecked());
+  Set(target, New("coreFrame").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreFrame)).ToLocalChecked());
+  Set(target, New("coreTimeUs").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreTimeUs)).ToLocalChecked());
+  Set(target, New("INPUT_BUTTONS").ToLocalChecked(), New(INPUT_BUTTONS));
+  Set(target, New("INPUT_ANALOG_LEFT_X").ToLocalChecked(), New(INPUT_ANALOG_LEFT_X));
+  Set(target, New("INPUT_ANALOG_LEFT_Y").ToLocalChecked(), New(INPUT_ANALOG_LEFT_Y));
+  Set(target, New("INPUT_ANALOG_RIGHT_X").ToLocalChecked(), New(INPUT_ANALOG_RIGHT_X));
+  Set(target, New("INPUT_ANALOG_RIGHT_Y").ToLocalChecked(), New(INPUT_ANALOG_RIGHT_Y));
+  Set(target, New("INPUT_POINTER_X").ToLocalChecked(), New(INPUT_POINTER_X));
+  Set(target, New("INPUT_POINTER_Y").ToLocalChecked(), New(INPUT_POINTER_Y));
+  Set(target, New("INPUT_POINTER_PRESSED").ToLocalChecked(), New(INPUT_POINTER_PRESSED));
+  Set(target, New("INPUT_STRIDE").ToLocalChecked(), New(INPUT_STRIDE));
+  Set(target, New("coreStateSize").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreStateSize)).ToLocalChecked());
+  Set(target, New("coreStateSave").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreSaveState)).ToLocalChecked());
+  Set(target, New("coreStateRestore").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreRestoreState)).ToLocalChecked());
+  Set(target, New("coreStatePoolSave").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreStatePoolSave)).ToLocalChecked());
+  Set(target, New("coreStatePoolFork").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreStatePoolFork)).ToLocalChecked());
+  Set(target, New("coreStatePoolRestore").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreStatePoolRestore)).ToLocalChecked());
+  Set(target, New("coreStatePoolRelease").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreStatePoolRelease)).ToLocalChecked());
+  Set(target, New("coreStatePoolStats").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreStatePoolStats)).ToLocalChecked());
+  Set(target, New("coreSetSaveDirectory").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreSetSaveDirectory)).ToLocalChecked());
+  Set(target, New("coreAutosaveSetup").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreAutosaveSetup)).ToLocalChecked());
+  Set(target, New("coreAutosaveFlush").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreAutosaveFlush)).ToLocalChecked());
+  Set(target, New("coreAutosaveStats").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreAutosaveStats)).ToLocalChecked());
+  Set(target, New("coreStateSaveFile").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreStateSaveFile)).ToLocalChecked());
+  Set(target, New("coreStateLoadFile").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreStateLoadFile)).ToLocalChecked());
+  Set(target, New("coreHashFile").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreHashFile)).ToLocalChecked());
+  Set(target, New("coreHashDbWrite").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreHashDbWrite)).ToLocalChecked());
+  Set(target, New("coreHashDbOpen").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreHashDbOpen)).ToLocalChecked());
+  Set(target, New("coreHashDbLookup").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreHashDbLookup)).ToLocalChecked());
+  Set(target, New("coreLogLevel").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreLogLevel)).ToLocalChecked());
+  Set(target, New("coreLogRateLimit").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreLogRateLimit)).ToLocalChecked());
+  Set(target, New("coreLogFile").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreLogFile)).ToLocalChecked());
+  Set(target, New("coreLogCallback").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreLogCallback)).ToLocalChecked());
+  Set(target, New("coreLogFlush").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreLogFlush)).ToLocalChecked());
+  Set(target, New("coreLogStats").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreLogStats)).ToLocalChecked());
+  Set(target, New("LOG_DEBUG").ToLocalChecked(), New(LOG_DEBUG));
+  Set(target, New("LOG_INFO").ToLocalChecked(), New(LOG_INFO));
+  Set(target, New("LOG_WARN").ToLocalChecked(), New(LOG_WARN));
+  Set(target, New("LOG_ERROR").ToLocalChecked(), New(LOG_ERROR));
+  Set(target, New("LOG_NONE").ToLocalChecked(), New(LOG_NONE));
+  Set(target, New("coreMovieRecord").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreMovieRecord)).ToLocalChecked());
+  Set(target, New("coreMoviePlay").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreMoviePlay)).ToLocalChecked());
+  Set(target, New("coreMovieStop").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreMovieStop)).ToLocalChecked());
+  Set(target, New("coreMovieSeek").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreMovieSeek)).ToLocalChecked());
+  Set(target, New("coreMovieStatus").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreMovieStatus)).ToLocalChecked());
+  Set(target, New("coreMovieReplay").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreMovieReplay)).ToLocalChecked());
+  Set(target, New("coreMovieCompare").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreMovieCompare)).ToLocalChecked());
+  Set(target, New("coreFingerprintSetup").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreFingerprintSetup)).ToLocalChecked());
+  Set(target, New("coreFingerprint").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreFingerprint)).ToLocalChecked());
+  Set(target, New("FINGERPRINT_VIDEO").ToLocalChecked(), New(FINGERPRINT_VIDEO));
+  Set(target, New("FINGERPRINT_AUDIO").ToLocalChecked(), New(FINGERPRINT_AUDIO));
+  Set(target, New("FINGERPRINT_RAM").ToLocalChecked(), New(FINGERPRINT_RAM));
+  Set(target, New("coreMemory").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreMemory)).ToLocalChecked());
+  Set(target, New("coreMemoryMapDescriptors").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreMemoryMapDescriptors)).ToLocalChecked());
+  Set(target, New("coreMemoryRead").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreMemoryRead)).ToLocalChecked());
+  Set(target, New("coreMemoryReadRange").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreMemoryReadRange)).ToLocalChecked());
+  Set(target, New("coreScanReset").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreScanReset)).ToLocalChecked());
+  Set(target, New("coreScanFilter").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreScanFilter)).ToLocalChecked());
+  Set(target, New("coreScanResults").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreScanResults)).ToLocalChecked());
+  Set(target, New("SCAN_EQUAL").ToLocalChecked(), New(SCAN_EQUAL));
+  Set(target, New("SCAN_NOT_EQUAL").ToLocalChecked(), New(SCAN_NOT_EQUAL));
+  Set(target, New("SCAN_GREATER").ToLocalChecked(), New(SCAN_GREATER));
+  Set(target, New("SCAN_LESS").ToLocalChecked(), New(SCAN_LESS));
+  Set(target, New("SCAN_CHANGED").ToLocalChecked(), New(SCAN_CHANGED));
+  Set(target, New("SCAN_UNCHANGED").ToLocalChecked(), New(SCAN_UNCHANGED));
+  Set(target, New("SCAN_INCREASED").ToLocalChecked(), New(SCAN_INCREASED));
+  Set(target, New("SCAN_DECREASED").ToLocalChecked(), New(SCAN_DECREASED));
+  Set(target, New("SCAN_DELTA").ToLocalChecked(), New(SCAN_DELTA));
+  Set(target, New("coreConditionAdd").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreConditionAdd)).ToLocalChecked());
+  Set(target, New("coreConditionRemove").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreConditionRemove)).ToLocalChecked());
+  Set(target, New("coreConditionsClear").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreConditionsClear)).ToLocalChecked());
+  Set(target, New("coreConditionsResetHits").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreConditionsResetHits)).ToLocalChecked());
+  Set(target, New("coreConditionHits").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreConditionHits)).ToLocalChecked());
+  Set(target, New("coreConditionsTriggered").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreConditionsTriggered)).ToLocalChecked());
+  Set(target, New("MEMORY_SAVE_RAM").ToLocalChecked(), New(RETRO_MEMORY_SAVE_RAM));
+  Set(target, New("MEMORY_RTC").ToLocalChecked(), New(RETRO_MEMORY_RTC));
+  Set(target, New("MEMORY_SYSTEM_RAM").ToLocalChecked(), New(RETRO_MEMORY_SYSTEM_RAM));
+  Set(target, New("MEMORY_VIDEO_RAM").ToLocalChecked(), New(RETRO_MEMORY_VIDEO_RAM));
+  Set(target, New("coreNetplayStart").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreNetplayStart)).ToLocalChecked());
+  Set(target, New("coreNetplayStop").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreNetplayStop)).ToLocalChecked());
+  Set(target, New("coreNetplayStats").ToLocalChecked(), GetFunction(New<FunctionTemplate>(nodeCoreNetplayStats)).ToLocalChecked());
 }
 
 NODE_MODULE(retro_api, init)
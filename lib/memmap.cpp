@@ -0,0 +1,219 @@
+#include "memmap.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "retro.h"
+
+
+namespace
+{
+
+  // Mirrors of a descriptor are enumerated up to this many intervals
+  const unsigned MAX_MIRROR_BITS = 12;
+
+  inline uint64_t addBitsDown(uint64_t n)
+  {
+    n |= n >> 1;
+    n |= n >> 2;
+    n |= n >> 4;
+    n |= n >> 8;
+    n |= n >> 16;
+    n |= n >> 32;
+    return n;
+  }
+
+  inline uint64_t highestBit(uint64_t n)
+  {
+    n = addBitsDown(n);
+    return n ^ (n >> 1);
+  }
+
+  inline unsigned popCount(uint64_t n)
+  {
+    unsigned count = 0;
+    for (; n; n &= n - 1) count++;
+    return count;
+  }
+
+  // Inserts a zero bit at every set bit of `mask`
+  uint64_t inflate(uint64_t addr, uint64_t mask)
+  {
+    while (mask) {
+      const uint64_t tmp = (mask - 1) & ~mask;
+      addr = ((addr & ~tmp) << 1) | (addr & tmp);
+      mask = mask & (mask - 1);
+    }
+    return addr;
+  }
+
+  // Removes the bits of `addr` at every set bit of `mask`
+  uint64_t reduce(uint64_t addr, uint64_t mask)
+  {
+    while (mask) {
+      const uint64_t tmp = (mask - 1) & ~mask;
+      addr = (addr & tmp) | ((addr >> 1) & ~tmp);
+      mask = (mask & (mask - 1)) >> 1;
+    }
+    return addr;
+  }
+
+} // anonymous namespace
+
+// Claims whatever part of [a, b] is still free
+void MemoryMap::claim(std::map<uint64_t, Interval> & claimed, uint64_t a, uint64_t b, uint32_t desc)
+{
+  auto it = claimed.upper_bound(a);
+  if (it != claimed.begin()) {
+    const Interval & prev = std::prev(it)->second;
+    if (prev.end >= b) return;
+    if (prev.end >= a) a = prev.end + 1;
+  }
+  while (it != claimed.end() && it->first <= b) {
+    if (it->first > a) claimed[a] = Interval { a, it->first - 1, desc };
+    if (it->second.end >= b) return;
+    a = it->second.end + 1;
+    ++it;
+  }
+  claimed[a] = Interval { a, b, desc };
+}
+
+void MemoryMap::clear()
+{
+  descs_.clear();
+  intervals_.clear();
+  indexed_ = false;
+  last_ = 0;
+}
+
+void MemoryMap::set(const retro_memory_descriptor * descs, unsigned count)
+{
+  clear();
+
+  uint64_t top = 1;
+  for (unsigned i=0; i<count; i++) {
+    const retro_memory_descriptor & d = descs[i];
+    top |= d.select ? d.select : d.start + d.len - 1;
+  }
+  top = addBitsDown(top);
+
+  for (unsigned i=0; i<count; i++) {
+    const retro_memory_descriptor & d = descs[i];
+    Desc desc = { (const uint8_t *)d.ptr, d.offset, d.start, d.select, d.disconnect, d.len, (d.flags & RETRO_MEMDESC_BIGENDIAN) != 0 };
+
+    // Without select, len is a power of two and the block is mapped once
+    if (desc.select == 0) {
+      if (desc.len == 0 || (desc.len & (desc.len - 1)) != 0) continue;
+      desc.select = top & ~inflate(addBitsDown(desc.len - 1), desc.disconnect);
+    }
+    if (desc.len == 0) desc.len = addBitsDown(reduce(top & ~desc.select, desc.disconnect)) + 1;
+    if (desc.start & ~desc.select) continue;
+    if (!desc.ptr) continue; // Open bus, hardware registers
+    descs_.push_back(desc);
+  }
+
+  // The first descriptor to claim an address gets it; each one is laid out as aligned blocks of
+  // the size of the lowest select bit, one per combination of the free bits above
+  std::map<uint64_t, Interval> claimed;
+  indexed_ = true;
+  for (uint32_t i=0; i<descs_.size() && indexed_; i++) {
+    const Desc & desc = descs_[i];
+    const uint64_t free = top & ~desc.select;
+    const uint64_t blockSize = desc.select ? (desc.select & (~desc.select + 1)) : top + 1;
+    const uint64_t mirrors = free & ~(blockSize - 1);
+    if (popCount(mirrors) > MAX_MIRROR_BITS) {
+      indexed_ = false;
+      break;
+    }
+
+    uint64_t sub = 0;
+    do {
+      claim(claimed, desc.start | sub, (desc.start | sub) + blockSize - 1, i);
+      sub = (sub - mirrors) & mirrors;
+    } while (sub != 0);
+  }
+
+  if (indexed_) {
+    for (const auto & entry : claimed) {
+      const Interval & in = entry.second;
+      if (!intervals_.empty() && intervals_.back().desc == in.desc && intervals_.back().end + 1 == in.start) {
+        intervals_.back().end = in.end;
+      }
+      else {
+        intervals_.push_back(in);
+      }
+    }
+  }
+}
+
+const MemoryMap::Desc * MemoryMap::find(uint64_t addr) const
+{
+  if (!indexed_) {
+    for (const Desc & desc : descs_) {
+      if (((desc.start ^ addr) & desc.select) == 0) return &desc;
+    }
+    return nullptr;
+  }
+
+  if (intervals_.empty()) return nullptr;
+  if (last_ < intervals_.size()) {
+    const Interval & in = intervals_[last_];
+    if (addr >= in.start && addr <= in.end) return &descs_[in.desc];
+  }
+
+  auto it = std::upper_bound(intervals_.begin(), intervals_.end(), addr, [](uint64_t a, const Interval & in) {
+    return a < in.start;
+  });
+  if (it == intervals_.begin()) return nullptr;
+  --it;
+  if (addr > it->end) return nullptr;
+  last_ = it - intervals_.begin();
+  return &descs_[it->desc];
+}
+
+// Subtract start, pick off disconnect, apply len, add offset
+const uint8_t * MemoryMap::translate(const Desc & desc, uint64_t addr) const
+{
+  uint64_t off = reduce((addr - desc.start) & ~desc.select, desc.disconnect);
+  while (off >= desc.len) off -= highestBit(off);
+  return desc.ptr + desc.offset + off;
+}
+
+const uint8_t * MemoryMap::translate(uint64_t addr) const
+{
+  const Desc * desc = find(addr);
+  return desc ? translate(*desc, addr) : nullptr;
+}
+
+void MemoryMap::read(const uint32_t * addrs, size_t count, unsigned width, void * out) const
+{
+  uint8_t * dst = (uint8_t *)out;
+  for (size_t i=0; i<count; i++) {
+    const Desc * desc = find(addrs[i]);
+    const bool bigEndian = desc && desc->bigEndian;
+
+    uint32_t value = 0;
+    for (unsigned b=0; b<width; b++) {
+      const uint8_t * p = (b == 0) ? (desc ? translate(*desc, addrs[i]) : nullptr) : translate((uint64_t)addrs[i] + b);
+      const uint32_t byte = p ? *p : 0;
+      value |= byte << (8 * (bigEndian ? width - 1 - b : b));
+    }
+
+    switch (width) {
+      case 1: dst[i] = (uint8_t)value; break;
+      case 2: ((uint16_t *)dst)[i] = (uint16_t)value; break;
+      default: ((uint32_t *)dst)[i] = value; break;
+    }
+  }
+}
+
+size_t MemoryMap::readRange(uint64_t start, uint8_t * out, size_t size) const
+{
+  size_t mapped = 0;
+  for (size_t i=0; i<size; i++) {
+    const uint8_t * p = translate(start + i);
+    out[i] = p ? *p : 0;
+    if (p) mapped++;
+  }
+  return mapped;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <vector>
+
+struct retro_memory_descriptor;
+
+
+// MEMORY MAP
+//--------------------------------------------------------------------------------------------------
+
+// Address space of the emulated CPU as described by RETRO_ENVIRONMENT_SET_MEMORY_MAPS. Descriptors
+// are preprocessed like RetroArch does (missing select or len derived from the other), then their
+// mirrors are laid out as sorted intervals so a lookup is a binary search, or nothing at all when
+// it falls in the same interval as the previous one.
+// @note Address space names are not distinguished, everything lives in one space
+
+class MemoryMap
+{
+public:
+  void set(const retro_memory_descriptor * descs, unsigned count);
+  void clear();
+
+  size_t descriptors() const { return descs_.size(); }
+
+  // Host byte behind an emulated address
+  // @return nullptr if unmapped
+  const uint8_t * translate(uint64_t addr) const;
+
+  // Reads one value of `width` bytes (1, 2 or 4) per address into `out`, honoring
+  // RETRO_MEMDESC_BIGENDIAN; unmapped bytes read as 0
+  void read(const uint32_t * addrs, size_t count, unsigned width, void * out) const;
+
+  // @return Bytes actually mapped, the others read as 0
+  size_t readRange(uint64_t start, uint8_t * out, size_t size) const;
+
+private:
+  struct Desc
+  {
+    const uint8_t * ptr;
+    uint64_t offset;
+    uint64_t start;
+    uint64_t select;
+    uint64_t disconnect;
+    uint64_t len;
+    bool bigEndian;
+  };
+
+  // Addresses [start, end] claimed by a descriptor
+  struct Interval
+  {
+    uint64_t start;
+    uint64_t end;
+    uint32_t desc;
+  };
+
+  static void claim(std::map<uint64_t, Interval> & claimed, uint64_t a, uint64_t b, uint32_t desc);
+  const Desc * find(uint64_t addr) const;
+  const uint8_t * translate(const Desc & desc, uint64_t addr) const;
+
+  std::vector<Desc> descs_;
+  std::vector<Interval> intervals_;
+  bool indexed_ = false;    // Too many mirrors to lay out, descriptors are walked instead
+  mutable size_t last_ = 0; // Interval of the previous lookup
+};
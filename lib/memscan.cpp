@@ -0,0 +1,246 @@
+#include "memscan.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define MEMSCAN_SSE2 1
+  #include <emmintrin.h>
+#endif
+
+
+namespace
+{
+
+  inline uint32_t widthMask(unsigned width)
+  {
+    return width == 4 ? 0xFFFFFFFFu : (1u << (8 * width)) - 1;
+  }
+
+#if defined(_MSC_VER)
+  inline size_t popCount(uint64_t n)
+  {
+    return (size_t)__popcnt64(n);
+  }
+
+  inline unsigned lowestBit(uint64_t n)
+  {
+    unsigned long index;
+    _BitScanForward64(&index, n);
+    return (unsigned)index;
+  }
+#else
+  inline size_t popCount(uint64_t n)
+  {
+    return (size_t)__builtin_popcountll(n);
+  }
+
+  inline unsigned lowestBit(uint64_t n)
+  {
+    return (unsigned)__builtin_ctzll(n);
+  }
+#endif
+
+#if MEMSCAN_SSE2
+
+  // Lanes compared as numbers need the byte order of the host
+  inline __m128i toHostOrder(__m128i v, unsigned width, bool bigEndian)
+  {
+    if (!bigEndian || width == 1) return v;
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    if (width == 4) v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+    return v;
+  }
+
+  inline __m128i set1(uint32_t value, unsigned width)
+  {
+    switch (width) {
+      case 1: return _mm_set1_epi8((char)value);
+      case 2: return _mm_set1_epi16((short)value);
+      default: return _mm_set1_epi32((int)value);
+    }
+  }
+
+  inline __m128i cmpEq(__m128i a, __m128i b, unsigned width)
+  {
+    switch (width) {
+      case 1: return _mm_cmpeq_epi8(a, b);
+      case 2: return _mm_cmpeq_epi16(a, b);
+      default: return _mm_cmpeq_epi32(a, b);
+    }
+  }
+
+  // Unsigned a > b, SSE2 only compares signed lanes
+  inline __m128i cmpGt(__m128i a, __m128i b, unsigned width)
+  {
+    const __m128i sign = set1(1u << (8 * width - 1), width);
+    a = _mm_xor_si128(a, sign);
+    b = _mm_xor_si128(b, sign);
+    switch (width) {
+      case 1: return _mm_cmpgt_epi8(a, b);
+      case 2: return _mm_cmpgt_epi16(a, b);
+      default: return _mm_cmpgt_epi32(a, b);
+    }
+  }
+
+  inline __m128i add(__m128i a, __m128i b, unsigned width)
+  {
+    switch (width) {
+      case 1: return _mm_add_epi8(a, b);
+      case 2: return _mm_add_epi16(a, b);
+      default: return _mm_add_epi32(a, b);
+    }
+  }
+
+  // One bit per lane of a compare result
+  inline uint32_t laneMask(__m128i m, unsigned width)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    switch (width) {
+      case 1: return (uint32_t)_mm_movemask_epi8(m);
+      case 2: return (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(m, zero)) & 0xFF;
+      default: return (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(_mm_packs_epi32(m, zero), zero)) & 0xF;
+    }
+  }
+
+#endif
+
+} // anonymous namespace
+
+void MemoryScanner::reset(const uint8_t * data, size_t size, unsigned width, bool bigEndian, bool aligned)
+{
+  width_ = (width == 2 || width == 4) ? width : 1;
+  step_ = aligned ? width_ : 1;
+  bigEndian_ = bigEndian;
+  snapshot_.assign(data, data + size);
+
+  positions_ = (size >= width_) ? (size - width_) / step_ + 1 : 0;
+  candidates_.assign((positions_ + 63) / 64, ~0ull);
+  if (positions_ % 64) candidates_.back() = (1ull << (positions_ % 64)) - 1;
+}
+
+void MemoryScanner::clear()
+{
+  snapshot_.clear();
+  candidates_.clear();
+  positions_ = 0;
+}
+
+uint32_t MemoryScanner::valueAt(const uint8_t * data, size_t offset) const
+{
+  const uint8_t * p = data + offset;
+  switch (width_) {
+    case 1: return p[0];
+    case 2: return bigEndian_ ? (uint32_t)(p[0] << 8 | p[1]) : (uint32_t)(p[1] << 8 | p[0]);
+    default: return bigEndian_ ? ((uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3])
+      : ((uint32_t)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0]);
+  }
+}
+
+bool MemoryScanner::match(ScanOp op, uint32_t cur, uint32_t prev, uint32_t value) const
+{
+  switch (op) {
+    case SCAN_EQUAL: return cur == value;
+    case SCAN_NOT_EQUAL: return cur != value;
+    case SCAN_GREATER: return cur > value;
+    case SCAN_LESS: return cur < value;
+    case SCAN_CHANGED: return cur != prev;
+    case SCAN_UNCHANGED: return cur == prev;
+    case SCAN_INCREASED: return cur > prev;
+    case SCAN_DECREASED: return cur < prev;
+    case SCAN_DELTA: return ((cur - prev) & widthMask(width_)) == value;
+    default: return false;
+  }
+}
+
+void MemoryScanner::filterScalar(const uint8_t * data, ScanOp op, uint32_t value, size_t from)
+{
+  for (size_t w=from/64; w<candidates_.size(); w++) {
+    uint64_t bits = candidates_[w];
+    if (w == from / 64) bits &= ~0ull << (from % 64);
+    for (; bits; bits &= bits - 1) {
+      const size_t k = w * 64 + lowestBit(bits);
+      const size_t offset = k * step_;
+      if (!match(op, valueAt(data, offset), valueAt(snapshot_.data(), offset), value)) {
+        candidates_[w] &= ~(1ull << (k % 64));
+      }
+    }
+  }
+}
+
+// 16 bytes at a time for aligned positions
+// @return First position left to the scalar loop
+size_t MemoryScanner::filterSimd(const uint8_t * data, ScanOp op, uint32_t value)
+{
+#if MEMSCAN_SSE2
+  if (step_ != width_) return 0;
+
+  const unsigned lanes = 16 / width_;
+  const size_t blocks = snapshot_.size() / 16;
+  const __m128i valueVec = set1(value & widthMask(width_), width_);
+
+  for (size_t b=0; b<blocks; b++) {
+    const size_t k = b * lanes;
+    uint64_t & word = candidates_[k / 64];
+    const unsigned shift = k % 64;
+    const uint64_t laneBits = ((lanes == 64) ? ~0ull : ((1ull << lanes) - 1)) << shift;
+    if ((word & laneBits) == 0) continue; // Nothing left to filter here
+
+    const __m128i cur = toHostOrder(_mm_loadu_si128((const __m128i *)(data + b * 16)), width_, bigEndian_);
+    const __m128i prev = toHostOrder(_mm_loadu_si128((const __m128i *)(snapshot_.data() + b * 16)), width_, bigEndian_);
+
+    __m128i m;
+    switch (op) {
+      case SCAN_EQUAL: m = cmpEq(cur, valueVec, width_); break;
+      case SCAN_NOT_EQUAL: m = _mm_andnot_si128(cmpEq(cur, valueVec, width_), _mm_set1_epi8(-1)); break;
+      case SCAN_GREATER: m = cmpGt(cur, valueVec, width_); break;
+      case SCAN_LESS: m = cmpGt(valueVec, cur, width_); break;
+      case SCAN_CHANGED: m = _mm_andnot_si128(cmpEq(cur, prev, width_), _mm_set1_epi8(-1)); break;
+      case SCAN_UNCHANGED: m = cmpEq(cur, prev, width_); break;
+      case SCAN_INCREASED: m = cmpGt(cur, prev, width_); break;
+      case SCAN_DECREASED: m = cmpGt(prev, cur, width_); break;
+      case SCAN_DELTA: m = cmpEq(cur, add(prev, valueVec, width_), width_); break;
+      default: m = _mm_setzero_si128(); break;
+    }
+    word &= ~laneBits | ((uint64_t)laneMask(m, width_) << shift);
+  }
+  return blocks * lanes;
+#else
+  return 0;
+#endif
+}
+
+size_t MemoryScanner::filter(const uint8_t * data, ScanOp op, uint32_t value)
+{
+  value &= widthMask(width_);
+  const size_t done = filterSimd(data, op, value);
+  if (done < positions_) filterScalar(data, op, value, done);
+
+  memcpy(snapshot_.data(), data, snapshot_.size());
+  return count();
+}
+
+size_t MemoryScanner::count() const
+{
+  size_t count = 0;
+  for (const uint64_t word : candidates_) count += popCount(word);
+  return count;
+}
+
+size_t MemoryScanner::results(uint32_t * offsets, uint32_t * values, size_t max) const
+{
+  size_t n = 0;
+  for (size_t w=0; w<candidates_.size() && n<max; w++) {
+    for (uint64_t bits = candidates_[w]; bits && n<max; bits &= bits - 1) {
+      const size_t offset = (w * 64 + lowestBit(bits)) * step_;
+      offsets[n] = (uint32_t)offset;
+      if (values) values[n] = valueAt(snapshot_.data(), offset);
+      n++;
+    }
+  }
+  return n;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+
+// MEMORY SCANNER
+//--------------------------------------------------------------------------------------------------
+
+// Narrows down where a game keeps a variable: every position of a memory region starts as a
+// candidate, each filter compares the current memory with a value or with the snapshot taken by
+// the previous filter, and drops the candidates which do not match.
+
+enum ScanOp
+{
+  SCAN_EQUAL,      // Current == value
+  SCAN_NOT_EQUAL,
+  SCAN_GREATER,    // Current > value, unsigned
+  SCAN_LESS,
+  SCAN_CHANGED,    // Current != previous
+  SCAN_UNCHANGED,
+  SCAN_INCREASED,  // Current > previous, unsigned
+  SCAN_DECREASED,
+  SCAN_DELTA,      // Current - previous == value, wrapping
+  SCAN_OP_COUNT
+};
+
+class MemoryScanner
+{
+public:
+  // Every position is a candidate again, `data` is the first snapshot
+  // @param width 1, 2 or 4 bytes
+  // @param aligned Only positions multiple of `width`, otherwise every byte
+  void reset(const uint8_t * data, size_t size, unsigned width, bool bigEndian, bool aligned);
+
+  // No snapshot and no candidates, until the next reset
+  void clear();
+
+  // @return Candidates left
+  size_t filter(const uint8_t * data, ScanOp op, uint32_t value);
+
+  size_t size() const { return snapshot_.size(); }
+  size_t count() const;
+
+  // Byte offsets of the first `max` candidates and their value in the last snapshot
+  // @param values May be null
+  size_t results(uint32_t * offsets, uint32_t * values, size_t max) const;
+
+private:
+  uint32_t valueAt(const uint8_t * data, size_t offset) const;
+  bool match(ScanOp op, uint32_t cur, uint32_t prev, uint32_t value) const;
+  void filterScalar(const uint8_t * data, ScanOp op, uint32_t value, size_t from);
+  size_t filterSimd(const uint8_t * data, ScanOp op, uint32_t value);
+
+  std::vector<uint8_t> snapshot_;
+  std::vector<uint64_t> candidates_; // Bit per position
+  size_t positions_ = 0;
+  unsigned width_ = 1;
+  unsigned step_ = 1;
+  bool bigEndian_ = false;
+};
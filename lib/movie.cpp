@@ -0,0 +1,248 @@
+#include "movie.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "compress.h"
+
+
+namespace
+{
+
+  const char MAGIC[4] = { 'R', 'M', 'O', 'V' };
+  const uint32_t VERSION = 1;
+
+  const uint8_t RECORD_INPUT = 'F';
+  const uint8_t RECORD_SAME_INPUT = 'S';
+  const uint8_t RECORD_KEYFRAME = 'K';
+
+  // Little endian on disk, like every platform this runs on
+  struct MovieFileHeader
+  {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t inputValues;
+    uint32_t keyframeInterval;
+    uint32_t romCrc;
+    uint64_t romSize;
+    uint64_t frames;
+    char coreName[64];
+    char coreVersion[64];
+    char romName[128];
+  };
+
+  static_assert(sizeof(MovieFileHeader) == 296, "MovieFileHeader layout changed");
+
+  struct KeyframeHeader
+  {
+    uint64_t frame;
+    uint64_t stateSize;
+    uint64_t encodedSize;
+  };
+
+  template<size_t N>
+  void copyField(char (&dst)[N], const std::string & src)
+  {
+    memset(dst, 0, N);
+    memcpy(dst, src.c_str(), std::min(src.size(), N - 1));
+  }
+
+  template<size_t N>
+  std::string readField(const char (&src)[N])
+  {
+    return std::string(src, strnlen(src, N));
+  }
+
+  MovieFileHeader makeHeader(const MovieInfo & info)
+  {
+    MovieFileHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.headerSize = sizeof(MovieFileHeader);
+    header.inputValues = info.inputValues;
+    header.keyframeInterval = info.keyframeInterval;
+    header.romCrc = info.romCrc;
+    header.romSize = info.romSize;
+    header.frames = info.frames;
+    copyField(header.coreName, info.coreName);
+    copyField(header.coreVersion, info.coreVersion);
+    copyField(header.romName, info.romName);
+    return header;
+  }
+
+} // anonymous namespace
+
+MovieWriter::~MovieWriter()
+{
+  std::string error;
+  close(error);
+}
+
+bool MovieWriter::open(const std::string & path, const MovieInfo & info, const uint8_t * state, size_t stateSize, std::string & error)
+{
+  file_ = fopen(path.c_str(), "wb");
+  if (!file_) {
+    error = "Cannot create " + path;
+    return false;
+  }
+  setvbuf(file_, NULL, _IOFBF, 1 << 16);
+
+  info_ = info;
+  info_.frames = 0;
+  last_.clear();
+  ok_ = true;
+
+  const MovieFileHeader header = makeHeader(info_);
+  ok_ = fwrite(&header, sizeof(header), 1, file_) == 1;
+  keyframe(0, state, stateSize);
+  if (!ok_) error = "Cannot write " + path;
+  return ok_;
+}
+
+void MovieWriter::frame(const int32_t * input)
+{
+  if (!file_) return;
+
+  if (last_.size() == info_.inputValues && std::equal(last_.begin(), last_.end(), input)) {
+    ok_ = (fputc(RECORD_SAME_INPUT, file_) != EOF) && ok_;
+  }
+  else {
+    last_.assign(input, input + info_.inputValues);
+    ok_ = (fputc(RECORD_INPUT, file_) != EOF) && ok_;
+    ok_ = (fwrite(input, sizeof(int32_t), info_.inputValues, file_) == info_.inputValues) && ok_;
+  }
+  info_.frames++;
+}
+
+void MovieWriter::keyframe(uint64_t frame, const uint8_t * state, size_t stateSize)
+{
+  if (!file_) return;
+
+  scratch_.clear();
+  deltaEncode(state, nullptr, stateSize, scratch_);
+
+  const KeyframeHeader kf = { frame, stateSize, scratch_.size() };
+  ok_ = (fputc(RECORD_KEYFRAME, file_) != EOF) && ok_;
+  ok_ = (fwrite(&kf, sizeof(kf), 1, file_) == 1) && ok_;
+  ok_ = (fwrite(scratch_.data(), 1, scratch_.size(), file_) == scratch_.size()) && ok_;
+}
+
+bool MovieWriter::close(std::string & error)
+{
+  if (!file_) return true;
+
+  // Patch the frame count now that it is known
+  const MovieFileHeader header = makeHeader(info_);
+  ok_ = (fseek(file_, 0, SEEK_SET) == 0) && ok_;
+  ok_ = (fwrite(&header, sizeof(header), 1, file_) == 1) && ok_;
+  ok_ = (fclose(file_) == 0) && ok_;
+  file_ = nullptr;
+
+  if (!ok_) error = "Cannot write movie";
+  return ok_;
+}
+
+bool MovieReader::open(const std::string & path, std::string & error)
+{
+  inputOffsets_.clear();
+  keyframes_.clear();
+
+  if (!file_.open(path)) {
+    error = "Cannot open " + path;
+    return false;
+  }
+
+  MovieFileHeader header;
+  if (file_.size() < sizeof(header)) {
+    error = "Not a movie file: " + path;
+    return false;
+  }
+  memcpy(&header, file_.data(), sizeof(header));
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.headerSize < sizeof(header)) {
+    error = "Not a movie file: " + path;
+    return false;
+  }
+  if (header.version != VERSION) {
+    error = "Unsupported movie version " + std::to_string(header.version);
+    return false;
+  }
+
+  info_.coreName = readField(header.coreName);
+  info_.coreVersion = readField(header.coreVersion);
+  info_.romName = readField(header.romName);
+  info_.romSize = header.romSize;
+  info_.romCrc = header.romCrc;
+  info_.inputValues = header.inputValues;
+  info_.keyframeInterval = header.keyframeInterval;
+
+  // Index every record; a recording which was not closed properly is still usable up to its
+  // last complete record
+  const uint8_t * data = file_.data();
+  const size_t size = file_.size();
+  const size_t inputSize = header.inputValues * sizeof(int32_t);
+  size_t pos = header.headerSize;
+  size_t lastInput = 0;
+  bool hasInput = false;
+
+  while (pos < size) {
+    const uint8_t type = data[pos++];
+    if (type == RECORD_INPUT) {
+      if (size - pos < inputSize) break;
+      lastInput = pos;
+      hasInput = true;
+      inputOffsets_.push_back(pos);
+      pos += inputSize;
+    }
+    else if (type == RECORD_SAME_INPUT) {
+      if (!hasInput) break;
+      inputOffsets_.push_back(lastInput);
+    }
+    else if (type == RECORD_KEYFRAME) {
+      KeyframeHeader kf;
+      if (size - pos < sizeof(kf)) break;
+      memcpy(&kf, data + pos, sizeof(kf));
+      pos += sizeof(kf);
+      if (size - pos < kf.encodedSize) break;
+      keyframes_.push_back(Keyframe { kf.frame, kf.stateSize, pos, (size_t)kf.encodedSize });
+      pos += kf.encodedSize;
+    }
+    else {
+      break;
+    }
+  }
+
+  if (keyframes_.empty() || keyframes_[0].frame != 0) {
+    error = "Movie has no starting state: " + path;
+    return false;
+  }
+
+  info_.frames = inputOffsets_.size();
+  return true;
+}
+
+void MovieReader::input(uint64_t frame, int32_t * input) const
+{
+  if (frame >= inputOffsets_.size()) {
+    std::fill(input, input + info_.inputValues, 0);
+    return;
+  }
+  memcpy(input, file_.data() + inputOffsets_[frame], info_.inputValues * sizeof(int32_t));
+}
+
+uint64_t MovieReader::keyframe(uint64_t frame, size_t stateSize, std::vector<uint8_t> & state) const
+{
+  // Keyframes are written in frame order
+  auto it = std::upper_bound(keyframes_.begin(), keyframes_.end(), frame, [](uint64_t f, const Keyframe & kf) {
+    return f < kf.frame;
+  });
+  const Keyframe & kf = *(it - 1);
+
+  if (kf.stateSize != stateSize) {
+    state.clear();
+    return kf.frame;
+  }
+  state.assign(kf.stateSize, 0);
+  if (!deltaApply(file_.data() + kf.offset, kf.size, state.data(), state.size())) state.clear();
+  return kf.frame;
+}
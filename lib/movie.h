@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+
+
+// INPUT MOVIES
+//--------------------------------------------------------------------------------------------------
+
+// Layout: header, then one record per frame (its input, or a marker when it did not change) and
+// keyframe records holding a state to seek from. The state the recording started from is the
+// keyframe of frame 0.
+
+struct MovieInfo
+{
+  std::string coreName;
+  std::string coreVersion;
+  std::string romName;
+  uint64_t romSize = 0;
+  uint32_t romCrc = 0;
+  uint32_t inputValues = 0;      // int32_t per frame
+  uint32_t keyframeInterval = 0;
+  uint64_t frames = 0;
+};
+
+class MovieWriter
+{
+public:
+  ~MovieWriter();
+
+  // Starts a movie from the given state
+  bool open(const std::string & path, const MovieInfo & info, const uint8_t * state, size_t stateSize, std::string & error);
+
+  // Input consumed by the core during the next frame, info.inputValues values
+  void frame(const int32_t * input);
+
+  // State before emulating `frame`
+  void keyframe(uint64_t frame, const uint8_t * state, size_t stateSize);
+
+  // Writes the final frame count
+  bool close(std::string & error);
+
+  uint64_t frames() const { return info_.frames; }
+  const MovieInfo & info() const { return info_; }
+
+private:
+  FILE * file_ = nullptr;
+  MovieInfo info_;
+  std::vector<int32_t> last_;
+  std::vector<uint8_t> scratch_;
+  bool ok_ = true;
+};
+
+class MovieReader
+{
+public:
+  bool open(const std::string & path, std::string & error);
+
+  const MovieInfo & info() const { return info_; }
+  uint64_t frames() const { return info_.frames; }
+
+  // Copies the input of `frame` into `input`, info().inputValues values
+  void input(uint64_t frame, int32_t * input) const;
+
+  // Decodes the last keyframe at or before `frame`
+  // @param stateSize State size of the running core; `state` is left empty, without allocating,
+  //                  if the keyframe's differs
+  // @return Frame of the keyframe
+  uint64_t keyframe(uint64_t frame, size_t stateSize, std::vector<uint8_t> & state) const;
+
+private:
+  struct Keyframe
+  {
+    uint64_t frame;
+    uint64_t stateSize;
+    size_t offset;
+    size_t size;
+  };
+
+  MappedFile file_;
+  MovieInfo info_;
+  std::vector<size_t> inputOffsets_; // Per frame, in the mapping
+  std::vector<Keyframe> keyframes_;
+};
@@ -0,0 +1,372 @@
+#include "netplay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#if WIN32
+  #include <winsock2.h>
+  #include <ws2tcpip.h>
+  typedef SOCKET socket_t;
+  typedef int socklen_t;
+  #define closesocket_ closesocket
+#else
+  #include <arpa/inet.h>
+  #include <fcntl.h>
+  #include <netdb.h>
+  #include <netinet/in.h>
+  #include <sys/socket.h>
+  #include <unistd.h>
+  typedef int socket_t;
+  #define closesocket_ close
+#endif
+
+
+namespace
+{
+
+  const uint32_t MAGIC = 0x4c504e52; // "RNPL"
+  const size_t MAX_PACKET_FRAMES = 64;
+  const size_t MAX_PACKET_SIZE = 1 << 16;
+
+  // Every packet repeats the local input the remote player has not acknowledged yet, so lost
+  // packets need no retransmission
+  struct PacketHeader
+  {
+    uint32_t magic;
+    uint16_t inputValues;
+    uint16_t count;      // Frames of input following the header
+    uint32_t start;      // Frame of the first one
+    uint32_t frame;      // Sender's current frame
+    uint32_t ack;        // Frames of input received from the destination
+    uint32_t holdUs;     // Time since `echoUs` was received
+    int64_t sendUs;      // Sender's clock
+    int64_t echoUs;      // Last `sendUs` received from the destination
+  };
+
+  inline int64_t nowUs()
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  inline double elapsedUs(int64_t start)
+  {
+    return (double)(nowUs() - start);
+  }
+
+  inline socket_t sock(intptr_t s)
+  {
+    return (socket_t)s;
+  }
+
+  // Compares the parts of an IPv4 address that identify the peer, the rest is padding
+  bool samePeer(const sockaddr_storage & from, socklen_t fromLen, const std::vector<uint8_t> & peer)
+  {
+    if (peer.size() < sizeof(sockaddr_in) || (size_t)fromLen != peer.size()) return false;
+    sockaddr_in a, b;
+    memcpy(&a, &from, sizeof(a));
+    memcpy(&b, peer.data(), sizeof(b));
+    return a.sin_family == b.sin_family && a.sin_port == b.sin_port && a.sin_addr.s_addr == b.sin_addr.s_addr;
+  }
+
+#if WIN32
+  bool socketInit()
+  {
+    static bool initialized = false;
+    if (!initialized) {
+      WSADATA wsa;
+      initialized = (WSAStartup(MAKEWORD(2, 2), &wsa) == 0);
+    }
+    return initialized;
+  }
+
+  bool setNonBlocking(socket_t s)
+  {
+    u_long mode = 1;
+    return ioctlsocket(s, FIONBIO, &mode) == 0;
+  }
+#else
+  bool socketInit()
+  {
+    return true;
+  }
+
+  bool setNonBlocking(socket_t s)
+  {
+    const int flags = fcntl(s, F_GETFL, 0);
+    return flags != -1 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+  }
+#endif
+
+} // anonymous namespace
+
+NetplaySession::NetplaySession(const NetplayConfig & config, SaveFn save, LoadFn load, RunFn run)
+  : config_(config), save_(save), load_(load), run_(run), rng_(std::random_device()())
+{
+  config_.maxRollback = std::max<size_t>(1, std::min(config_.maxRollback, INPUT_RING / 4));
+  config_.inputDelay = std::min(config_.inputDelay, INPUT_RING / 4);
+  if (config_.fps <= 0.0) config_.fps = 60.0;
+
+  localInputs_.assign(INPUT_RING * config_.inputValues, 0);
+  remoteInputs_.assign(INPUT_RING * config_.inputValues, 0);
+  usedRemote_.assign(INPUT_RING * config_.inputValues, 0);
+  frameInput_.assign(2 * config_.inputValues, 0);
+  states_.resize(config_.maxRollback + 1);
+
+  // The first frames run without local input, as if it had been held back before the session
+  localCount_ = config_.inputDelay;
+}
+
+NetplaySession::~NetplaySession()
+{
+  if (socket_ != -1) closesocket_(sock(socket_));
+}
+
+bool NetplaySession::open(std::string & error)
+{
+  if (!socketInit()) {
+    error = "Cannot initialize sockets";
+    return false;
+  }
+
+  const socket_t s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (s == (socket_t)-1) {
+    error = "Cannot create socket";
+    return false;
+  }
+  socket_ = (intptr_t)s;
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(config_.localPort);
+  if (bind(s, (const sockaddr *)&addr, sizeof(addr)) != 0) {
+    error = "Cannot bind UDP port " + std::to_string(config_.localPort);
+    return false;
+  }
+  if (!setNonBlocking(s)) {
+    error = "Cannot make socket non blocking";
+    return false;
+  }
+  return true;
+}
+
+uint16_t NetplaySession::localPort() const
+{
+  sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  if (getsockname(sock(socket_), (sockaddr *)&addr, &len) != 0) return 0;
+  return ntohs(addr.sin_port);
+}
+
+bool NetplaySession::connect(const std::string & host, uint16_t port, std::string & error)
+{
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  addrinfo * res = nullptr;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res) {
+    error = "Cannot resolve " + host;
+    return false;
+  }
+  const uint8_t * addr = (const uint8_t *)res->ai_addr;
+  remoteAddr_.assign(addr, addr + res->ai_addrlen);
+  freeaddrinfo(res);
+  return true;
+}
+
+bool NetplaySession::update(const int32_t * localInput)
+{
+  if (stats_.desynced) return false;
+  receive();
+
+  // Input of a frame is only taken once, it may have been sent already
+  if (localCount_ <= frame_ + config_.inputDelay) {
+    std::copy(localInput, localInput + config_.inputValues, inputAt(localInputs_, localCount_));
+    localCount_++;
+  }
+
+  if (rollbackTo_ != NONE && !rollback()) return false;
+
+  // Too far ahead of the remote input, or of the remote player (the slower peer would otherwise
+  // keep rolling back); waiting every other update lets it catch up smoothly
+  const bool blocked = frame_ >= remoteCount_ + config_.maxRollback;
+  const bool ahead = stats_.frameAdvantage > 1 && !syncWait_;
+  syncWait_ = !blocked && ahead;
+  if (blocked || ahead) {
+    stats_.stalls++;
+    send();
+    return false;
+  }
+
+  if (!advance(false)) return false;
+  stats_.frames++;
+  send();
+  return true;
+}
+
+bool NetplaySession::advance(bool resim)
+{
+  // Frames whose remote input is known are never rolled back to
+  if (frame_ >= remoteCount_) {
+    const int64_t start = nowUs();
+    const bool saved = save_(states_[frame_ % states_.size()]);
+    stats_.saveUs += elapsedUs(start);
+    if (!saved) {
+      stats_.desynced = true;
+      return false;
+    }
+  }
+
+  const size_t iv = config_.inputValues;
+  const int32_t * local = inputAt(localInputs_, frame_);
+  const int32_t * remote = (frame_ < remoteCount_) ? inputAt(remoteInputs_, frame_)
+    : remoteCount_ ? inputAt(remoteInputs_, remoteCount_ - 1) : nullptr;
+
+  int32_t * used = inputAt(usedRemote_, frame_);
+  if (remote) std::copy(remote, remote + iv, used);
+  else std::fill(used, used + iv, 0);
+
+  int32_t * input = frameInput_.data();
+  std::copy(local, local + iv, input + config_.player * iv);
+  std::copy(used, used + iv, input + (1 - config_.player) * iv);
+  run_(input, resim);
+  frame_++;
+  return true;
+}
+
+bool NetplaySession::rollback()
+{
+  const int64_t start = nowUs();
+  const size_t target = frame_;
+  const size_t depth = target - rollbackTo_;
+
+  // Re-simulating from the current state would silently diverge from the remote player
+  if (!load_(states_[rollbackTo_ % states_.size()])) {
+    stats_.desynced = true;
+    return false;
+  }
+  frame_ = rollbackTo_;
+  rollbackTo_ = NONE;
+  while (frame_ < target) {
+    if (!advance(true)) return false;
+  }
+
+  const double us = elapsedUs(start);
+  stats_.rollbacks++;
+  stats_.rollbackFrames += depth;
+  stats_.rollbackMax = std::max(stats_.rollbackMax, depth);
+  stats_.resimUs += us;
+  stats_.resimUsMax = std::max(stats_.resimUsMax, us);
+  return true;
+}
+
+void NetplaySession::receive()
+{
+  const size_t iv = config_.inputValues;
+  packet_.resize(MAX_PACKET_SIZE);
+
+  for (;;) {
+    sockaddr_storage from;
+    socklen_t fromLen = sizeof(from);
+    const int len = (int)recvfrom(sock(socket_), (char *)packet_.data(), (int)packet_.size(), 0, (sockaddr *)&from, &fromLen);
+    if (len < 0) break;
+
+    // Anything not sent by the connected peer could inject input and desync the session
+    if (len < (int)sizeof(PacketHeader) || !samePeer(from, fromLen, remoteAddr_)) continue;
+
+    PacketHeader hdr;
+    memcpy(&hdr, packet_.data(), sizeof(hdr));
+    if (hdr.magic != MAGIC || hdr.inputValues != iv) continue;
+    if ((size_t)len < sizeof(hdr) + hdr.count * iv * sizeof(int32_t)) continue;
+    stats_.packetsReceived++;
+
+    const int64_t now = nowUs();
+    remoteFrame_ = std::max<size_t>(remoteFrame_, hdr.frame);
+    remoteAck_ = std::max<size_t>(remoteAck_, hdr.ack);
+    peerSendUs_ = hdr.sendUs;
+    peerRecvUs_ = now;
+    if (hdr.echoUs) {
+      const double rtt = (double)(now - hdr.echoUs - hdr.holdUs);
+      stats_.rttUs = stats_.rttUs ? stats_.rttUs * 0.9 + rtt * 0.1 : rtt;
+    }
+
+    // Input is only taken in order, a gap waits for a packet starting earlier
+    const uint8_t * data = packet_.data() + sizeof(hdr);
+    for (size_t i=0; i<hdr.count; i++) {
+      const size_t f = hdr.start + i;
+      if (f < remoteCount_) continue;
+      if (f > remoteCount_ || f >= frame_ + INPUT_RING / 2) break;
+
+      int32_t * dst = inputAt(remoteInputs_, f);
+      memcpy(dst, data + i * iv * sizeof(int32_t), iv * sizeof(int32_t));
+      if (f < frame_ && !std::equal(dst, dst + iv, inputAt(usedRemote_, f))) {
+        rollbackTo_ = std::min(rollbackTo_, f);
+      }
+      remoteCount_++;
+    }
+  }
+
+  // Half the round trip has passed since the remote player reported its frame
+  const double framesInFlight = stats_.rttUs / 2.0 * config_.fps / 1e6;
+  stats_.frameAdvantage = (int64_t)frame_ - (int64_t)(remoteFrame_ + (size_t)framesInFlight);
+}
+
+void NetplaySession::send()
+{
+  const int64_t now = nowUs();
+  const size_t iv = config_.inputValues;
+  const size_t start = std::min(remoteAck_, localCount_);
+  const size_t count = std::min(localCount_ - start, MAX_PACKET_FRAMES);
+
+  PacketHeader hdr;
+  hdr.magic = MAGIC;
+  hdr.inputValues = (uint16_t)iv;
+  hdr.count = (uint16_t)count;
+  hdr.start = (uint32_t)start;
+  hdr.frame = (uint32_t)frame_;
+  hdr.ack = (uint32_t)remoteCount_;
+  hdr.holdUs = peerRecvUs_ ? (uint32_t)(now - peerRecvUs_) : 0;
+  hdr.sendUs = now;
+  hdr.echoUs = peerSendUs_;
+
+  Outgoing out;
+  out.data.resize(sizeof(hdr) + count * iv * sizeof(int32_t));
+  memcpy(out.data.data(), &hdr, sizeof(hdr));
+  for (size_t i=0; i<count; i++) {
+    memcpy(out.data.data() + sizeof(hdr) + i * iv * sizeof(int32_t), inputAt(localInputs_, start + i), iv * sizeof(int32_t));
+  }
+
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  if (config_.loss > 0.0 && uniform(rng_) < config_.loss) {
+    stats_.packetsLost++;
+  }
+  else {
+    const double delayMs = config_.latencyMs + config_.jitterMs * (uniform(rng_) * 2.0 - 1.0);
+    out.releaseUs = now + (int64_t)(std::max(0.0, delayMs) * 1000.0);
+    outgoing_.push_back(std::move(out));
+  }
+  flush(now);
+}
+
+void NetplaySession::flush(int64_t now)
+{
+  if (remoteAddr_.empty()) {
+    outgoing_.clear();
+    return;
+  }
+
+  // With jitter, packets may leave out of order, like on a real network
+  for (auto it = outgoing_.begin(); it != outgoing_.end();) {
+    if (it->releaseUs > now) {
+      ++it;
+      continue;
+    }
+    sendto(sock(socket_), (const char *)it->data.data(), (int)it->data.size(), 0, (const sockaddr *)remoteAddr_.data(), (socklen_t)remoteAddr_.size());
+    stats_.packetsSent++;
+    it = outgoing_.erase(it);
+  }
+}
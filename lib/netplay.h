@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+
+// ROLLBACK NETPLAY
+//--------------------------------------------------------------------------------------------------
+
+// Two players exchange their input over UDP. Frames run as soon as the local input is known, the
+// remote input being predicted as unchanged; once the actual input arrives and differs, the state
+// saved before the first mispredicted frame is restored and the frames since are emulated again.
+
+struct NetplayConfig
+{
+  unsigned player = 0;         // Local player, 0 or 1
+  uint16_t localPort = 0;      // 0 picks any free port
+  std::string remoteHost;
+  uint16_t remotePort = 0;
+  size_t inputValues = 0;      // int32_t per player and frame
+  size_t inputDelay = 1;       // Frames local input is held back, hiding that much latency
+  size_t maxRollback = 8;      // Frames run ahead of the remote input before waiting for it
+  double fps = 60.0;
+
+  // Simulated network conditions, applied to outgoing packets when they are flushed, once per
+  // update
+  double latencyMs = 0.0;
+  double jitterMs = 0.0;
+  double loss = 0.0;           // Probability a packet is dropped
+};
+
+struct NetplayStats
+{
+  size_t frames = 0;           // Frames emulated, not counting re-simulation
+  size_t stalls = 0;           // Updates waiting for the remote player
+  size_t rollbacks = 0;
+  size_t rollbackFrames = 0;   // Frames emulated again
+  size_t rollbackMax = 0;      // Deepest rollback, in frames
+  double resimUs = 0;          // Restoring and re-simulating, in total
+  double resimUsMax = 0;
+  double saveUs = 0;           // Saving states to roll back to, in total
+  size_t packetsSent = 0;
+  size_t packetsReceived = 0;
+  size_t packetsLost = 0;      // Dropped by the simulated network
+  double rttUs = 0;            // Smoothed round trip time
+  int64_t frameAdvantage = 0;  // Local frame minus the estimated remote one
+  bool desynced = false;       // A state failed to save or restore, the session has stopped
+};
+
+class NetplaySession
+{
+public:
+  // Serializes the state before a frame, or restores it
+  typedef std::function<bool(std::vector<uint8_t> & state)> SaveFn;
+  typedef std::function<bool(const std::vector<uint8_t> & state)> LoadFn;
+
+  // Emulates a frame with the input of both players, inputValues each, player 0 first
+  // @param resim Frame emulated again after a rollback, producing no output
+  typedef std::function<void(const int32_t * input, bool resim)> RunFn;
+
+  NetplaySession(const NetplayConfig & config, SaveFn save, LoadFn load, RunFn run);
+  ~NetplaySession();
+
+  NetplaySession(const NetplaySession &) = delete;
+  NetplaySession & operator=(const NetplaySession &) = delete;
+
+  // Binds the local port
+  bool open(std::string & error);
+  uint16_t localPort() const;
+
+  bool connect(const std::string & host, uint16_t port, std::string & error);
+
+  // Exchanges input, rolls back if needed then emulates the next frame with `localInput`
+  // @return false if the frame was held back waiting for the remote player, or the session has
+  //         stopped after a desync
+  bool update(const int32_t * localInput);
+
+  size_t frame() const { return frame_; }
+  const NetplayStats & stats() const { return stats_; }
+
+private:
+  static const size_t INPUT_RING = 256; // Frames of input kept per player
+  static const size_t NONE = (size_t)-1;
+
+  struct Outgoing
+  {
+    int64_t releaseUs;
+    std::vector<uint8_t> data;
+  };
+
+  int32_t * inputAt(std::vector<int32_t> & ring, size_t frame)
+  {
+    return ring.data() + (frame % INPUT_RING) * config_.inputValues;
+  }
+
+  // @return false on a desync, the frame is not emulated
+  bool advance(bool resim);
+  bool rollback();
+  void receive();
+  void send();
+  void flush(int64_t nowUs);
+
+  NetplayConfig config_;
+  SaveFn save_;
+  LoadFn load_;
+  RunFn run_;
+
+  intptr_t socket_ = -1;
+  std::vector<uint8_t> remoteAddr_;
+
+  size_t frame_ = 0;          // Next frame to emulate
+  size_t rollbackTo_ = NONE;  // First mispredicted frame
+  size_t localCount_ = 0;     // Frames of local input known
+  size_t remoteCount_ = 0;    // Frames of remote input received, contiguous
+  size_t remoteAck_ = 0;      // Frames of local input the remote player has
+  size_t remoteFrame_ = 0;    // Last frame reported by the remote player
+  bool syncWait_ = false;
+
+  std::vector<int32_t> localInputs_;
+  std::vector<int32_t> remoteInputs_;
+  std::vector<int32_t> usedRemote_;   // Remote input each frame actually ran with
+  std::vector<int32_t> frameInput_;
+  std::vector<std::vector<uint8_t>> states_;
+
+  int64_t peerSendUs_ = 0;    // Timestamp of the last remote packet, echoed back
+  int64_t peerRecvUs_ = 0;
+
+  std::deque<Outgoing> outgoing_;
+  std::mt19937 rng_;
+  std::vector<uint8_t> packet_;
+
+  NetplayStats stats_;
+};
@@ -0,0 +1,174 @@
+#include "perfcounters.h"
+#include "logsink.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <mutex>
+
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+  #include <cpuid.h>
+#endif
+
+
+namespace
+{
+
+  struct Registration
+  {
+    const void * owner;
+    retro_perf_counter * counter;
+  };
+
+  // Registration happens once per counter, the core pool may do it from its own thread
+  std::mutex gRegistryMutex;
+  std::vector<Registration> gRegistry;
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+  void cpuid(unsigned leaf, unsigned regs[4])
+  {
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, (int)leaf, 0);
+    for (int i = 0; i < 4; i++) regs[i] = (unsigned)r[i];
+#else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+  }
+
+  uint64_t detectCpuFeatures()
+  {
+    unsigned regs[4] = {};
+    cpuid(0, regs);
+    const unsigned maxLeaf = regs[0];
+    if (maxLeaf < 1) return 0;
+
+    cpuid(1, regs);
+    const unsigned ecx = regs[2], edx = regs[3];
+    uint64_t features = 0;
+    if (edx & (1u << 23)) features |= RETRO_SIMD_MMX;
+    if (edx & (1u << 25)) features |= RETRO_SIMD_SSE | RETRO_SIMD_MMXEXT;
+    if (edx & (1u << 26)) features |= RETRO_SIMD_SSE2;
+    if (ecx & (1u << 0)) features |= RETRO_SIMD_SSE3;
+    if (ecx & (1u << 9)) features |= RETRO_SIMD_SSSE3;
+    if (ecx & (1u << 19)) features |= RETRO_SIMD_SSE4;
+    if (ecx & (1u << 20)) features |= RETRO_SIMD_SSE42;
+    if (ecx & (1u << 25)) features |= RETRO_SIMD_AES;
+
+    // AVX also needs the OS to save the YMM registers
+    const bool osAvx = (ecx & (1u << 27)) && (ecx & (1u << 28));
+    if (osAvx) {
+#if defined(_MSC_VER)
+      const uint64_t xcr0 = _xgetbv(0);
+#else
+      unsigned lo, hi;
+      __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+      const uint64_t xcr0 = ((uint64_t)hi << 32) | lo;
+#endif
+      if ((xcr0 & 6) == 6) {
+        features |= RETRO_SIMD_AVX;
+        if (maxLeaf >= 7) {
+          cpuid(7, regs);
+          if (regs[1] & (1u << 5)) features |= RETRO_SIMD_AVX2;
+        }
+      }
+    }
+    return features;
+  }
+#else
+  uint64_t detectCpuFeatures()
+  {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(__aarch64__)
+    return RETRO_SIMD_NEON;
+#else
+    return 0;
+#endif
+  }
+#endif
+
+  const uint64_t gCpuFeatures = detectCpuFeatures();
+
+  PerfCounterStats statsOf(const retro_perf_counter & counter, double ticksPerUs)
+  {
+    PerfCounterStats stats;
+    stats.ident = counter.ident ? counter.ident : "";
+    stats.calls = counter.call_cnt;
+    stats.totalUs = counter.total / ticksPerUs;
+    stats.meanUs = counter.call_cnt ? stats.totalUs / counter.call_cnt : 0.0;
+    return stats;
+  }
+
+} // anonymous namespace
+
+uint64_t perfCpuFeatures()
+{
+  return gCpuFeatures;
+}
+
+void perfStart(retro_perf_counter * counter)
+{
+  if (counter) counter->start = timingTicks();
+}
+
+void perfStop(retro_perf_counter * counter)
+{
+  if (!counter) return;
+  counter->total += timingTicks() - counter->start;
+  counter->call_cnt++;
+}
+
+void perfRegister(const void * owner, retro_perf_counter * counter)
+{
+  if (!counter) return;
+
+  std::lock_guard<std::mutex> lock(gRegistryMutex);
+  counter->registered = true;
+  for (const auto & reg : gRegistry) {
+    if (reg.counter == counter) return;
+  }
+  gRegistry.push_back(Registration { owner, counter });
+}
+
+void perfRelease(const void * owner)
+{
+  std::lock_guard<std::mutex> lock(gRegistryMutex);
+  gRegistry.erase(std::remove_if(gRegistry.begin(), gRegistry.end(), [owner](const Registration & reg) {
+    return reg.owner == owner;
+  }), gRegistry.end());
+}
+
+std::vector<PerfCounterStats> perfCounters(const void * owner)
+{
+  const double ticksPerUs = timingTicksPerUs();
+  std::vector<PerfCounterStats> result;
+
+  std::lock_guard<std::mutex> lock(gRegistryMutex);
+  for (const auto & reg : gRegistry) {
+    if (reg.owner == owner) result.push_back(statsOf(*reg.counter, ticksPerUs));
+  }
+  return result;
+}
+
+void perfReset(const void * owner)
+{
+  std::lock_guard<std::mutex> lock(gRegistryMutex);
+  for (const auto & reg : gRegistry) {
+    if (reg.owner != owner) continue;
+    reg.counter->total = 0;
+    reg.counter->call_cnt = 0;
+  }
+}
+
+void perfLog(const void * owner)
+{
+  auto counters = perfCounters(owner);
+  std::sort(counters.begin(), counters.end(), [](const PerfCounterStats & a, const PerfCounterStats & b) {
+    return a.totalUs > b.totalUs;
+  });
+
+  for (const auto & counter : counters) {
+    logWrite(LOG_INFO, "[perf] %s: %llu calls, %.1f us total, %.3f us per call", counter.ident.c_str(),
+      (unsigned long long)counter.calls, counter.totalUs, counter.meanUs);
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "retro.h"
+
+
+// CORE PERFORMANCE COUNTERS
+//--------------------------------------------------------------------------------------------------
+
+// Backs RETRO_ENVIRONMENT_GET_PERF_INTERFACE. Counters live in the core (usually statics of its
+// library) and the core updates them itself through perf_start/perf_stop; the registry only keeps
+// track of which ones exist, per owning instance, so that they can be read at any time.
+//
+// Ticks are those of timingTicks(): TSC cycles on x86, nanoseconds elsewhere.
+
+struct PerfCounterStats
+{
+  std::string ident;
+  uint64_t calls = 0;
+  double totalUs = 0.0;
+  double meanUs = 0.0;
+};
+
+// RETRO_SIMD_* supported by this CPU
+uint64_t perfCpuFeatures();
+
+// perf_start and perf_stop, which only touch the counter
+void perfStart(retro_perf_counter * counter);
+void perfStop(retro_perf_counter * counter);
+
+// @param owner Instance whose library holds the counter, registering again is a no-op
+void perfRegister(const void * owner, retro_perf_counter * counter);
+
+// Forgets the counters of `owner`, before its library is unloaded
+void perfRelease(const void * owner);
+
+// @note Only reads the counters, the owner's core must not be running on another thread
+std::vector<PerfCounterStats> perfCounters(const void * owner);
+
+// Zeroes the totals and call counts
+void perfReset(const void * owner);
+
+// Writes the counters to the log, sorted by total time
+void perfLog(const void * owner);
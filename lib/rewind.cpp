@@ -0,0 +1,171 @@
+#include "rewind.h"
+
+#include <chrono>
+#include <cstring>
+
+#include "compress.h"
+
+
+RewindBuffer::RewindBuffer(size_t budget)
+{
+  stats_.budget = budget;
+  ring_.resize(budget);
+  thread_ = std::thread(&RewindBuffer::worker_, this);
+}
+
+RewindBuffer::~RewindBuffer()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  cond_.notify_all();
+  thread_.join();
+}
+
+void RewindBuffer::push(std::vector<uint8_t> & state, size_t frame)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (hasPending_ || busy_) {
+      stats_.dropped++;
+      return;
+    }
+    pending_.swap(state);
+    pendingFrame_ = frame;
+    hasPending_ = true;
+    stats_.pushed++;
+
+    // Keep the caller's buffer at the right size so it never reallocates
+    if (state.size() != pending_.size()) state.resize(pending_.size());
+  }
+  cond_.notify_all();
+}
+
+size_t RewindBuffer::rewind(size_t targetFrame, std::vector<uint8_t> & state, size_t & frame)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  waitIdle_(lock);
+  if (current_.empty()) return 0;
+
+  size_t done = 0;
+  while ((done == 0 || currentFrame_ > targetFrame) && !entries_.empty()) {
+    const Entry & e = entries_.back();
+    if (!deltaApply(&ring_[e.offset], e.size, &current_[0], current_.size())) {
+      // Corrupted history, keep what was reconstructed so far
+      entries_.clear();
+      break;
+    }
+    head_ = e.offset;
+    currentFrame_ = e.frame;
+    entries_.pop_back();
+    done++;
+  }
+  if (entries_.empty()) head_ = 0;
+
+  frame = currentFrame_;
+  state.resize(current_.size());
+  memcpy(&state[0], &current_[0], current_.size());
+  return done;
+}
+
+void RewindBuffer::clear()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  waitIdle_(lock);
+  current_.clear();
+  entries_.clear();
+  head_ = 0;
+}
+
+RewindStats RewindBuffer::stats()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  RewindStats res = stats_;
+  res.entries = entries_.size();
+  res.used = current_.size();
+  for (const auto & e : entries_) res.used += e.size;
+  return res;
+}
+
+void RewindBuffer::waitIdle_(std::unique_lock<std::mutex> & lock)
+{
+  cond_.wait(lock, [this] { return !hasPending_ && !busy_; });
+}
+
+void RewindBuffer::worker_()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this] { return quit_ || hasPending_; });
+    if (quit_) return;
+
+    std::vector<uint8_t> state;
+    state.swap(pending_);
+    const size_t frame = pendingFrame_;
+    hasPending_ = false;
+    busy_ = true;
+
+    // Only the helper thread touches current_ and scratch_ while busy_ is set
+    const bool sameSize = (current_.size() == state.size());
+    lock.unlock();
+    const auto start = std::chrono::steady_clock::now();
+    if (sameSize) {
+      // Delta that turns the new state back into the current one
+      scratch_.clear();
+      deltaEncode(&current_[0], &state[0], state.size(), scratch_);
+    }
+    const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    lock.lock();
+
+    if (sameSize) {
+      stats_.encodeUs += us;
+      stats_.rawBytes += state.size();
+      stats_.encodedBytes += scratch_.size();
+      if (!store_(scratch_, currentFrame_)) entries_.clear();
+    }
+    else {
+      // First state, or the core changed its state size: history is useless
+      entries_.clear();
+      head_ = 0;
+    }
+    current_.swap(state);
+    currentFrame_ = frame;
+
+    // Recycled for the next push
+    state.resize(current_.size());
+    pending_.swap(state);
+    busy_ = false;
+    cond_.notify_all();
+  }
+}
+
+bool RewindBuffer::store_(const std::vector<uint8_t> & enc, size_t frame)
+{
+  // The latest full state counts against the budget too
+  const size_t capacity = ring_.size() > current_.size() ? ring_.size() - current_.size() : 0;
+  if (enc.empty() || enc.size() > capacity) return false;
+
+  size_t used = 0;
+  for (const auto & e : entries_) used += e.size;
+
+  // Evict the oldest deltas until the new one fits, head_ never catches up with the tail
+  while (!entries_.empty()) {
+    const size_t tail = entries_.front().offset;
+    const bool fits = (head_ >= tail)
+      ? (head_ + enc.size() <= ring_.size() || enc.size() < tail)
+      : (head_ + enc.size() < tail);
+    if (fits && used + enc.size() <= capacity) break;
+    used -= entries_.front().size;
+    entries_.pop_front();
+  }
+  if (entries_.empty()) head_ = 0;
+
+  // Wrap when the end of the ring is too short
+  if (head_ + enc.size() > ring_.size()) head_ = 0;
+
+  memcpy(&ring_[head_], &enc[0], enc.size());
+  entries_.push_back(Entry { head_, enc.size(), frame });
+  head_ += enc.size();
+  return true;
+}
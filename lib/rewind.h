@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// REWIND BUFFER
+//--------------------------------------------------------------------------------------------------
+
+struct RewindStats
+{
+  size_t budget = 0;     // Bytes
+  size_t used = 0;       // Bytes, deltas and the latest full state
+  size_t entries = 0;    // States that can be stepped back to
+  size_t pushed = 0;
+  size_t dropped = 0;    // States skipped because the helper thread was still busy
+  double encodeUs = 0.0; // Accumulated delta encoding time, in microseconds
+  size_t rawBytes = 0;   // Accumulated size of the states before encoding
+  size_t encodedBytes = 0;
+};
+
+// Keeps the latest state in full and, in a fixed size ring, the XOR deltas needed to walk back
+// to the older ones. Encoding happens on a helper thread; dropping the oldest delta never
+// invalidates the newer ones.
+class RewindBuffer
+{
+public:
+  explicit RewindBuffer(size_t budget);
+  ~RewindBuffer();
+
+  RewindBuffer(const RewindBuffer &) = delete;
+  RewindBuffer & operator=(const RewindBuffer &) = delete;
+
+  // Hands a serialized state over to the helper thread, unless it is still busy with the previous
+  // one: the history then has a gap, which the frame numbers account for
+  // @param frame Frame the state was captured at
+  // @note `state` is swapped with a recycled buffer of the same size, no copy happens
+  void push(std::vector<uint8_t> & state, size_t frame);
+
+  // Steps back at least one state, then on until a state captured at or before `targetFrame`,
+  // and writes the resulting state into `state`
+  // @param frame Set to the frame that state was captured at
+  // @return Number of states actually stepped back
+  size_t rewind(size_t targetFrame, std::vector<uint8_t> & state, size_t & frame);
+
+  void clear();
+  RewindStats stats();
+
+private:
+  struct Entry
+  {
+    size_t offset;
+    size_t size;
+    size_t frame; // Of the state the delta restores
+  };
+
+  void worker_();
+  bool store_(const std::vector<uint8_t> & enc, size_t frame);
+  void waitIdle_(std::unique_lock<std::mutex> & lock);
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::thread thread_;
+  bool quit_ = false;
+  bool busy_ = false;
+
+  std::vector<uint8_t> pending_;
+  size_t pendingFrame_ = 0;
+  bool hasPending_ = false;
+  std::vector<uint8_t> current_;
+  size_t currentFrame_ = 0;
+  std::vector<uint8_t> spare_;
+  std::vector<uint8_t> scratch_;
+
+  // Ring of encoded deltas, oldest first
+  std::vector<uint8_t> ring_;
+  std::deque<Entry> entries_;
+  size_t head_ = 0; // Next write offset
+
+  RewindStats stats_;
+};
@@ -0,0 +1,100 @@
+#include "romcache.h"
+#include "zip.h"
+
+#include <sys/stat.h>
+#include <map>
+#include <mutex>
+
+
+namespace
+{
+
+  // File images are only reused while the file on disk keeps the same mtime and size
+  struct CachedImage
+  {
+    std::shared_ptr<const RomImage> image;
+    int64_t mtime = 0;
+    int64_t size = 0;
+    bool put = false; // From romCachePut, the disk is not checked
+  };
+
+  std::mutex gMutex;
+  std::map<std::string, CachedImage> gImages;
+  std::map<std::string, CachedImage> gArchiveFiles; // Mapped, not extracted
+  RomCacheStats gStats;
+
+} // anonymous namespace
+
+std::shared_ptr<const RomImage> romCacheGet(const std::string & path, bool extract)
+{
+  std::string archive, entry;
+  const bool isArchive = zipSplitPath(path, archive, entry);
+  auto & images = (isArchive && !extract) ? gArchiveFiles : gImages;
+
+  struct stat st;
+  const bool exists = stat((isArchive ? archive : path).c_str(), &st) == 0;
+  const int64_t mtime = exists ? (int64_t)st.st_mtime : 0;
+  const int64_t size = exists ? (int64_t)st.st_size : 0;
+
+  {
+    std::lock_guard<std::mutex> lock(gMutex);
+    const auto it = images.find(path);
+    if (it != images.end() && (it->second.put || (exists && it->second.mtime == mtime && it->second.size == size))) {
+      gStats.hits++;
+      return it->second.image;
+    }
+    gStats.misses++;
+  }
+  if (!exists) return nullptr;
+
+  // Loaded outside the lock, decompressing an archive entry takes a while
+  std::shared_ptr<RomImage> image(new RomImage());
+  if (isArchive && extract) {
+    std::string error;
+    const auto zip = zipOpen(archive, error);
+    const ZipEntry * found = zip ? zip->find(entry) : nullptr;
+    if (!found || !zip->extract(*found, image->buffer_, error)) return nullptr;
+  }
+  else if (!image->file_.open(path)) {
+    return nullptr;
+  }
+
+  // Another thread may have loaded the same version meanwhile, a changed file replaces the image
+  std::lock_guard<std::mutex> lock(gMutex);
+  CachedImage & cached = images[path];
+  if (cached.image && (cached.put || (cached.mtime == mtime && cached.size == size))) return cached.image;
+  cached.image = image;
+  cached.mtime = mtime;
+  cached.size = size;
+  return image;
+}
+
+void romCachePut(const std::string & path, const void * data, size_t size)
+{
+  std::shared_ptr<RomImage> image(new RomImage());
+  const uint8_t * bytes = (const uint8_t *)data;
+  image->buffer_.assign(bytes, bytes + size);
+
+  std::lock_guard<std::mutex> lock(gMutex);
+  CachedImage & cached = gImages[path];
+  cached.image = image;
+  cached.put = true;
+}
+
+void romCacheClear()
+{
+  std::lock_guard<std::mutex> lock(gMutex);
+  gImages.clear();
+  gArchiveFiles.clear();
+}
+
+RomCacheStats romCacheStats()
+{
+  std::lock_guard<std::mutex> lock(gMutex);
+  RomCacheStats stats = gStats;
+  stats.entries = gImages.size() + gArchiveFiles.size();
+  stats.bytes = 0;
+  for (const auto & entry : gImages) stats.bytes += entry.second.image->size();
+  for (const auto & entry : gArchiveFiles) stats.bytes += entry.second.image->size();
+  return stats;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+
+
+// ROM CACHE
+//--------------------------------------------------------------------------------------------------
+
+// Read-only content image, either a mapping of the file or a copy of a buffer handed over by JS
+class RomImage
+{
+public:
+  const uint8_t * data() const { return buffer_.empty() ? file_.data() : buffer_.data(); }
+  size_t size() const { return buffer_.empty() ? file_.size() : buffer_.size(); }
+
+private:
+  friend std::shared_ptr<const RomImage> romCacheGet(const std::string & path, bool extract);
+  friend void romCachePut(const std::string & path, const void * data, size_t size);
+
+  MappedFile file_;
+  std::vector<uint8_t> buffer_;
+};
+
+struct RomCacheStats
+{
+  size_t entries = 0;
+  size_t bytes = 0;
+  size_t hits = 0;
+  size_t misses = 0;
+};
+
+// Images are shared by every instance loading the same path for the lifetime of the process, so
+// only the first load touches the disk. Archive entries (see zip.h) are decompressed once. A file
+// whose mtime or size changed is loaded again. Images already handed out stay as they are when the
+// file is replaced, but a mapped file must not be truncated or rewritten in place while in use.
+// @param extract false to map an archive itself, for cores which read archives
+// @note Thread-safe
+// @return nullptr if the file cannot be mapped
+std::shared_ptr<const RomImage> romCacheGet(const std::string & path, bool extract = true);
+
+// Serves `path` from a copy of `data` from now on, whether the file exists or not
+void romCachePut(const std::string & path, const void * data, size_t size);
+
+// Images still in use stay alive until released
+void romCacheClear();
+RomCacheStats romCacheStats();
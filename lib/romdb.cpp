@@ -0,0 +1,197 @@
+#include "romdb.h"
+#include "hash.h"
+#include "zip.h"
+
+#include <string.h>
+#include <algorithm>
+
+
+namespace
+{
+
+  const char MAGIC[4] = { 'R', 'H', 'D', 'B' };
+  const uint32_t VERSION = 1;
+
+  // Both hashes are computed chunk by chunk so each chunk is read from memory once
+  const size_t HASH_CHUNK = 1 << 20;
+
+  struct DiskHeader
+  {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t sha1Count;
+    uint64_t metadataOffset;
+    uint64_t metadataSize;
+  };
+
+  struct DiskRecord
+  {
+    uint32_t crc32;
+    uint32_t metadataSize;
+    uint64_t size;
+    uint64_t metadataOffset; // In the metadata blob
+    uint8_t sha1[20];
+    uint32_t reserved;
+  };
+
+  static_assert(sizeof(DiskHeader) == 32, "DiskHeader must not be padded");
+  static_assert(sizeof(DiskRecord) == 48, "DiskRecord must not be padded");
+
+  bool hasSha1(const uint8_t * sha1)
+  {
+    static const uint8_t zero[20] = {};
+    return memcmp(sha1, zero, 20) != 0;
+  }
+
+  bool readMetadata(const MappedFile & file, const DiskRecord & rec, std::string & metadata)
+  {
+    const DiskHeader * header = (const DiskHeader *)file.data();
+    if (rec.metadataOffset > header->metadataSize || rec.metadataSize > header->metadataSize - rec.metadataOffset) return false;
+    metadata.assign((const char *)file.data() + header->metadataOffset + rec.metadataOffset, rec.metadataSize);
+    return true;
+  }
+
+  void hashBuffer(const uint8_t * data, size_t size, ContentHashes & hashes)
+  {
+    Sha1 sha1;
+    uint32_t crc = 0;
+    for (size_t pos = 0; pos < size; pos += HASH_CHUNK) {
+      const size_t n = std::min(HASH_CHUNK, size - pos);
+      crc = crc32(crc, data + pos, n);
+      sha1.update(data + pos, n);
+    }
+    hashes.size = size;
+    hashes.crc32 = crc;
+    sha1.final(hashes.sha1);
+  }
+
+} // anonymous namespace
+
+bool hashContent(const std::string & path, ContentHashes & hashes, std::string & error)
+{
+  std::string archive, entry;
+  if (zipSplitPath(path, archive, entry)) {
+    const auto zip = zipOpen(archive, error);
+    if (!zip) return false;
+    const ZipEntry * found = zip->find(entry);
+    if (!found) {
+      error = "No " + (entry.empty() ? std::string("file") : entry) + " in " + archive;
+      return false;
+    }
+
+    std::vector<uint8_t> data;
+    if (!zip->extract(*found, data, error)) return false;
+    hashBuffer(data.data(), data.size(), hashes);
+    return true;
+  }
+
+  MappedFile file;
+  if (!file.open(path)) {
+    error = "Cannot open " + path;
+    return false;
+  }
+  file.adviseSequential();
+  hashBuffer(file.data(), file.size(), hashes);
+  return true;
+}
+
+bool hashDbWrite(const std::string & path, std::vector<HashDbRecord> records, std::string & error)
+{
+  std::sort(records.begin(), records.end(), [](const HashDbRecord & a, const HashDbRecord & b) {
+    return a.crc32 != b.crc32 ? a.crc32 < b.crc32 : a.size < b.size;
+  });
+
+  std::vector<DiskRecord> disk(records.size());
+  std::vector<uint32_t> bySha1;
+  std::string metadata;
+  for (size_t i = 0; i < records.size(); i++) {
+    DiskRecord & rec = disk[i];
+    memset(&rec, 0, sizeof(rec));
+    rec.crc32 = records[i].crc32;
+    rec.size = records[i].size;
+    memcpy(rec.sha1, records[i].sha1, sizeof(rec.sha1));
+    rec.metadataOffset = metadata.size();
+    rec.metadataSize = (uint32_t)records[i].metadata.size();
+    metadata += records[i].metadata;
+    if (hasSha1(rec.sha1)) bySha1.push_back((uint32_t)i);
+  }
+  std::sort(bySha1.begin(), bySha1.end(), [&](uint32_t a, uint32_t b) {
+    return memcmp(disk[a].sha1, disk[b].sha1, 20) < 0;
+  });
+
+  DiskHeader header;
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.count = (uint32_t)disk.size();
+  header.sha1Count = (uint32_t)bySha1.size();
+  header.metadataOffset = sizeof(header) + disk.size() * sizeof(DiskRecord) + bySha1.size() * sizeof(uint32_t);
+  header.metadataSize = metadata.size();
+
+  const bool ok = fileWriteAtomic(path, {
+    { &header, sizeof(header) },
+    { disk.data(), disk.size() * sizeof(DiskRecord) },
+    { bySha1.data(), bySha1.size() * sizeof(uint32_t) },
+    { metadata.data(), metadata.size() },
+  }, false);
+  if (!ok) error = "Cannot write " + path;
+  return ok;
+}
+
+bool HashDatabase::open(const std::string & path, std::string & error)
+{
+  count_ = 0;
+  if (!file_.open(path)) {
+    error = "Cannot open " + path;
+    return false;
+  }
+
+  DiskHeader header;
+  bool ok = file_.size() >= sizeof(header);
+  if (ok) {
+    memcpy(&header, file_.data(), sizeof(header));
+    const uint64_t tables = sizeof(header) + (uint64_t)header.count * sizeof(DiskRecord) + (uint64_t)header.sha1Count * sizeof(uint32_t);
+    ok = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+      header.sha1Count <= header.count && header.metadataOffset == tables &&
+      header.metadataSize <= file_.size() && header.metadataOffset <= file_.size() - header.metadataSize;
+  }
+  if (!ok) {
+    error = "Not a hash database: " + path;
+    file_.close();
+    return false;
+  }
+
+  count_ = header.count;
+  return true;
+}
+
+bool HashDatabase::findCrc(uint32_t crc, uint64_t size, std::string & metadata) const
+{
+  if (!count_) return false;
+  const DiskRecord * begin = (const DiskRecord *)(file_.data() + sizeof(DiskHeader));
+  const DiskRecord * end = begin + count_;
+
+  const DiskRecord * rec = std::lower_bound(begin, end, crc, [](const DiskRecord & r, uint32_t c) {
+    return r.crc32 < c;
+  });
+  for (; rec != end && rec->crc32 == crc; rec++) {
+    if (size && rec->size && rec->size != size) continue;
+    return readMetadata(file_, *rec, metadata);
+  }
+  return false;
+}
+
+bool HashDatabase::findSha1(const uint8_t sha1[20], std::string & metadata) const
+{
+  if (!count_ || !hasSha1(sha1)) return false;
+  const DiskHeader * header = (const DiskHeader *)file_.data();
+  const DiskRecord * records = (const DiskRecord *)(file_.data() + sizeof(DiskHeader));
+  const uint32_t * begin = (const uint32_t *)(records + count_);
+  const uint32_t * end = begin + header->sha1Count;
+
+  const uint32_t * it = std::lower_bound(begin, end, sha1, [&](uint32_t i, const uint8_t * key) {
+    return i < count_ && memcmp(records[i].sha1, key, 20) < 0;
+  });
+  if (it == end || *it >= count_ || memcmp(records[*it].sha1, sha1, 20) != 0) return false;
+  return readMetadata(file_, records[*it], metadata);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+
+
+// CONTENT HASHES
+//--------------------------------------------------------------------------------------------------
+
+struct ContentHashes
+{
+  uint64_t size = 0;
+  uint32_t crc32 = 0;
+  uint8_t sha1[20] = {};
+};
+
+// Hashes a file, or an `archive.zip#entry`, in a single pass over its mapping
+// @note Blocking, meant for a worker thread
+bool hashContent(const std::string & path, ContentHashes & hashes, std::string & error);
+
+
+// HASH DATABASE
+//--------------------------------------------------------------------------------------------------
+
+// Maps content hashes to opaque metadata (typically JSON with per-game options and input maps).
+// The file is an array of fixed-size records sorted by CRC, an index of those records sorted by
+// SHA-1, then the metadata blob:
+//   [header] [records] [u32 record index sorted by sha1] [metadata]
+// so lookups are binary searches straight into the mapping, nothing is parsed at open.
+
+struct HashDbRecord
+{
+  uint32_t crc32 = 0;
+  uint64_t size = 0; // 0 when unknown
+  uint8_t sha1[20] = {}; // All zeros when unknown
+  std::string metadata;
+};
+
+bool hashDbWrite(const std::string & path, std::vector<HashDbRecord> records, std::string & error);
+
+class HashDatabase
+{
+public:
+  bool open(const std::string & path, std::string & error);
+
+  size_t size() const { return count_; }
+
+  // @param size 0 to match any size
+  // @return false if no record matches
+  bool findCrc(uint32_t crc, uint64_t size, std::string & metadata) const;
+  bool findSha1(const uint8_t sha1[20], std::string & metadata) const;
+
+private:
+  MappedFile file_;
+  size_t count_ = 0;
+};
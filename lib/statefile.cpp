@@ -0,0 +1,153 @@
+#include "statefile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "compress.h"
+#include "hash.h"
+
+
+namespace
+{
+
+  const char MAGIC[4] = { 'R', 'S', 'T', 'F' };
+  const uint32_t VERSION = 2; // 1 only checksummed the payload
+  const uint32_t FLAG_COMPRESSED = 1 << 0;
+
+  // Rejected before allocating anything, whatever the file claims
+  const uint64_t MAX_STATE_SIZE = 256u << 20;
+
+  // Little endian on disk, like every platform this runs on
+  struct StateFileHeader
+  {
+    char magic[4];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t headerSize;
+    uint64_t stateSize;
+    uint64_t payloadSize;
+    uint32_t crc; // Of the header (this field zeroed), then the payload
+    uint32_t reserved;
+    char coreName[64];
+    char coreVersion[64];
+  };
+
+  static_assert(sizeof(StateFileHeader) == 168, "StateFileHeader layout changed");
+
+  void copyField(char (&dst)[64], const std::string & src)
+  {
+    memset(dst, 0, sizeof(dst));
+    memcpy(dst, src.c_str(), std::min(src.size(), sizeof(dst) - 1));
+  }
+
+  std::string readField(const char (&src)[64])
+  {
+    return std::string(src, strnlen(src, sizeof(src)));
+  }
+
+  uint32_t headerCrc(StateFileHeader header)
+  {
+    header.crc = 0;
+    return crc32(0, &header, sizeof(header));
+  }
+
+} // anonymous namespace
+
+bool stateFileWrite(const std::string & path, const StateFileInfo & info, const uint8_t * state, size_t size,
+                    bool compress, bool sync, std::vector<uint8_t> & scratch, std::string & error)
+{
+  const uint8_t * payload = state;
+  size_t payloadSize = size;
+  if (compress) {
+    scratch.clear();
+    deltaEncode(state, nullptr, size, scratch);
+    payload = scratch.data();
+    payloadSize = scratch.size();
+  }
+
+  StateFileHeader header;
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.flags = compress ? FLAG_COMPRESSED : 0;
+  header.headerSize = sizeof(StateFileHeader);
+  header.stateSize = size;
+  header.payloadSize = payloadSize;
+  header.reserved = 0;
+  copyField(header.coreName, info.coreName);
+  copyField(header.coreVersion, info.coreVersion);
+  header.crc = crc32(headerCrc(header), payload, payloadSize);
+
+  if (!fileWriteAtomic(path, { { &header, sizeof(header) }, { payload, payloadSize } }, sync)) {
+    error = "Cannot write " + path;
+    return false;
+  }
+  return true;
+}
+
+bool StateFileReader::open(const std::string & path, size_t expectedSize, std::string & error)
+{
+  state_ = nullptr;
+  stateSize_ = 0;
+
+  if (!file_.open(path)) {
+    error = "Cannot open " + path;
+    return false;
+  }
+
+  StateFileHeader header;
+  if (file_.size() < sizeof(header)) {
+    error = "Not a state file: " + path;
+    return false;
+  }
+  memcpy(&header, file_.data(), sizeof(header));
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.headerSize < sizeof(header)) {
+    error = "Not a state file: " + path;
+    return false;
+  }
+  if (header.version != VERSION && header.version != 1) {
+    error = "Unsupported state file version " + std::to_string(header.version);
+    return false;
+  }
+  if (header.headerSize > file_.size() || header.payloadSize > file_.size() - header.headerSize) {
+    error = "Truncated state file: " + path;
+    return false;
+  }
+
+  // Everything between the known header and the payload is covered too
+  const uint8_t * payload = file_.data() + header.headerSize;
+  uint32_t crc = 0;
+  if (header.version != 1) {
+    crc = headerCrc(header);
+    crc = crc32(crc, file_.data() + sizeof(header), header.headerSize - sizeof(header));
+  }
+  if (crc32(crc, payload, header.payloadSize) != header.crc) {
+    error = "Corrupted state file: " + path;
+    return false;
+  }
+
+  if (expectedSize ? header.stateSize != expectedSize : header.stateSize > MAX_STATE_SIZE) {
+    error = "State size " + std::to_string(header.stateSize) + " does not match the core";
+    return false;
+  }
+
+  info_.coreName = readField(header.coreName);
+  info_.coreVersion = readField(header.coreVersion);
+
+  if (header.flags & FLAG_COMPRESSED) {
+    decoded_.assign(header.stateSize, 0);
+    if (!deltaApply(payload, header.payloadSize, decoded_.data(), decoded_.size())) {
+      error = "Corrupted state file: " + path;
+      return false;
+    }
+    state_ = decoded_.data();
+  }
+  else {
+    if (header.payloadSize != header.stateSize) {
+      error = "Corrupted state file: " + path;
+      return false;
+    }
+    state_ = payload;
+  }
+  stateSize_ = header.stateSize;
+  return true;
+}
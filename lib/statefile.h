@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+
+
+// SAVE STATE FILES
+//--------------------------------------------------------------------------------------------------
+
+// Layout: StateFileHeader, then the payload (the state, optionally delta codec encoded).
+// The core identity is checked on load since states do not carry over between cores or versions.
+
+struct StateFileInfo
+{
+  std::string coreName;
+  std::string coreVersion;
+};
+
+// Encodes and writes a state atomically, meant to run off the main thread
+// @param scratch Reused between calls to hold the encoded payload
+bool stateFileWrite(const std::string & path, const StateFileInfo & info, const uint8_t * state, size_t size,
+                    bool compress, bool sync, std::vector<uint8_t> & scratch, std::string & error);
+
+// Maps and validates a state file
+class StateFileReader
+{
+public:
+  // @param expectedSize State size of the running core, checked before anything is allocated;
+  //                     0 only bounds it
+  bool open(const std::string & path, size_t expectedSize, std::string & error);
+
+  const StateFileInfo & info() const { return info_; }
+
+  // Points into the mapping itself for uncompressed files
+  const uint8_t * state() const { return state_; }
+  size_t stateSize() const { return stateSize_; }
+
+private:
+  MappedFile file_;
+  std::vector<uint8_t> decoded_;
+  StateFileInfo info_;
+  const uint8_t * state_ = nullptr;
+  size_t stateSize_ = 0;
+};
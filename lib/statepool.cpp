@@ -0,0 +1,161 @@
+#include "statepool.h"
+
+#include <cstring>
+
+
+StatePool::StatePool(size_t stateSize)
+  : stateSize_(stateSize)
+  , pagesPerState_((stateSize + PAGE_SIZE - 1) / PAGE_SIZE)
+{
+}
+
+StatePool::Handle StatePool::save(const uint8_t * data, Handle base)
+{
+  uint32_t baseSlot = 0;
+  const bool hasBase = slotOf_(base, baseSlot);
+
+  uint32_t slot;
+  const Handle handle = newHandle_(slot);
+  if (!handle) return 0;
+
+  for (size_t i=0; i<pagesPerState_; i++) {
+    const size_t offset = i * PAGE_SIZE;
+    const size_t len = (offset + PAGE_SIZE <= stateSize_) ? PAGE_SIZE : stateSize_ - offset;
+
+    if (hasBase) {
+      const uint32_t basePage = slotPages_(baseSlot)[i];
+      if (memcmp(page_(basePage), data + offset, len) == 0) {
+        pageRefs_[basePage]++;
+        slotPages_(slot)[i] = basePage;
+        sharedPages_++;
+        continue;
+      }
+    }
+
+    const uint32_t page = allocPage_();
+    uint8_t * dst = page_(page);
+    memcpy(dst, data + offset, len);
+    if (len < PAGE_SIZE) memset(dst + len, 0, PAGE_SIZE - len);
+    slotPages_(slot)[i] = page;
+    copiedPages_++;
+  }
+
+  return handle;
+}
+
+StatePool::Handle StatePool::fork(Handle handle)
+{
+  uint32_t src;
+  if (!slotOf_(handle, src)) return 0;
+
+  uint32_t slot;
+  const Handle res = newHandle_(slot);
+  if (!res) return 0;
+
+  const uint32_t * srcPages = slotPages_(src);
+  uint32_t * dstPages = slotPages_(slot);
+  for (size_t i=0; i<pagesPerState_; i++) {
+    dstPages[i] = srcPages[i];
+    pageRefs_[srcPages[i]]++;
+  }
+  return res;
+}
+
+bool StatePool::read(Handle handle, uint8_t * data) const
+{
+  uint32_t slot;
+  if (!slotOf_(handle, slot)) return false;
+
+  const uint32_t * pages = slotPages_(slot);
+  for (size_t i=0; i<pagesPerState_; i++) {
+    const size_t offset = i * PAGE_SIZE;
+    const size_t len = (offset + PAGE_SIZE <= stateSize_) ? PAGE_SIZE : stateSize_ - offset;
+    memcpy(data + offset, page_(pages[i]), len);
+  }
+  return true;
+}
+
+bool StatePool::release(Handle handle)
+{
+  uint32_t slot;
+  if (!slotOf_(handle, slot)) return false;
+
+  const uint32_t * pages = slotPages_(slot);
+  for (size_t i=0; i<pagesPerState_; i++) {
+    unrefPage_(pages[i]);
+  }
+  slotLive_[slot] = false;
+  slotGen_[slot]++;
+  freeSlots_.push_back(slot);
+  liveStates_--;
+  return true;
+}
+
+bool StatePool::valid(Handle handle) const
+{
+  uint32_t slot;
+  return slotOf_(handle, slot);
+}
+
+StatePoolStats StatePool::stats() const
+{
+  StatePoolStats res;
+  res.stateSize = stateSize_;
+  res.states = liveStates_;
+  res.arenaBytes = chunks_.size() * PAGES_PER_CHUNK * PAGE_SIZE;
+  res.pages = pageRefs_.size() - freePages_.size();
+  for (const auto refs : pageRefs_) res.pageRefs += refs;
+  res.sharedPages = sharedPages_;
+  res.copiedPages = copiedPages_;
+  return res;
+}
+
+bool StatePool::slotOf_(Handle handle, uint32_t & slot) const
+{
+  if (handle == 0) return false;
+  slot = (handle & SLOT_MASK) - 1;
+  const uint32_t gen = handle >> SLOT_BITS;
+  return slot < slotLive_.size() && slotLive_[slot] && (slotGen_[slot] & (0xFFFFFFFFu >> SLOT_BITS)) == gen;
+}
+
+StatePool::Handle StatePool::newHandle_(uint32_t & slot)
+{
+  if (!freeSlots_.empty()) {
+    slot = freeSlots_.back();
+    freeSlots_.pop_back();
+  }
+  else {
+    if (slotLive_.size() >= SLOT_MASK) return 0;
+    slot = (uint32_t)slotLive_.size();
+    slotLive_.push_back(false);
+    slotGen_.push_back(0);
+    pageTable_.resize(pageTable_.size() + pagesPerState_);
+  }
+
+  slotLive_[slot] = true;
+  liveStates_++;
+  const uint32_t gen = slotGen_[slot] & (0xFFFFFFFFu >> SLOT_BITS);
+  return (gen << SLOT_BITS) | (slot + 1);
+}
+
+uint32_t StatePool::allocPage_()
+{
+  if (freePages_.empty()) {
+    const uint32_t first = (uint32_t)(chunks_.size() * PAGES_PER_CHUNK);
+    chunks_.emplace_back(PAGES_PER_CHUNK * PAGE_SIZE);
+    pageRefs_.resize(pageRefs_.size() + PAGES_PER_CHUNK, 0);
+    for (size_t i=PAGES_PER_CHUNK; i>0; i--) {
+      freePages_.push_back(first + (uint32_t)(i - 1));
+    }
+  }
+
+  const uint32_t page = freePages_.back();
+  freePages_.pop_back();
+  pageRefs_[page] = 1;
+  return page;
+}
+
+void StatePool::unrefPage_(uint32_t page)
+{
+  if (--pageRefs_[page] == 0) freePages_.push_back(page);
+}
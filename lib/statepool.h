@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+
+// SAVE STATE POOL
+//--------------------------------------------------------------------------------------------------
+
+struct StatePoolStats
+{
+  size_t stateSize = 0;   // Bytes
+  size_t states = 0;      // Live handles
+  size_t pages = 0;       // Distinct pages in use
+  size_t pageRefs = 0;    // Pages referenced by all live states
+  size_t arenaBytes = 0;  // Memory reserved for pages
+  size_t sharedPages = 0; // Pages found identical to the base state when saving
+  size_t copiedPages = 0;
+};
+
+// Save states split into 4 KiB pages allocated from an arena. Pages are reference counted and
+// shared between a state and the one it was derived from whenever their content is identical,
+// so sibling states in a search tree only pay for what they changed.
+class StatePool
+{
+public:
+  // 0 is never a valid handle
+  typedef uint32_t Handle;
+
+  static const size_t PAGE_SIZE = 4096;
+
+  explicit StatePool(size_t stateSize);
+
+  StatePool(const StatePool &) = delete;
+  StatePool & operator=(const StatePool &) = delete;
+
+  size_t stateSize() const { return stateSize_; }
+
+  // Stores `data` (stateSize() bytes), sharing the pages which did not change since `base`
+  // @param base May be 0 or a released handle, in which case nothing is shared
+  Handle save(const uint8_t * data, Handle base);
+
+  // New handle referencing the same pages, nothing is copied
+  Handle fork(Handle handle);
+
+  // Gathers the pages of a state into `data` (stateSize() bytes)
+  bool read(Handle handle, uint8_t * data) const;
+
+  bool release(Handle handle);
+  bool valid(Handle handle) const;
+
+  StatePoolStats stats() const;
+
+private:
+  // Handles carry a generation so that a released and reused slot is not mistaken for the old one
+  static const uint32_t SLOT_BITS = 20;
+  static const uint32_t SLOT_MASK = (1u << SLOT_BITS) - 1;
+  static const size_t PAGES_PER_CHUNK = 256;
+
+  uint32_t * slotPages_(uint32_t slot) { return &pageTable_[slot * pagesPerState_]; }
+  const uint32_t * slotPages_(uint32_t slot) const { return &pageTable_[slot * pagesPerState_]; }
+  uint8_t * page_(uint32_t page) { return chunks_[page / PAGES_PER_CHUNK].data() + (page % PAGES_PER_CHUNK) * PAGE_SIZE; }
+  const uint8_t * page_(uint32_t page) const { return chunks_[page / PAGES_PER_CHUNK].data() + (page % PAGES_PER_CHUNK) * PAGE_SIZE; }
+
+  bool slotOf_(Handle handle, uint32_t & slot) const;
+  Handle newHandle_(uint32_t & slot);
+  uint32_t allocPage_();
+  void unrefPage_(uint32_t page);
+
+  size_t stateSize_;
+  size_t pagesPerState_;
+
+  // Page arena
+  std::vector<std::vector<uint8_t>> chunks_;
+  std::vector<uint32_t> pageRefs_;
+  std::vector<uint32_t> freePages_;
+
+  // Fixed-size page lists of every slot, back to back
+  std::vector<uint32_t> pageTable_;
+  std::vector<uint32_t> slotGen_;
+  std::vector<bool> slotLive_;
+  std::vector<uint32_t> freeSlots_;
+
+  size_t liveStates_ = 0;
+  size_t sharedPages_ = 0;
+  size_t copiedPages_ = 0;
+};
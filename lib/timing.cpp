@@ -0,0 +1,155 @@
+#include "timing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+
+namespace
+{
+
+  typedef std::chrono::steady_clock Clock;
+
+  const char * const STAGE_NAMES[TIMING_STAGE_COUNT] = {
+    "frame", "run", "video", "audio", "input", "marshal",
+  };
+
+  inline unsigned highestBit(uint64_t v)
+  {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(v);
+#else
+    unsigned bit = 0;
+    while (v >>= 1) bit++;
+    return bit;
+#endif
+  }
+
+  inline size_t bucketOf(uint64_t ticks)
+  {
+    const unsigned SUB_BITS = TimingHistogram::SUB_BITS;
+    if (ticks < (2u << SUB_BITS)) return (size_t)ticks;
+
+    const unsigned shift = highestBit(ticks) - SUB_BITS;
+    const size_t bucket = ((size_t)shift << SUB_BITS) + (size_t)(ticks >> shift);
+    return std::min(bucket, TimingHistogram::BUCKET_COUNT - 1);
+  }
+
+  inline uint64_t bucketUpperBound(size_t bucket)
+  {
+    const unsigned SUB_BITS = TimingHistogram::SUB_BITS;
+    if (bucket < (2u << SUB_BITS)) return bucket;
+
+    const unsigned shift = (unsigned)(bucket >> SUB_BITS) - 1;
+    const uint64_t mantissa = bucket - ((size_t)shift << SUB_BITS);
+    return ((mantissa + 1) << shift) - 1;
+  }
+
+#if TIMING_USE_TSC
+  // Reference points taken at load time; the ratio is refined on every read until the interval
+  // is long enough to be precise, then frozen
+  struct TscCalibration
+  {
+    TscCalibration() : time(Clock::now()), ticks(timingTicks()) {}
+
+    const Clock::time_point time;
+    const uint64_t ticks;
+    std::atomic<double> frozen { 0.0 };
+  };
+
+  TscCalibration gCalibration;
+#endif
+
+} // anonymous namespace
+
+double timingTicksPerUs()
+{
+#if TIMING_USE_TSC
+  const double frozen = gCalibration.frozen.load(std::memory_order_relaxed);
+  if (frozen > 0.0) return frozen;
+
+  const std::chrono::milliseconds MIN_INTERVAL(5);
+  if (Clock::now() - gCalibration.time < MIN_INTERVAL) {
+    std::this_thread::sleep_until(gCalibration.time + MIN_INTERVAL);
+  }
+
+  const uint64_t ticks = timingTicks();
+  const auto elapsed = Clock::now() - gCalibration.time;
+  const double us = std::chrono::duration<double, std::micro>(elapsed).count();
+  const double ratio = (double)(ticks - gCalibration.ticks) / us;
+  if (elapsed >= std::chrono::seconds(1)) gCalibration.frozen.store(ratio, std::memory_order_relaxed);
+  return ratio;
+#else
+  return 1000.0; // Nanoseconds
+#endif
+}
+
+void TimingHistogram::record(uint64_t ticks)
+{
+  buckets_[bucketOf(ticks)]++;
+  count_++;
+  sum_ += ticks;
+  max_ = std::max(max_, ticks);
+}
+
+void TimingHistogram::reset()
+{
+  std::fill(buckets_, buckets_ + BUCKET_COUNT, 0);
+  count_ = 0;
+  sum_ = 0;
+  max_ = 0;
+}
+
+uint64_t TimingHistogram::percentile(double q) const
+{
+  if (!count_) return 0;
+
+  const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(q * count_ + 0.5));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BUCKET_COUNT; i++) {
+    seen += buckets_[i];
+    if (seen >= rank) return std::min(bucketUpperBound(i), max_);
+  }
+  return max_;
+}
+
+const char * timingStageName(TimingStage stage)
+{
+  return stage < TIMING_STAGE_COUNT ? STAGE_NAMES[stage] : "";
+}
+
+FrameTimings::FrameTimings()
+  : histograms_(new TimingHistogram[TIMING_STAGE_COUNT])
+{
+}
+
+void FrameTimings::endFrame(uint64_t frameTicks)
+{
+  pending_[TIMING_FRAME] = frameTicks;
+  for (size_t i = 0; i < TIMING_STAGE_COUNT; i++) {
+    if (pending_[i]) histograms_[i].record(pending_[i]);
+    pending_[i] = 0;
+  }
+}
+
+TimingSummary FrameTimings::summary(TimingStage stage) const
+{
+  const TimingHistogram & histogram = histograms_[stage];
+  const double perUs = timingTicksPerUs();
+
+  TimingSummary summary;
+  summary.count = histogram.count();
+  summary.meanUs = histogram.mean() / perUs;
+  summary.p50Us = histogram.percentile(0.50) / perUs;
+  summary.p90Us = histogram.percentile(0.90) / perUs;
+  summary.p99Us = histogram.percentile(0.99) / perUs;
+  summary.maxUs = histogram.max() / perUs;
+  return summary;
+}
+
+void FrameTimings::reset()
+{
+  for (size_t i = 0; i < TIMING_STAGE_COUNT; i++) histograms_[i].reset();
+  std::fill(pending_, pending_ + TIMING_STAGE_COUNT, 0);
+}
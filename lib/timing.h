@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#if WIN32
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define TIMING_USE_TSC 1
+#else
+#include <chrono>
+#endif
+
+
+// FRAME TIMINGS
+//--------------------------------------------------------------------------------------------------
+
+// Always on, so a scope costs two timestamp reads and an add. Timestamps are raw TSC ticks where
+// available (the TSC is invariant on anything recent), and only converted to microseconds when
+// the stats are read.
+
+inline uint64_t timingTicks()
+{
+#if TIMING_USE_TSC
+  return __rdtsc();
+#else
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Calibrated against steady_clock, the first call may wait a few milliseconds
+double timingTicksPerUs();
+
+// Log-linear buckets over ticks: exact below 64, then 32 buckets per power of two, which bounds
+// the error of any percentile to about 3% of its value. Fixed size, recording never allocates.
+class TimingHistogram
+{
+public:
+  static const unsigned SUB_BITS = 5;
+  static const unsigned MAX_BITS = 44; // Longer samples land in the last bucket
+  static const size_t BUCKET_COUNT = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+  void record(uint64_t ticks);
+  void reset();
+
+  uint64_t count() const { return count_; }
+  uint64_t max() const { return max_; }
+  double mean() const { return count_ ? (double)sum_ / count_ : 0.0; }
+
+  // @param q In [0, 1]
+  // @return Upper bound of the bucket holding the q-th sample, in ticks
+  uint64_t percentile(double q) const;
+
+private:
+  uint32_t buckets_[BUCKET_COUNT] = {};
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+  uint64_t max_ = 0;
+};
+
+// Where the time of a coreUpdate goes. The core's callbacks run from within retro_run, so RUN
+// includes VIDEO, AUDIO and INPUT.
+enum TimingStage
+{
+  TIMING_FRAME = 0, // The whole coreUpdate
+  TIMING_RUN,       // retro_run, speculative frames included
+  TIMING_VIDEO,     // Pixel conversion in the video callback
+  TIMING_AUDIO,     // Audio batching
+  TIMING_INPUT,     // Input polling
+  TIMING_MARSHAL,   // Copies of the frame's video and audio to JS
+  TIMING_STAGE_COUNT,
+};
+
+const char * timingStageName(TimingStage stage);
+
+struct TimingSummary
+{
+  uint64_t count = 0; // Frames
+  double meanUs = 0.0;
+  double p50Us = 0.0;
+  double p90Us = 0.0;
+  double p99Us = 0.0;
+  double maxUs = 0.0;
+};
+
+// One histogram per stage, sampled once per frame: a stage entered several times within a frame
+// records the sum. Stages absent from a frame (no audio, say) record nothing for it.
+class FrameTimings
+{
+public:
+  FrameTimings();
+
+  void add(TimingStage stage, uint64_t ticks) { pending_[stage] += ticks; }
+
+  // Records the pending sums and FRAME itself
+  void endFrame(uint64_t frameTicks);
+
+  TimingSummary summary(TimingStage stage) const;
+  void reset();
+
+private:
+  std::unique_ptr<TimingHistogram[]> histograms_; // ~5KB each, kept off the owner
+  uint64_t pending_[TIMING_STAGE_COUNT] = {};
+};
+
+// Times a scope into `timings`, which may be null to time nothing
+class TimingScope
+{
+public:
+  TimingScope(FrameTimings * timings, TimingStage stage)
+    : timings_(timings), stage_(stage), start_(timings ? timingTicks() : 0) {}
+
+  ~TimingScope()
+  {
+    if (timings_) timings_->add(stage_, timingTicks() - start_);
+  }
+
+private:
+  FrameTimings * timings_;
+  TimingStage stage_;
+  uint64_t start_;
+};
@@ -0,0 +1,518 @@
+#include "zip.h"
+#include "hash.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+
+namespace
+{
+
+  // INFLATE
+  //------------------------------------------------------------------------------------------------
+
+  const unsigned FAST_BITS = 10;
+  const unsigned MAX_BITS = 15;
+
+  const uint16_t LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+  const uint8_t LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+  const uint16_t DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+  const uint8_t DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+  const uint8_t CODE_LENGTH_ORDER[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+  // LSB-first bit buffer. Reading past the end feeds zeros and flags the stream as truncated, so
+  // the decoder never has to check for the end of the input in its inner loop.
+  class BitReader
+  {
+  public:
+    BitReader(const uint8_t * data, size_t size) : p_(data), end_(data + size) {}
+
+    bool overrun() const { return count_ < pad_; }
+
+    uint32_t peek(unsigned n)
+    {
+      if (count_ < n) refill();
+      return (uint32_t)(buf_ & ((1ull << n) - 1));
+    }
+
+    void consume(unsigned n)
+    {
+      buf_ >>= n;
+      count_ -= n;
+    }
+
+    uint32_t bits(unsigned n)
+    {
+      const uint32_t v = peek(n);
+      consume(n);
+      return v;
+    }
+
+    // Drops the partial byte and hands back the bytes still buffered, for stored blocks
+    const uint8_t * alignToByte()
+    {
+      consume(count_ & 7);
+      p_ -= (count_ - std::min(count_, pad_)) / 8;
+      buf_ = 0;
+      count_ = 0;
+      pad_ = 0;
+      return p_;
+    }
+
+    size_t remaining() const { return end_ - p_; }
+    void skip(size_t n) { p_ += n; }
+
+  private:
+    void refill()
+    {
+      while (count_ <= 56) {
+        if (p_ < end_) {
+          buf_ |= (uint64_t)*p_++ << count_;
+        } else {
+          pad_ += 8;
+        }
+        count_ += 8;
+      }
+    }
+
+    const uint8_t * p_;
+    const uint8_t * end_;
+    uint64_t buf_ = 0;
+    unsigned count_ = 0;
+    unsigned pad_ = 0; // Zero bits fed past the end, always at the top of the buffer
+  };
+
+  // Canonical Huffman code: short codes resolve with a single table lookup, longer ones walk the
+  // code lengths one bit at a time
+  struct Huffman
+  {
+    uint16_t fast[1 << FAST_BITS]; // (length << 9) | symbol, 0 when the code is longer
+    uint16_t count[MAX_BITS + 1];
+    uint16_t symbol[288];
+
+    bool build(const uint8_t * lengths, unsigned n)
+    {
+      memset(fast, 0, sizeof(fast));
+      memset(count, 0, sizeof(count));
+      for (unsigned i = 0; i < n; i++) count[lengths[i]]++;
+      count[0] = 0;
+
+      int left = 1;
+      for (unsigned len = 1; len <= MAX_BITS; len++) {
+        left = (left << 1) - count[len];
+        if (left < 0) return false; // Over-subscribed
+      }
+
+      uint16_t offset[MAX_BITS + 2];
+      uint32_t next[MAX_BITS + 1];
+      offset[1] = 0;
+      next[1] = 0;
+      for (unsigned len = 1; len <= MAX_BITS; len++) {
+        offset[len + 1] = offset[len] + count[len];
+        if (len > 1) next[len] = (next[len - 1] + count[len - 1]) << 1;
+      }
+
+      for (unsigned sym = 0; sym < n; sym++) {
+        const unsigned len = lengths[sym];
+        if (!len) continue;
+        symbol[offset[len]++] = (uint16_t)sym;
+
+        const uint32_t code = next[len]++;
+        if (len > FAST_BITS) continue;
+        uint32_t rev = 0;
+        for (unsigned i = 0; i < len; i++) rev |= ((code >> i) & 1) << (len - 1 - i);
+        for (uint32_t i = rev; i < (1u << FAST_BITS); i += 1u << len) {
+          fast[i] = (uint16_t)((len << 9) | sym);
+        }
+      }
+      return true;
+    }
+
+    // @return -1 on an unused code
+    int decode(BitReader & in) const
+    {
+      const uint32_t window = in.peek(MAX_BITS);
+      const uint16_t entry = fast[window & ((1 << FAST_BITS) - 1)];
+      if (entry) {
+        in.consume(entry >> 9);
+        return entry & 511;
+      }
+
+      int code = 0, first = 0, index = 0;
+      for (unsigned len = 1; len <= MAX_BITS; len++) {
+        code |= (window >> (len - 1)) & 1;
+        const int n = count[len];
+        if (code - n < first) {
+          in.consume(len);
+          return symbol[index + (code - first)];
+        }
+        index += n;
+        first = (first + n) << 1;
+        code <<= 1;
+      }
+      return -1;
+    }
+  };
+
+  bool inflateCodes(BitReader & in, const Huffman & lit, const Huffman & dist,
+    uint8_t * dst, size_t size, size_t & pos)
+  {
+    for (;;) {
+      const int sym = lit.decode(in);
+      if (sym < 0 || in.overrun()) return false;
+
+      if (sym < 256) {
+        if (pos == size) return false;
+        dst[pos++] = (uint8_t)sym;
+        continue;
+      }
+      if (sym == 256) return true;
+      if (sym > 285) return false;
+
+      const size_t len = LENGTH_BASE[sym - 257] + in.bits(LENGTH_EXTRA[sym - 257]);
+      const int dsym = dist.decode(in);
+      if (dsym < 0 || dsym > 29) return false;
+      const size_t d = DIST_BASE[dsym] + in.bits(DIST_EXTRA[dsym]);
+      if (d > pos || len > size - pos) return false;
+
+      uint8_t * out = dst + pos;
+      const uint8_t * from = out - d;
+      if (d >= len) {
+        memcpy(out, from, len);
+      } else {
+        for (size_t i = 0; i < len; i++) out[i] = from[i];
+      }
+      pos += len;
+    }
+  }
+
+  bool inflateDynamic(BitReader & in, Huffman & lit, Huffman & dist)
+  {
+    const unsigned nlen = in.bits(5) + 257;
+    const unsigned ndist = in.bits(5) + 1;
+    const unsigned ncode = in.bits(4) + 4;
+    if (nlen > 286 || ndist > 30) return false;
+
+    uint8_t lengths[286 + 30] = {};
+    for (unsigned i = 0; i < ncode; i++) lengths[CODE_LENGTH_ORDER[i]] = (uint8_t)in.bits(3);
+
+    Huffman lencode;
+    if (!lencode.build(lengths, 19)) return false;
+    memset(lengths, 0, 19);
+
+    for (unsigned i = 0; i < nlen + ndist;) {
+      const int sym = lencode.decode(in);
+      if (sym < 0 || in.overrun()) return false;
+      if (sym < 16) {
+        lengths[i++] = (uint8_t)sym;
+        continue;
+      }
+
+      uint8_t value = 0;
+      unsigned repeat;
+      if (sym == 16) {
+        if (i == 0) return false;
+        value = lengths[i - 1];
+        repeat = 3 + in.bits(2);
+      } else if (sym == 17) {
+        repeat = 3 + in.bits(3);
+      } else {
+        repeat = 11 + in.bits(7);
+      }
+      if (i + repeat > nlen + ndist) return false;
+      while (repeat--) lengths[i++] = value;
+    }
+
+    if (!lengths[256]) return false; // No end-of-block code
+    return lit.build(lengths, nlen) && dist.build(lengths + nlen, ndist);
+  }
+
+
+  // ARCHIVES
+  //------------------------------------------------------------------------------------------------
+
+  const uint32_t LOCAL_HEADER = 0x04034b50;
+  const uint32_t CENTRAL_HEADER = 0x02014b50;
+  const uint32_t END_OF_DIRECTORY = 0x06054b50;
+  const uint32_t ZIP64_END_OF_DIRECTORY = 0x06064b50;
+
+  // Deflate cannot expand data by more than this (a 258-byte match per 2 bits, roughly)
+  const uint64_t MAX_DEFLATE_RATIO = 1032;
+  const uint32_t ZIP64_LOCATOR = 0x07064b50;
+
+  uint16_t read16(const uint8_t * p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+  uint32_t read32(const uint8_t * p) { return read16(p) | ((uint32_t)read16(p + 2) << 16); }
+  uint64_t read64(const uint8_t * p) { return read32(p) | ((uint64_t)read32(p + 4) << 32); }
+
+  struct CachedArchive
+  {
+    std::shared_ptr<const ZipArchive> archive;
+    int64_t mtime = 0;
+    int64_t size = 0;
+  };
+
+  std::mutex gMutex;
+  std::map<std::string, CachedArchive> gArchives;
+
+} // anonymous namespace
+
+bool inflateRaw(const uint8_t * src, size_t srcSize, uint8_t * dst, size_t dstSize)
+{
+  BitReader in(src, srcSize);
+  std::unique_ptr<Huffman> lit(new Huffman()), dist(new Huffman());
+  bool fixedBuilt = false;
+  size_t pos = 0;
+
+  for (bool last = false; !last;) {
+    last = in.bits(1) != 0;
+    const unsigned type = in.bits(2);
+    if (in.overrun()) return false;
+
+    if (type == 0) {
+      const uint8_t * p = in.alignToByte();
+      if (in.remaining() < 4) return false;
+      const size_t len = read16(p);
+      if (len != (uint16_t)~read16(p + 2)) return false;
+      if (in.remaining() - 4 < len || len > dstSize - pos) return false;
+      memcpy(dst + pos, p + 4, len);
+      in.skip(4 + len);
+      pos += len;
+      continue;
+    }
+
+    if (type == 1) {
+      if (!fixedBuilt) {
+        uint8_t lengths[288 + 30];
+        memset(lengths, 8, 144);
+        memset(lengths + 144, 9, 112);
+        memset(lengths + 256, 7, 24);
+        memset(lengths + 280, 8, 8);
+        memset(lengths + 288, 5, 30);
+        lit->build(lengths, 288);
+        dist->build(lengths + 288, 30);
+        fixedBuilt = true;
+      }
+    } else if (type == 2) {
+      fixedBuilt = false;
+      if (!inflateDynamic(in, *lit, *dist)) return false;
+    } else {
+      return false;
+    }
+
+    if (!inflateCodes(in, *lit, *dist, dst, dstSize, pos)) return false;
+  }
+
+  return pos == dstSize && !in.overrun();
+}
+
+bool ZipArchive::open(const std::string & path, std::string & error)
+{
+  entries_.clear();
+  if (!file_.open(path)) {
+    error = "Cannot open " + path;
+    return false;
+  }
+  if (!readDirectory(error)) {
+    error += ": " + path;
+    file_.close();
+    entries_.clear();
+    return false;
+  }
+  return true;
+}
+
+bool ZipArchive::readDirectory(std::string & error)
+{
+  const uint8_t * data = file_.data();
+  const size_t size = file_.size();
+  error = "Not a zip archive";
+  if (size < 22) return false;
+
+  // The end record sits before a comment of up to 64KB
+  size_t eocd = size - 22;
+  const size_t lowest = size > 22 + 0xffff ? size - 22 - 0xffff : 0;
+  while (read32(data + eocd) != END_OF_DIRECTORY) {
+    if (eocd == lowest) return false;
+    eocd--;
+  }
+
+  uint64_t count = read16(data + eocd + 10);
+  uint64_t dirSize = read32(data + eocd + 12);
+  uint64_t dirOffset = read32(data + eocd + 16);
+
+  if (eocd >= 20 && read32(data + eocd - 20) == ZIP64_LOCATOR) {
+    const uint64_t offset = read64(data + eocd - 20 + 8);
+    if (size < 56 || offset > size - 56 || read32(data + offset) != ZIP64_END_OF_DIRECTORY) return false;
+    count = read64(data + offset + 32);
+    dirSize = read64(data + offset + 40);
+    dirOffset = read64(data + offset + 48);
+  }
+
+  error = "Corrupted zip archive";
+  if (dirOffset > size || dirSize > size - dirOffset) return false;
+
+  const uint8_t * p = data + dirOffset;
+  const uint8_t * end = p + dirSize;
+  entries_.reserve((size_t)std::min<uint64_t>(count, dirSize / 46));
+  for (uint64_t i = 0; i < count; i++) {
+    if (end - p < 46 || read32(p) != CENTRAL_HEADER) return false;
+    const uint16_t flags = read16(p + 8);
+    const size_t nameLen = read16(p + 28);
+    const size_t extraLen = read16(p + 30);
+    const size_t commentLen = read16(p + 32);
+    if ((size_t)(end - p) < 46 + nameLen + extraLen + commentLen) return false;
+
+    ZipEntry entry;
+    entry.name.assign((const char *)p + 46, nameLen);
+    entry.method = read16(p + 10);
+    entry.crc = read32(p + 16);
+    entry.compressedSize = read32(p + 20);
+    entry.size = read32(p + 24);
+    entry.headerOffset = read32(p + 42);
+
+    // Zip64 extra field, holding only the values which overflowed, in this order
+    const uint8_t * extra = p + 46 + nameLen;
+    const uint8_t * extraEnd = extra + extraLen;
+    while (extraEnd - extra >= 4) {
+      const uint16_t id = read16(extra);
+      const size_t len = read16(extra + 2);
+      const uint8_t * field = extra + 4;
+      if ((size_t)(extraEnd - field) < len) break;
+      if (id == 0x0001) {
+        const uint8_t * fieldEnd = field + len;
+        uint64_t * values[3] = { &entry.size, &entry.compressedSize, &entry.headerOffset };
+        for (uint64_t * value : values) {
+          if (*value != 0xffffffff) continue;
+          if (fieldEnd - field < 8) return false;
+          *value = read64(field);
+          field += 8;
+        }
+      }
+      extra += 4 + len;
+    }
+
+    p += 46 + nameLen + extraLen + commentLen;
+
+    // Directories and encrypted entries cannot be loaded as content
+    if (entry.name.empty() || entry.name.back() == '/' || (flags & 1)) continue;
+    entries_.push_back(std::move(entry));
+  }
+
+  error.clear();
+  return true;
+}
+
+const ZipEntry * ZipArchive::find(const std::string & name) const
+{
+  if (name.empty()) return entries_.empty() ? nullptr : &entries_[0];
+  for (const auto & entry : entries_) {
+    if (entry.name == name) return &entry;
+  }
+  return nullptr;
+}
+
+bool ZipArchive::extract(const ZipEntry & entry, std::vector<uint8_t> & out, std::string & error) const
+{
+  const uint8_t * data = file_.data();
+  const size_t size = file_.size();
+  const uint64_t header = entry.headerOffset;
+  if (header > size || size - header < 30 || read32(data + header) != LOCAL_HEADER) {
+    error = "Corrupted zip entry " + entry.name;
+    return false;
+  }
+
+  // The local header repeats the name but may carry a different extra field
+  const uint64_t offset = header + 30 + read16(data + header + 26) + read16(data + header + 28);
+  if (offset > size || entry.compressedSize > size - offset) {
+    error = "Corrupted zip entry " + entry.name;
+    return false;
+  }
+  if (entry.size > SIZE_MAX) {
+    error = "Zip entry too large: " + entry.name;
+    return false;
+  }
+
+  // Sizes come from the headers: bound them by what the data can expand to before allocating
+  const uint64_t maxSize = entry.method == 0 ? entry.compressedSize : entry.compressedSize * MAX_DEFLATE_RATIO;
+  if (entry.size > maxSize) {
+    error = "Corrupted zip entry " + entry.name;
+    return false;
+  }
+
+  const uint8_t * src = data + offset;
+  out.resize((size_t)entry.size);
+  bool ok;
+  if (entry.method == 0) {
+    ok = entry.compressedSize == entry.size;
+    if (ok) memcpy(out.data(), src, out.size());
+  } else if (entry.method == 8) {
+    ok = inflateRaw(src, (size_t)entry.compressedSize, out.data(), out.size());
+  } else {
+    error = "Unsupported compression method for " + entry.name;
+    return false;
+  }
+
+  if (!ok || crc32(0, out.data(), out.size()) != entry.crc) {
+    error = "Corrupted zip entry " + entry.name;
+    out.clear();
+    return false;
+  }
+  return true;
+}
+
+bool zipSplitPath(const std::string & path, std::string & archive, std::string & entry)
+{
+  std::string lower = path;
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+
+  const size_t sep = lower.find(".zip#");
+  if (sep != std::string::npos) {
+    archive = path.substr(0, sep + 4);
+    entry = path.substr(sep + 5);
+    return true;
+  }
+  if (lower.size() > 4 && lower.compare(lower.size() - 4, 4, ".zip") == 0) {
+    archive = path;
+    entry.clear();
+    return true;
+  }
+  return false;
+}
+
+std::shared_ptr<const ZipArchive> zipOpen(const std::string & path, std::string & error)
+{
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    error = "Cannot open " + path;
+    return nullptr;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(gMutex);
+    const auto it = gArchives.find(path);
+    if (it != gArchives.end() && it->second.mtime == (int64_t)st.st_mtime && it->second.size == (int64_t)st.st_size) {
+      return it->second.archive;
+    }
+  }
+
+  std::shared_ptr<ZipArchive> archive(new ZipArchive());
+  if (!archive->open(path, error)) return nullptr;
+
+  std::lock_guard<std::mutex> lock(gMutex);
+  CachedArchive & cached = gArchives[path];
+  cached.archive = archive;
+  cached.mtime = (int64_t)st.st_mtime;
+  cached.size = (int64_t)st.st_size;
+  return archive;
+}
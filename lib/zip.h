@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+
+
+// INFLATE
+//--------------------------------------------------------------------------------------------------
+
+// Decodes a raw deflate stream (RFC 1951) whose decoded size is known up front
+// @return false if the stream is corrupted or does not decode to exactly `dstSize` bytes
+bool inflateRaw(const uint8_t * src, size_t srcSize, uint8_t * dst, size_t dstSize);
+
+
+// ZIP ARCHIVES
+//--------------------------------------------------------------------------------------------------
+
+// Content inside an archive is addressed as `path/to/archive.zip#path/in/archive`. Without the
+// entry part, the first file of the archive is used.
+
+struct ZipEntry
+{
+  std::string name;
+  uint16_t method = 0;
+  uint32_t crc = 0;
+  uint64_t compressedSize = 0;
+  uint64_t size = 0;
+  uint64_t headerOffset = 0; // Local file header
+};
+
+// Read-only view of an archive, stored (0) and deflated (8) entries only
+class ZipArchive
+{
+public:
+  bool open(const std::string & path, std::string & error);
+
+  const std::vector<ZipEntry> & entries() const { return entries_; }
+
+  // @param name Empty for the first file of the archive
+  // @return nullptr if there is no such entry
+  const ZipEntry * find(const std::string & name) const;
+
+  // Decompresses the entry and checks its CRC
+  bool extract(const ZipEntry & entry, std::vector<uint8_t> & out, std::string & error) const;
+
+private:
+  bool readDirectory(std::string & error);
+
+  MappedFile file_;
+  std::vector<ZipEntry> entries_;
+};
+
+// @return true if `path` names an archive, filling its archive path and entry name
+bool zipSplitPath(const std::string & path, std::string & archive, std::string & entry);
+
+// Central directories are parsed once and kept for the lifetime of the process, until the
+// archive changes on disk
+// @note Thread-safe
+// @return nullptr on failure
+std::shared_ptr<const ZipArchive> zipOpen(const std::string & path, std::string & error);